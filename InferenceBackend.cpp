@@ -0,0 +1,71 @@
+#include "InferenceBackend.h"
+#include <string.h>
+#include "PosenetLog.h"
+#define LOG_TAG "INFERENCEBACKEND.CC"
+
+namespace ORB_SLAM2
+{
+    //empty view (no data)
+    TensorView::TensorView()
+    {}
+    
+    //view over a densely packed NHWC buffer
+    TensorView::TensorView(const float* pData, int32_t n, int32_t h, int32_t w, int32_t c) {
+        data = pData;
+        
+        shape[0] = n;
+        shape[1] = h;
+        shape[2] = w;
+        shape[3] = c;
+        
+        //innermost dimension is contiguous
+        strides[3] = 1;
+        strides[2] = c;
+        strides[1] = w * c;
+        strides[0] = h * w * c;
+    }
+    
+    //view over a densely packed NHWC buffer of the given type (raw bytes for UINT8/INT8)
+    TensorView::TensorView(const void* pData, TensorType pType, float pScale, int32_t pZeroPoint, int32_t n, int32_t h, int32_t w, int32_t c)
+    : TensorView(pType == TensorType::FLOAT32 ? (const float*)pData : NULL, n, h, w, c) {
+        if (pType != TensorType::FLOAT32) {
+            quantizedData = (const uint8_t*)pData;
+        }
+        
+        type = pType;
+        scale = pScale;
+        zeroPoint = pZeroPoint;
+    }
+    
+    TensorView TensorView::rebased(const void* pData) const {
+        TensorView view = *this;
+        
+        view.data = quantized() ? NULL : (const float*)pData;
+        view.quantizedData = quantized() ? (const uint8_t*)pData : NULL;
+        
+        return view;
+    }
+    
+    
+    InferenceBackend::~InferenceBackend()
+    {}
+    
+    bool InferenceBackend::setInput(const void* src, size_t bytes) {
+        TensorView input = getInputView();
+        void* dst = getInputBuffer();
+        
+        if (dst == NULL || input.empty()) {
+            LOGE("setInput(): %s backend has no input buffer", getName());
+            return false;
+        }
+        
+        if (bytes != input.byteSize()) {
+            LOGE("setInput(): got %zu bytes, %s input takes %zu", bytes, getName(), input.byteSize());
+            return false;
+        }
+        
+        memcpy(dst, src, bytes);
+        
+        return true;
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef INFERENCE_BACKEND_H
+#define INFERENCE_BACKEND_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+namespace ORB_SLAM2 {
+
+    //element type of a tensor: float, or 8-bit quantized with real value = (q - zeroPoint) * scale
+    enum class TensorType {
+        FLOAT32,
+        UINT8,
+        INT8
+    };
+
+    //lightweight non-owning view over a flat NHWC tensor buffer (shape + strides), so the decoder can read
+    //interpreter output directly without copying it into nested vectors first
+    class TensorView {
+        public:
+            //float tensors point data at their buffer; quantized ones leave it NULL and use quantizedData instead
+            const float* data = NULL;
+            const uint8_t* quantizedData = NULL;
+            TensorType type = TensorType::FLOAT32;
+            float scale = 1.0f;
+            int32_t zeroPoint = 0;
+
+            int32_t shape[4] = {0, 0, 0, 0};
+            int32_t strides[4] = {0, 0, 0, 0};
+
+            TensorView();
+            TensorView(const float* pData, int32_t n, int32_t h, int32_t w, int32_t c);
+            TensorView(const void* pData, TensorType pType, float pScale, int32_t pZeroPoint, int32_t n, int32_t h, int32_t w, int32_t c);
+
+            inline size_t offset(int n, int h, int w, int c) const {
+                return (size_t)n * strides[0] + h * strides[1] + w * strides[2] + c * strides[3];
+            }
+
+            //read the element at [n][h][w][c] (dequantizing just this one element for quantized tensors)
+            inline float at(int n, int h, int w, int c) const {
+                size_t i = offset(n, h, w, c);
+
+                if (data != NULL) {
+                    return data[i];
+                }
+
+                int32_t q = (type == TensorType::INT8) ? (int32_t)(int8_t)quantizedData[i] : (int32_t)quantizedData[i];
+
+                return (q - zeroPoint) * scale;
+            }
+
+            //pointer to the (contiguous) channel vector at [n][h][w] of a float tensor
+            inline const float* cell(int n, int h, int w) const {
+                return data + n * strides[0] + h * strides[1] + w * strides[2];
+            }
+
+            //same for the raw bytes of a quantized tensor
+            inline const uint8_t* quantizedCell(int n, int h, int w) const {
+                return quantizedData + n * strides[0] + h * strides[1] + w * strides[2];
+            }
+
+            int32_t batch() const { return shape[0]; }
+            int32_t height() const { return shape[1]; }
+            int32_t width() const { return shape[2]; }
+            int32_t channels() const { return shape[3]; }
+            bool empty() const { return data == NULL && quantizedData == NULL; }
+            bool quantized() const { return type != TensorType::FLOAT32; }
+
+            //bytes per element, and the underlying buffer whatever its type
+            size_t elementSize() const { return quantized() ? 1 : sizeof(float); }
+            const void* buffer() const { return (data != NULL) ? (const void*)data : (const void*)quantizedData; }
+
+            //bytes of the whole (densely packed) tensor
+            size_t byteSize() const { return (size_t)shape[0] * shape[1] * shape[2] * shape[3] * elementSize(); }
+
+            //the same view (type, quantization, shape) over a copy of the buffer somewhere else
+            TensorView rebased(const void* pData) const;
+    };
+
+    //what Posenet runs the model on. A backend owns (or wraps) one model instance with a single NHWC image input (input 0) and
+    //any number of NHWC outputs; Posenet preprocesses straight into the input buffer, calls invoke(), and decodes the outputs
+    //in place through TensorViews. TFLite is one implementation (TfLiteBackend); SyntheticBackend emits configurable outputs
+    //without any model. Not thread-safe: one backend serves one Posenet
+    class InferenceBackend {
+        public:
+            virtual ~InferenceBackend();
+
+            //short name for logs ("tflite", "synthetic", ...)
+            virtual const char* getName() const = 0;
+
+            //shape, type and quantization of input 0 (an empty view if the backend has no input allocated), and its buffer to
+            //write a frame into before invoke()
+            virtual TensorView getInputView() = 0;
+            virtual void* getInputBuffer() = 0;
+
+            //reshape input 0 to batch x rows x cols x 3 and reallocate (the outputs follow). Existing input and output views are
+            //invalid afterwards
+            virtual bool resizeInput(int batch, int rows, int cols) = 0;
+
+            virtual bool invoke() = 0;
+
+            virtual int getNumOutputs() = 0;
+
+            //view of output index, valid until the next invoke() or resizeInput()
+            virtual TensorView getOutputView(int index) = 0;
+
+            //copy an already preprocessed input (exactly the input's byteSize()) into input 0
+            bool setInput(const void* src, size_t bytes);
+    };
+}
+
+#endif //INFERENCE_BACKEND_H
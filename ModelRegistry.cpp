@@ -0,0 +1,134 @@
+#include "ModelRegistry.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "PosenetLog.h"
+#define LOG_TAG "MODELREGISTRY.CC"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+    std::mutex ModelRegistry::mutex;
+    std::unordered_map<std::string, std::weak_ptr<ModelRegistry::MappedModel>> ModelRegistry::models;
+    uint64_t ModelRegistry::hits = 0;
+    uint64_t ModelRegistry::loads = 0;
+    
+
+    ModelRegistry::MappedModel::~MappedModel() {
+        //the model points into the mapping, so it has to go first
+        if (model != NULL) {
+            TfLiteModelDelete(model);
+        }
+        
+        if (data != NULL) {
+            munmap(data, size);
+        }
+    }
+    
+    //resolve symlinks and relative paths so "./posenet.tflite" and "/data/posenet.tflite" share an entry
+    std::string ModelRegistry::canonicalPath(const char* pFilename) {
+        char* resolved = realpath(pFilename, NULL);
+        
+        if (resolved == NULL) {
+            return std::string(pFilename);
+        }
+        
+        std::string path(resolved);
+        free(resolved);
+        
+        return path;
+    }
+    
+    std::shared_ptr<TfLiteModel> ModelRegistry::acquire(const char* pFilename) {
+        if (pFilename == NULL) {
+            return std::shared_ptr<TfLiteModel>();
+        }
+        
+        std::string path = canonicalPath(pFilename);
+        
+        lock_guard<std::mutex> lock(mutex);
+        
+        std::shared_ptr<MappedModel> mapped = models[path].lock();
+        
+        if (mapped) {
+            hits++;
+        }
+        else {
+            mapped = load(path);
+            
+            if (!mapped) {
+                models.erase(path);
+                return std::shared_ptr<TfLiteModel>();
+            }
+            
+            models[path] = mapped;
+            loads++;
+        }
+        
+        //hand out the model while keeping the mapping alive (aliasing constructor: shares the MappedModel's refcount)
+        return std::shared_ptr<TfLiteModel>(mapped, mapped->model);
+    }
+    
+    //map the file read-only and build the model over the mapped bytes; falls back to TfLiteModelCreateFromFile if mapping fails
+    std::shared_ptr<ModelRegistry::MappedModel> ModelRegistry::load(const std::string &path) {
+        std::shared_ptr<MappedModel> mapped = std::make_shared<MappedModel>();
+        
+        int fd = open(path.c_str(), O_RDONLY);
+        
+        if (fd >= 0) {
+            struct stat st;
+            
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                
+                if (data != MAP_FAILED) {
+                    mapped->data = data;
+                    mapped->size = (size_t)st.st_size;
+                }
+            }
+            
+            //the mapping stays valid after the descriptor is closed
+            ::close(fd);
+        }
+        
+        if (mapped->data != NULL) {
+            mapped->model = TfLiteModelCreate(mapped->data, mapped->size);
+        }
+        else {
+            LOGW("ModelRegistry: couldn't map %s, loading it normally", path.c_str());
+            mapped->model = TfLiteModelCreateFromFile(path.c_str());
+        }
+        
+        if (mapped->model == NULL) {
+            LOGE("ModelRegistry: model initialization failed for %s", path.c_str());
+            return std::shared_ptr<MappedModel>();
+        }
+        
+        LOGI("ModelRegistry: loaded %s (%zu bytes mapped)", path.c_str(), mapped->size);
+        
+        return mapped;
+    }
+    
+    RegistryStats ModelRegistry::getStats() {
+        lock_guard<std::mutex> lock(mutex);
+        
+        RegistryStats registryStats;
+        registryStats.hits = hits;
+        registryStats.loads = loads;
+        
+        for (auto &entry : models) {
+            std::shared_ptr<MappedModel> mapped = entry.second.lock();
+            
+            if (mapped) {
+                registryStats.models++;
+                registryStats.mappedBytes += mapped->size;
+            }
+        }
+        
+        return registryStats;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "c_api.h"
+
+
+namespace ORB_SLAM2 {
+
+    //what the registry currently holds, for checking that N streams really are sharing one copy of the weights
+    struct RegistryStats {
+        //distinct model files currently loaded
+        int models = 0;
+
+        //bytes of .tflite files mapped into the process
+        size_t mappedBytes = 0;
+
+        //acquire() calls that found the model already loaded / had to load it
+        uint64_t hits = 0;
+        uint64_t loads = 0;
+    };
+
+    //process-wide cache of loaded models keyed by (canonical) file path. The .tflite file is memory-mapped read-only and handed to
+    //TfLiteModelCreate, so the weights live in the page cache rather than on our heap and every Posenet/interpreter built from the
+    //same file shares one copy. Models are reference counted: the mapping goes away when the last holder lets go.
+    class ModelRegistry {
+        public:
+            //the model for this file, loading (mapping) it if nobody holds it yet. NULL if the file can't be loaded
+            static std::shared_ptr<TfLiteModel> acquire(const char* pFilename);
+
+            static RegistryStats getStats();
+
+        private:
+            //one mapped file plus the model built over it (the model must not outlive the bytes)
+            struct MappedModel {
+                TfLiteModel* model = NULL;
+                void* data = NULL;
+                size_t size = 0;
+
+                ~MappedModel();
+            };
+
+            static std::shared_ptr<MappedModel> load(const std::string &path);
+            static std::string canonicalPath(const char* pFilename);
+
+            static std::mutex mutex;
+            static std::unordered_map<std::string, std::weak_ptr<MappedModel>> models;
+            static uint64_t hits;
+            static uint64_t loads;
+    };
+}
+
+#endif //MODEL_REGISTRY_H
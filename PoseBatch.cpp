@@ -0,0 +1,358 @@
+#include "PoseBatch.h"
+#include <algorithm>
+#include <cmath>
+#include "PosenetLog.h"
+#define LOG_TAG "POSEBATCH.CC"
+
+namespace ORB_SLAM2
+{
+    //score of the slots that don't hold a keypoint; thresholds are clamped to >= 0 so these never pass
+    static const float EMPTY_SCORE = -1.0f;
+    
+    //the few vector operations the reductions need, over the widest registers available: 8 floats (AVX2), 4 (SSE4.1/NEON),
+    //or 1 (plain scalar, same loops). Masks are all-ones lanes kept in the float type
+#if defined(POSENET_AVX2)
+    typedef __m256 FloatVec;
+    static const int VEC_LANES = 8;
+    
+    static inline FloatVec loadVec(const float* p) { return _mm256_load_ps(p); }
+    static inline void storeVec(float* p, FloatVec v) { _mm256_store_ps(p, v); }
+    static inline FloatVec splat(float v) { return _mm256_set1_ps(v); }
+    static inline FloatVec atLeast(FloatVec a, FloatVec b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static inline FloatVec select(FloatVec mask, FloatVec a, FloatVec b) { return _mm256_blendv_ps(b, a, mask); }
+    static inline FloatVec minVec(FloatVec a, FloatVec b) { return _mm256_min_ps(a, b); }
+    static inline FloatVec maxVec(FloatVec a, FloatVec b) { return _mm256_max_ps(a, b); }
+    static inline FloatVec addVec(FloatVec a, FloatVec b) { return _mm256_add_ps(a, b); }
+    static inline int countLanes(FloatVec mask) { return __builtin_popcount(_mm256_movemask_ps(mask)); }
+#elif defined(POSENET_SSE41)
+    typedef __m128 FloatVec;
+    static const int VEC_LANES = 4;
+    
+    static inline FloatVec loadVec(const float* p) { return _mm_load_ps(p); }
+    static inline void storeVec(float* p, FloatVec v) { _mm_store_ps(p, v); }
+    static inline FloatVec splat(float v) { return _mm_set1_ps(v); }
+    static inline FloatVec atLeast(FloatVec a, FloatVec b) { return _mm_cmpge_ps(a, b); }
+    static inline FloatVec select(FloatVec mask, FloatVec a, FloatVec b) { return _mm_blendv_ps(b, a, mask); }
+    static inline FloatVec minVec(FloatVec a, FloatVec b) { return _mm_min_ps(a, b); }
+    static inline FloatVec maxVec(FloatVec a, FloatVec b) { return _mm_max_ps(a, b); }
+    static inline FloatVec addVec(FloatVec a, FloatVec b) { return _mm_add_ps(a, b); }
+    static inline int countLanes(FloatVec mask) { return __builtin_popcount(_mm_movemask_ps(mask)); }
+#elif defined(POSENET_NEON)
+    typedef float32x4_t FloatVec;
+    static const int VEC_LANES = 4;
+    
+    static inline FloatVec loadVec(const float* p) { return vld1q_f32(p); }
+    static inline void storeVec(float* p, FloatVec v) { vst1q_f32(p, v); }
+    static inline FloatVec splat(float v) { return vdupq_n_f32(v); }
+    static inline FloatVec atLeast(FloatVec a, FloatVec b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+    static inline FloatVec select(FloatVec mask, FloatVec a, FloatVec b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+    static inline FloatVec minVec(FloatVec a, FloatVec b) { return vminq_f32(a, b); }
+    static inline FloatVec maxVec(FloatVec a, FloatVec b) { return vmaxq_f32(a, b); }
+    static inline FloatVec addVec(FloatVec a, FloatVec b) { return vaddq_f32(a, b); }
+    
+    static inline int countLanes(FloatVec mask) {
+        uint32x4_t bits = vshrq_n_u32(vreinterpretq_u32_f32(mask), 31);
+        
+        return (int)(vgetq_lane_u32(bits, 0) + vgetq_lane_u32(bits, 1) + vgetq_lane_u32(bits, 2) + vgetq_lane_u32(bits, 3));
+    }
+#else
+    typedef float FloatVec;
+    static const int VEC_LANES = 1;
+    
+    //a scalar "mask" is 1 or 0
+    static inline FloatVec loadVec(const float* p) { return *p; }
+    static inline void storeVec(float* p, FloatVec v) { *p = v; }
+    static inline FloatVec splat(float v) { return v; }
+    static inline FloatVec atLeast(FloatVec a, FloatVec b) { return (a >= b) ? 1.0f : 0.0f; }
+    static inline FloatVec select(FloatVec mask, FloatVec a, FloatVec b) { return (mask != 0.0f) ? a : b; }
+    static inline FloatVec minVec(FloatVec a, FloatVec b) { return std::min(a, b); }
+    static inline FloatVec maxVec(FloatVec a, FloatVec b) { return std::max(a, b); }
+    static inline FloatVec addVec(FloatVec a, FloatVec b) { return a + b; }
+    static inline int countLanes(FloatVec mask) { return (mask != 0.0f) ? 1 : 0; }
+#endif
+    
+    //horizontal reductions of one vector
+    static inline float laneMin(FloatVec v) {
+        alignas(32) float lanes[VEC_LANES];
+        storeVec(lanes, v);
+        
+        return *std::min_element(lanes, lanes + VEC_LANES);
+    }
+    
+    static inline float laneMax(FloatVec v) {
+        alignas(32) float lanes[VEC_LANES];
+        storeVec(lanes, v);
+        
+        return *std::max_element(lanes, lanes + VEC_LANES);
+    }
+    
+    static inline float laneSum(FloatVec v) {
+        alignas(32) float lanes[VEC_LANES];
+        storeVec(lanes, v);
+        
+        float sum = 0.0f;
+        
+        for (int i = 0; i < VEC_LANES; i++) {
+            sum += lanes[i];
+        }
+        
+        return sum;
+    }
+    
+    PoseBatch::PoseBatch(int pKeyPointsPerPerson) {
+        keyPointsPer = std::max(pKeyPointsPerPerson, 1);
+        personStride = (keyPointsPer + POSE_BATCH_LANES - 1) / POSE_BATCH_LANES * POSE_BATCH_LANES;
+    }
+    
+    void PoseBatch::clear() {
+        numPersons = 0;
+        
+        xs.clear();
+        ys.clear();
+        keyPointScores.clear();
+        bodyParts.clear();
+        personFrames.clear();
+        poseScores.clear();
+        frameStarts.clear();
+    }
+    
+    void PoseBatch::reserve(int persons) {
+        size_t slots = (size_t)persons * personStride;
+        
+        xs.reserve(slots);
+        ys.reserve(slots);
+        keyPointScores.reserve(slots);
+        bodyParts.reserve(slots);
+        personFrames.reserve(persons);
+        poseScores.reserve(persons);
+    }
+    
+    int PoseBatch::beginFrame() {
+        frameStarts.push_back(numPersons);
+        
+        return (int)frameStarts.size() - 1;
+    }
+    
+    int PoseBatch::addFrame(const std::vector<Person> &persons) {
+        int frame = beginFrame();
+        
+        for (const Person &person : persons) {
+            append(person);
+        }
+        
+        return frame;
+    }
+    
+    void PoseBatch::append(const Person &person) {
+        appendKeyPoints(person.keyPoints.data(), (int)person.keyPoints.size(), person.score);
+    }
+    
+    //each keypoint goes in the slot of its body part, so slot k is the same part for everyone
+    void PoseBatch::appendKeyPoints(const KeyPoint* keyPoints, int count, float score) {
+        if (frameStarts.empty()) {
+            beginFrame();
+        }
+        
+        size_t base = (size_t)numPersons * personStride;
+        size_t end = base + personStride;
+        
+        xs.resize(end, 0.0f);
+        ys.resize(end, 0.0f);
+        keyPointScores.resize(end, EMPTY_SCORE);
+        bodyParts.resize(end, NO_BODY_PART);
+        
+        for (int i = 0; i < count; i++) {
+            int slot = (int)keyPoints[i].bodyPart;
+            
+            if (slot < 0 || slot >= keyPointsPer) {
+                LOGW("append(): body part %d doesn't fit a batch of %d keypoints per person, dropping it", slot, keyPointsPer);
+                continue;
+            }
+            
+            xs[base + slot] = keyPoints[i].position.x;
+            ys[base + slot] = keyPoints[i].position.y;
+            keyPointScores[base + slot] = keyPoints[i].score;
+            bodyParts[base + slot] = (uint8_t)slot;
+        }
+        
+        personFrames.push_back((int32_t)frameStarts.size() - 1);
+        poseScores.push_back(score);
+        
+        numPersons++;
+    }
+    
+    int PoseBatch::frameBegin(int frame) const {
+        return frameStarts[frame];
+    }
+    
+    int PoseBatch::frameEnd(int frame) const {
+        return (frame + 1 < (int)frameStarts.size()) ? frameStarts[frame + 1] : numPersons;
+    }
+    
+    PoseView PoseBatch::view(int person) const {
+        size_t base = (size_t)person * personStride;
+        
+        PoseView pose;
+        pose.x = xs.data() + base;
+        pose.y = ys.data() + base;
+        pose.score = keyPointScores.data() + base;
+        pose.part = bodyParts.data() + base;
+        pose.numKeyPoints = keyPointsPer;
+        pose.frame = personFrames[person];
+        pose.personScore = poseScores[person];
+        
+        return pose;
+    }
+    
+    Person PoseBatch::toPerson(int person) const {
+        Person out;
+        
+        toPerson(person, out);
+        
+        return out;
+    }
+    
+    //the keypoints the person was appended with, in body part order
+    void PoseBatch::toPerson(int person, Person &out) const {
+        PoseView pose = view(person);
+        
+        out.keyPoints.clear();
+        
+        for (int k = 0; k < pose.numKeyPoints; k++) {
+            if (pose.part[k] == NO_BODY_PART) {
+                continue;
+            }
+            
+            KeyPoint keyPoint;
+            keyPoint.bodyPart = static_cast<BodyPart>(pose.part[k]);
+            keyPoint.position.x = pose.x[k];
+            keyPoint.position.y = pose.y[k];
+            keyPoint.score = pose.score[k];
+            
+            out.keyPoints.push_back(keyPoint);
+        }
+        
+        out.score = pose.personScore;
+    }
+    
+    std::vector<Person> PoseBatch::toPersons(int frame) const {
+        std::vector<Person> persons(frameEnd(frame) - frameBegin(frame));
+        
+        for (size_t i = 0; i < persons.size(); i++) {
+            toPerson(frameBegin(frame) + (int)i, persons[i]);
+        }
+        
+        return persons;
+    }
+    
+    void PoseBatch::boundingBoxes(float minScore, std::vector<PoseBox> &boxes) const {
+        const FloatVec threshold = splat(std::max(minScore, 0.0f));
+        const FloatVec infinity = splat(INFINITY);
+        const FloatVec negativeInfinity = splat(-INFINITY);
+        
+        boxes.resize(numPersons);
+        
+        for (int p = 0; p < numPersons; p++) {
+            size_t base = (size_t)p * personStride;
+            
+            FloatVec minX = infinity;
+            FloatVec minY = infinity;
+            FloatVec maxX = negativeInfinity;
+            FloatVec maxY = negativeInfinity;
+            int count = 0;
+            
+            //runs into the padding slots when keyPointsPer isn't a multiple of the vector width; their score keeps them out
+            for (int k = 0; k < keyPointsPer; k += VEC_LANES) {
+                FloatVec confident = atLeast(loadVec(&keyPointScores[base + k]), threshold);
+                FloatVec x = loadVec(&xs[base + k]);
+                FloatVec y = loadVec(&ys[base + k]);
+                
+                minX = minVec(minX, select(confident, x, infinity));
+                minY = minVec(minY, select(confident, y, infinity));
+                maxX = maxVec(maxX, select(confident, x, negativeInfinity));
+                maxY = maxVec(maxY, select(confident, y, negativeInfinity));
+                count += countLanes(confident);
+            }
+            
+            PoseBox &box = boxes[p];
+            box = PoseBox();
+            box.numKeyPoints = count;
+            
+            if (count > 0) {
+                box.minX = laneMin(minX);
+                box.minY = laneMin(minY);
+                box.maxX = laneMax(maxX);
+                box.maxY = laneMax(maxY);
+            }
+        }
+    }
+    
+    void PoseBatch::meanScores(float minScore, std::vector<float> &means) const {
+        const FloatVec threshold = splat(std::max(minScore, 0.0f));
+        const FloatVec zero = splat(0.0f);
+        
+        means.resize(numPersons);
+        
+        for (int p = 0; p < numPersons; p++) {
+            size_t base = (size_t)p * personStride;
+            
+            FloatVec sum = zero;
+            int count = 0;
+            
+            for (int k = 0; k < keyPointsPer; k += VEC_LANES) {
+                FloatVec score = loadVec(&keyPointScores[base + k]);
+                FloatVec confident = atLeast(score, threshold);
+                
+                sum = addVec(sum, select(confident, score, zero));
+                count += countLanes(confident);
+            }
+            
+            means[p] = (count > 0) ? laneSum(sum) / count : 0.0f;
+        }
+    }
+    
+    //vertical pass: one running count per slot, kept in vectors (as floats, exact far beyond any batch size)
+    void PoseBatch::countPerPart(float minScore, std::vector<int> &counts) const {
+        const FloatVec threshold = splat(std::max(minScore, 0.0f));
+        const FloatVec one = splat(1.0f);
+        const FloatVec zero = splat(0.0f);
+        
+        AlignedVector<float> totals(personStride, 0.0f);
+        
+        for (int p = 0; p < numPersons; p++) {
+            size_t base = (size_t)p * personStride;
+            
+            for (int k = 0; k < keyPointsPer; k += VEC_LANES) {
+                FloatVec confident = atLeast(loadVec(&keyPointScores[base + k]), threshold);
+                
+                storeVec(&totals[k], addVec(loadVec(&totals[k]), select(confident, one, zero)));
+            }
+        }
+        
+        counts.resize(keyPointsPer);
+        
+        for (int k = 0; k < keyPointsPer; k++) {
+            counts[k] = (int)totals[k];
+        }
+    }
+    
+    //one slot per person, a stride apart: a gather, so this stays scalar
+    void PoseBatch::personsWithPart(BodyPart part, float minScore, std::vector<int> &persons) const {
+        persons.clear();
+        
+        int slot = (int)part;
+        
+        if (slot < 0 || slot >= keyPointsPer) {
+            return;
+        }
+        
+        float threshold = std::max(minScore, 0.0f);
+        const float* score = keyPointScores.data() + slot;
+        
+        for (int p = 0; p < numPersons; p++) {
+            if (score[(size_t)p * personStride] >= threshold) {
+                persons.push_back(p);
+            }
+        }
+    }
+}
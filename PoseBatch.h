@@ -0,0 +1,161 @@
+#ifndef POSE_BATCH_H
+#define POSE_BATCH_H
+
+#include <vector>
+#include <new>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "Posenet.h"
+
+
+namespace ORB_SLAM2 {
+
+    //every column of a PoseBatch starts on a cache line, and each person's keypoints take a whole number of 8-float vectors
+    //(17 keypoints -> 24 slots), so every person starts on a 32-byte boundary and the kernels never need a scalar tail
+    const size_t POSE_BATCH_ALIGNMENT = 64;
+    const int POSE_BATCH_LANES = 8;
+
+    //body part column value of the padding slots (and of keypoints a Person didn't have)
+    const uint8_t NO_BODY_PART = 0xFF;
+
+    //std::allocator that hands out POSE_BATCH_ALIGNMENT-aligned memory
+    template <typename T>
+    class AlignedAllocator {
+        public:
+            typedef T value_type;
+
+            AlignedAllocator() {}
+
+            template <typename U>
+            AlignedAllocator(const AlignedAllocator<U>&) {}
+
+            T* allocate(size_t n) {
+                void* memory = NULL;
+
+                if (posix_memalign(&memory, POSE_BATCH_ALIGNMENT, n * sizeof(T)) != 0) {
+                    throw std::bad_alloc();
+                }
+
+                return (T*)memory;
+            }
+
+            void deallocate(T* p, size_t) {
+                free(p);
+            }
+
+            template <typename U>
+            bool operator==(const AlignedAllocator<U>&) const { return true; }
+
+            template <typename U>
+            bool operator!=(const AlignedAllocator<U>&) const { return false; }
+    };
+
+    template <typename T>
+    using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+    //box around the confident keypoints of one person (empty if none were)
+    struct PoseBox {
+        float minX = 0.0f;
+        float minY = 0.0f;
+        float maxX = 0.0f;
+        float maxY = 0.0f;
+        int numKeyPoints = 0;
+
+        bool empty() const { return numKeyPoints == 0; }
+    };
+
+    //one person of a PoseBatch read in place: keypoint k is x[k], y[k], score[k], part[k] for k < numKeyPoints
+    struct PoseView {
+        const float* x = NULL;
+        const float* y = NULL;
+        const float* score = NULL;
+        const uint8_t* part = NULL;
+        int numKeyPoints = 0;
+        int frame = 0;
+        float personScore = 0.0f;
+    };
+
+    //the people from a batch of frames stored column-wise (structure of arrays) for downstream analytics: all x coordinates,
+    //then all y, all scores and all body parts, each contiguous and aligned, with person i's keypoints at
+    //[i * stride(), i * stride() + keyPointsPerPerson()). Per-person columns hold the frame each person came from and their
+    //pose score. Unused slots (padding, or keypoints a Person didn't have) have score -1, so any threshold >= 0 skips them.
+    //Filling a batch copies out of Persons once; after that the reductions below read the columns with SIMD and
+    //poses can be read in place through PoseView without building Persons.
+    class PoseBatch {
+        public:
+            explicit PoseBatch(int pKeyPointsPerPerson = NUM_KEYPOINTS);
+
+            //drop every person and frame (keeps the memory)
+            void clear();
+            void reserve(int numPersons);
+
+            //start a new frame; append() adds people to the latest one. Returns the frame's index
+            int beginFrame();
+            void append(const Person &person);
+
+            template <int N>
+            void append(const FixedPerson<N> &person) {
+                appendKeyPoints(person.keyPoints.data(), person.numKeyPoints, person.score);
+            }
+
+            //beginFrame() plus append() for each of the frame's people
+            int addFrame(const std::vector<Person> &persons);
+
+            int size() const { return numPersons; }
+            int numFrames() const { return (int)frameStarts.size(); }
+            int keyPointsPerPerson() const { return keyPointsPer; }
+            int stride() const { return personStride; }
+
+            //people [frameBegin(f), frameEnd(f)) came from frame f
+            int frameBegin(int frame) const;
+            int frameEnd(int frame) const;
+
+            //the columns (size() * stride() keypoint slots, size() persons)
+            const float* x() const { return xs.data(); }
+            const float* y() const { return ys.data(); }
+            const float* scores() const { return keyPointScores.data(); }
+            const uint8_t* parts() const { return bodyParts.data(); }
+            const int32_t* frames() const { return personFrames.data(); }
+            const float* personScores() const { return poseScores.data(); }
+
+            PoseView view(int person) const;
+
+            //back to the Person type (the reused overload only allocates when the person's keypoint storage has to grow)
+            Person toPerson(int person) const;
+            void toPerson(int person, Person &out) const;
+            std::vector<Person> toPersons(int frame) const;
+
+            //box around each person's keypoints scoring at least minScore
+            void boundingBoxes(float minScore, std::vector<PoseBox> &boxes) const;
+
+            //each person's mean score over their keypoints scoring at least minScore (0 if none do)
+            void meanScores(float minScore, std::vector<float> &means) const;
+
+            //counts[k] = how many people have keypoint slot k scoring at least minScore (counts gets keyPointsPerPerson() entries)
+            void countPerPart(float minScore, std::vector<int> &counts) const;
+
+            //indices of the people whose given body part scores at least minScore
+            void personsWithPart(BodyPart part, float minScore, std::vector<int> &persons) const;
+
+        private:
+            int keyPointsPer;
+            int personStride;
+            int numPersons = 0;
+
+            AlignedVector<float> xs;
+            AlignedVector<float> ys;
+            AlignedVector<float> keyPointScores;
+            AlignedVector<uint8_t> bodyParts;
+
+            AlignedVector<int32_t> personFrames;
+            AlignedVector<float> poseScores;
+
+            //index of the first person of each frame
+            std::vector<int> frameStarts;
+
+            void appendKeyPoints(const KeyPoint* keyPoints, int count, float score);
+    };
+}
+
+#endif //POSE_BATCH_H
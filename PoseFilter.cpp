@@ -0,0 +1,91 @@
+#include "PoseFilter.h"
+#include <math.h>
+
+namespace ORB_SLAM2
+{
+    //smoothing factor of a first-order low-pass with the given cutoff (Hz) sampled every dt seconds
+    static float lowPassAlpha(float cutoff, float dt) {
+        float tau = 1.0f / (2.0f * (float)M_PI * cutoff);
+        return 1.0f / (1.0f + tau / dt);
+    }
+    
+    //one step of the One-Euro filter on a single coordinate: filter the velocity, let it pick the position's cutoff, filter the
+    //position. value/velocity hold the previous filtered state on the way in and the new one on the way out
+    static void oneEuroStep(const OneEuroConfig &config, float measured, float dt, float &value, float &velocity) {
+        float rawVelocity = (measured - value) / dt;
+        velocity += lowPassAlpha(config.derivativeCutoff, dt) * (rawVelocity - velocity);
+        
+        float cutoff = config.minCutoff + config.beta * fabsf(velocity);
+        value += lowPassAlpha(cutoff, dt) * (measured - value);
+    }
+    
+    PoseFilter::PoseFilter(PoseFilterType pType, const OneEuroConfig &pOneEuro) {
+        type = pType;
+        oneEuro = pOneEuro;
+    }
+    
+    void PoseFilter::reset() {
+        initialized = false;
+        states.clear();
+    }
+    
+    void PoseFilter::update(Person &person, double seconds) {
+        int numKeyPoints = (int)person.keyPoints.size();
+        float dt = (float)(seconds - lastSeconds);
+        
+        //start over on the first pose, a different keypoint count, or time not moving forward (e.g. the stream restarted)
+        if (!initialized || numKeyPoints != (int)states.size() || dt <= 0.0f) {
+            states.assign(numKeyPoints, KeyPointState());
+            
+            for (int i = 0; i < numKeyPoints; i++) {
+                states[i].x = person.keyPoints[i].position.x;
+                states[i].y = person.keyPoints[i].position.y;
+            }
+        }
+        else {
+            for (int i = 0; i < numKeyPoints; i++) {
+                KeyPointState &state = states[i];
+                Position &position = person.keyPoints[i].position;
+                
+                if (type == PoseFilterType::ONE_EURO) {
+                    oneEuroStep(oneEuro, position.x, dt, state.x, state.dx);
+                    oneEuroStep(oneEuro, position.y, dt, state.y, state.dy);
+                    
+                    position.x = state.x;
+                    position.y = state.y;
+                }
+                else {
+                    state.dx = (position.x - state.x) / dt;
+                    state.dy = (position.y - state.y) / dt;
+                    state.x = position.x;
+                    state.y = position.y;
+                }
+            }
+        }
+        
+        initialized = true;
+        lastSeconds = seconds;
+        last = person;
+    }
+    
+    bool PoseFilter::predict(double seconds, Person &person) const {
+        if (!initialized) {
+            return false;
+        }
+        
+        person = last;
+        
+        if (type == PoseFilterType::HOLD) {
+            return true;
+        }
+        
+        float dt = (float)(seconds - lastSeconds);
+        
+        for (size_t i = 0; i < states.size(); i++) {
+            person.keyPoints[i].position.x = states[i].x + states[i].dx * dt;
+            person.keyPoints[i].position.y = states[i].y + states[i].dy * dt;
+        }
+        
+        return true;
+    }
+}
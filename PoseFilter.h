@@ -0,0 +1,68 @@
+#ifndef POSE_FILTER_H
+#define POSE_FILTER_H
+
+#include <vector>
+
+#include "Posenet.h"
+
+
+namespace ORB_SLAM2 {
+
+    //how a PoseFilter fills in frames the model wasn't run on
+    enum class PoseFilterType {
+        //repeat the last inferred pose
+        HOLD,
+
+        //move each keypoint along the velocity measured between the last two inferred poses
+        CONSTANT_VELOCITY,
+
+        //One-Euro filter (Casiez et al. 2012) per keypoint coordinate: inferred poses come out smoothed (less jitter when still,
+        //little lag when moving fast), and predictions extrapolate along the filtered velocity
+        ONE_EURO
+    };
+
+    struct OneEuroConfig {
+        //cutoff frequency (Hz) when a keypoint is still: lower means less jitter but more lag
+        float minCutoff = 1.0f;
+
+        //how fast the cutoff rises with speed (per pixel/second): higher means less lag on fast motion
+        float beta = 0.007f;
+
+        //cutoff (Hz) for the velocity estimate itself
+        float derivativeCutoff = 1.0f;
+    };
+
+    //per-keypoint temporal state for one tracked person, fed with inferred poses and asked for poses in between
+    class PoseFilter {
+        public:
+            PoseFilter(PoseFilterType pType = PoseFilterType::CONSTANT_VELOCITY, const OneEuroConfig &pOneEuro = OneEuroConfig());
+
+            void reset();
+
+            //take in a freshly inferred pose at time seconds (ONE_EURO replaces its positions with the filtered ones)
+            void update(Person &person, double seconds);
+
+            //the pose at time seconds without a new measurement: held or extrapolated from the last update. Returns false (leaving
+            //person untouched) if nothing has been seen yet
+            bool predict(double seconds, Person &person) const;
+
+        private:
+            //filtered position and velocity (pixels/second) of one keypoint
+            struct KeyPointState {
+                float x = 0.0f;
+                float y = 0.0f;
+                float dx = 0.0f;
+                float dy = 0.0f;
+            };
+
+            PoseFilterType type;
+            OneEuroConfig oneEuro;
+
+            bool initialized = false;
+            double lastSeconds = 0.0;
+            Person last;
+            std::vector<KeyPointState> states;
+    };
+}
+
+#endif //POSE_FILTER_H
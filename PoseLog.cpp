@@ -0,0 +1,622 @@
+#include "PoseLog.h"
+#include <algorithm>
+#include <cmath>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "PosenetLog.h"
+#define LOG_TAG "POSELOG.CC"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+    static const char POSE_LOG_MAGIC[8] = {'P', 'O', 'S', 'E', 'L', 'O', 'G', '\0'};
+    
+    //records start on a page boundary
+    static const size_t POSE_LOG_HEADER_ALIGNMENT = 4096;
+    
+    static const char* const DEFAULT_PART_NAMES[NUM_KEYPOINTS] = {
+        "nose", "leftEye", "rightEye", "leftEar", "rightEar", "leftShoulder", "rightShoulder", "leftElbow", "rightElbow",
+        "leftWrist", "rightWrist", "leftHip", "rightHip", "leftKnee", "rightKnee", "leftAnkle", "rightAnkle"
+    };
+    
+    static size_t alignUp(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+    
+    static uint16_t quantizeCoordinate(float value, uint32_t extent) {
+        float fraction = value / (float)extent;
+        fraction = std::min(std::max(fraction, 0.0f), 1.0f);
+        return (uint16_t)lrintf(fraction * 65535.0f);
+    }
+    
+    static uint8_t quantizeScore(float score) {
+        score = std::min(std::max(score, 0.0f), 1.0f);
+        return (uint8_t)lrintf(score * 255.0f);
+    }
+    
+    //header fields that have to agree for two logs to share a record layout
+    static bool sameLayout(const PoseLogHeader &a, const PoseLogHeader &b) {
+        return a.headerBytes == b.headerBytes && a.recordBytes == b.recordBytes && a.personBytes == b.personBytes &&
+               a.numKeyPoints == b.numKeyPoints && a.maxPersons == b.maxPersons && a.frameRows == b.frameRows &&
+               a.frameCols == b.frameCols;
+    }
+    
+    
+    PoseLogWriter::PoseLogWriter() {
+        memset(&header, 0, sizeof(header));
+    }
+    
+    PoseLogWriter::~PoseLogWriter() {
+        close();
+    }
+    
+    bool PoseLogWriter::buildHeader(const PoseLogConfig &pConfig) {
+        if (pConfig.frameRows <= 0 || pConfig.frameCols <= 0) {
+            LOGE("PoseLogWriter: frame size %dx%d is invalid", pConfig.frameCols, pConfig.frameRows);
+            return false;
+        }
+        
+        if (pConfig.numKeyPoints <= 0 || pConfig.numKeyPoints > POSE_LOG_MAX_KEYPOINTS) {
+            LOGE("PoseLogWriter: %d keypoints per person is outside 1..%d", pConfig.numKeyPoints, POSE_LOG_MAX_KEYPOINTS);
+            return false;
+        }
+        
+        //numPersons is stored in 16 bits
+        if (pConfig.maxPersons <= 0 || pConfig.maxPersons > 0xFFFF) {
+            LOGE("PoseLogWriter: %d person slots per frame is invalid", pConfig.maxPersons);
+            return false;
+        }
+        
+        if (pConfig.edges.size() > (size_t)POSE_LOG_MAX_EDGES) {
+            LOGE("PoseLogWriter: %zu skeleton edges, at most %d are supported", pConfig.edges.size(), POSE_LOG_MAX_EDGES);
+            return false;
+        }
+        
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, POSE_LOG_MAGIC, sizeof(header.magic));
+        header.version = POSE_LOG_VERSION;
+        header.headerBytes = (uint32_t)alignUp(sizeof(PoseLogHeader), POSE_LOG_HEADER_ALIGNMENT);
+        header.numKeyPoints = (uint32_t)pConfig.numKeyPoints;
+        header.maxPersons = (uint32_t)pConfig.maxPersons;
+        header.frameRows = (uint32_t)pConfig.frameRows;
+        header.frameCols = (uint32_t)pConfig.frameCols;
+        
+        //x, y, score per keypoint plus the person score
+        header.personBytes = (uint32_t)alignUp(5 * pConfig.numKeyPoints + 1, 4);
+        header.recordBytes = (uint32_t)alignUp(sizeof(PoseLogFrame) + (size_t)pConfig.maxPersons * header.personBytes, 8);
+        
+        //no skeleton given: the PoseNet one if the keypoint count matches
+        bool posenetSkeleton = pConfig.edges.empty() && pConfig.partNames.empty() && pConfig.numKeyPoints == NUM_KEYPOINTS;
+        
+        if (posenetSkeleton) {
+            header.numEdges = NUM_POSE_EDGES;
+            
+            for (int e = 0; e < NUM_POSE_EDGES; e++) {
+                header.edges[e][0] = (uint8_t)POSE_CHAIN[e][0];
+                header.edges[e][1] = (uint8_t)POSE_CHAIN[e][1];
+            }
+            
+            for (int k = 0; k < NUM_KEYPOINTS; k++) {
+                strncpy(header.partNames[k], DEFAULT_PART_NAMES[k], POSE_LOG_NAME_BYTES - 1);
+            }
+        }
+        else {
+            header.numEdges = (uint32_t)pConfig.edges.size();
+            
+            for (size_t e = 0; e < pConfig.edges.size(); e++) {
+                int parent = pConfig.edges[e].first;
+                int child = pConfig.edges[e].second;
+                
+                if (parent < 0 || parent >= pConfig.numKeyPoints || child < 0 || child >= pConfig.numKeyPoints) {
+                    LOGE("PoseLogWriter: skeleton edge %d -> %d is out of range", parent, child);
+                    return false;
+                }
+                
+                header.edges[e][0] = (uint8_t)parent;
+                header.edges[e][1] = (uint8_t)child;
+            }
+            
+            //names longer than the field are cut short (the last byte always stays 0)
+            for (size_t k = 0; k < pConfig.partNames.size() && k < (size_t)pConfig.numKeyPoints; k++) {
+                strncpy(header.partNames[k], pConfig.partNames[k].c_str(), POSE_LOG_NAME_BYTES - 1);
+            }
+        }
+        
+        config = pConfig;
+        
+        //at least one record, and whole records so the buffer never splits one
+        size_t records = std::max(pConfig.bufferBytes / header.recordBytes, (size_t)1);
+        buffer.assign(records * header.recordBytes, 0);
+        buffered = 0;
+        
+        return true;
+    }
+    
+    bool PoseLogWriter::writeAll(const uint8_t* bytes, size_t count) {
+        while (count > 0) {
+            ssize_t written = write(fd, bytes, count);
+            
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                
+                LOGE("PoseLogWriter: write failed: %s", strerror(errno));
+                return false;
+            }
+            
+            bytes += written;
+            count -= (size_t)written;
+        }
+        
+        return true;
+    }
+    
+    //the header padded out to headerBytes, at the current file position
+    bool PoseLogWriter::writeHeader() {
+        std::vector<uint8_t> headerBytes(header.headerBytes, 0);
+        memcpy(headerBytes.data(), &header, sizeof(header));
+        
+        return writeAll(headerBytes.data(), headerBytes.size());
+    }
+    
+    bool PoseLogWriter::open(const std::string &path, const PoseLogConfig &pConfig) {
+        close();
+        
+        if (!buildHeader(pConfig)) {
+            return false;
+        }
+        
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        
+        if (fd < 0) {
+            LOGE("PoseLogWriter: couldn't create %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        
+        if (!writeHeader()) {
+            close();
+            return false;
+        }
+        
+        numFrames = 0;
+        return true;
+    }
+    
+    bool PoseLogWriter::openAppend(const std::string &path, const PoseLogConfig &pConfig) {
+        close();
+        
+        if (!buildHeader(pConfig)) {
+            return false;
+        }
+        
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        
+        if (fd < 0) {
+            LOGE("PoseLogWriter: couldn't open %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        
+        struct stat st;
+        
+        if (fstat(fd, &st) != 0) {
+            LOGE("PoseLogWriter: couldn't stat %s: %s", path.c_str(), strerror(errno));
+            close();
+            return false;
+        }
+        
+        //new (or empty) file: same as open()
+        if (st.st_size == 0) {
+            if (!writeHeader()) {
+                close();
+                return false;
+            }
+            
+            numFrames = 0;
+            return true;
+        }
+        
+        //the header itself was cut short (a crash while the log was being created, anywhere in its one write()): there are no
+        //frames to keep, so if what did get written starts like a pose log, start over
+        if ((uint64_t)st.st_size < header.headerBytes) {
+            char magic[sizeof(header.magic)];
+            size_t magicBytes = std::min((size_t)st.st_size, sizeof(magic));
+            
+            if (pread(fd, magic, magicBytes, 0) != (ssize_t)magicBytes || memcmp(magic, POSE_LOG_MAGIC, magicBytes) != 0) {
+                LOGE("PoseLogWriter: %s is not a version %u pose log", path.c_str(), POSE_LOG_VERSION);
+                close();
+                return false;
+            }
+            
+            LOGW("PoseLogWriter: %s has a partly written header, rewriting it", path.c_str());
+            
+            if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0 || !writeHeader()) {
+                LOGE("PoseLogWriter: couldn't rewrite the header of %s: %s", path.c_str(), strerror(errno));
+                close();
+                return false;
+            }
+            
+            numFrames = 0;
+            return true;
+        }
+        
+        PoseLogHeader existing;
+        
+        if (pread(fd, &existing, sizeof(existing), 0) != (ssize_t)sizeof(existing) ||
+            memcmp(existing.magic, POSE_LOG_MAGIC, sizeof(existing.magic)) != 0 || existing.version != POSE_LOG_VERSION) {
+            LOGE("PoseLogWriter: %s is not a version %u pose log", path.c_str(), POSE_LOG_VERSION);
+            close();
+            return false;
+        }
+        
+        if (!sameLayout(existing, header)) {
+            LOGE("PoseLogWriter: %s was written with a different skeleton, frame size or person count", path.c_str());
+            close();
+            return false;
+        }
+        
+        //cut off a record a crash left half written, so the next one lands on a record boundary
+        uint64_t records = ((uint64_t)st.st_size - header.headerBytes) / header.recordBytes;
+        off_t end = (off_t)(header.headerBytes + records * header.recordBytes);
+        
+        if (end != st.st_size) {
+            LOGW("PoseLogWriter: dropping %lld trailing bytes of a partial record in %s", (long long)(st.st_size - end), path.c_str());
+            
+            if (ftruncate(fd, end) != 0) {
+                LOGE("PoseLogWriter: couldn't truncate %s: %s", path.c_str(), strerror(errno));
+                close();
+                return false;
+            }
+        }
+        
+        if (lseek(fd, end, SEEK_SET) != end) {
+            LOGE("PoseLogWriter: couldn't seek in %s: %s", path.c_str(), strerror(errno));
+            close();
+            return false;
+        }
+        
+        numFrames = records;
+        return true;
+    }
+    
+    uint8_t* PoseLogWriter::nextRecord(int64_t timestamp, int numPersons, int droppedPersons) {
+        if (fd < 0) {
+            return NULL;
+        }
+        
+        if (buffered + header.recordBytes > buffer.size() && !flush()) {
+            return NULL;
+        }
+        
+        uint8_t* record = buffer.data() + buffered;
+        memset(record, 0, header.recordBytes);
+        
+        PoseLogFrame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.timestamp = timestamp;
+        frame.numPersons = (uint16_t)numPersons;
+        frame.droppedPersons = (uint16_t)std::min(droppedPersons, 0xFFFF);
+        memcpy(record, &frame, sizeof(frame));
+        
+        buffered += header.recordBytes;
+        numFrames++;
+        
+        return record;
+    }
+    
+    //keypoints go to the slot of their body part, so slots a person doesn't have keep score 0
+    void PoseLogWriter::writePerson(uint8_t* slot, const KeyPoint* keyPoints, int count, float score) {
+        int numKeyPoints = (int)header.numKeyPoints;
+        uint16_t* xs = (uint16_t*)slot;
+        uint16_t* ys = xs + numKeyPoints;
+        uint8_t* scores = (uint8_t*)(ys + numKeyPoints);
+        
+        for (int i = 0; i < count; i++) {
+            int k = (int)keyPoints[i].bodyPart;
+            
+            if (k < 0 || k >= numKeyPoints) {
+                continue;
+            }
+            
+            xs[k] = quantizeCoordinate(keyPoints[i].position.x, header.frameCols);
+            ys[k] = quantizeCoordinate(keyPoints[i].position.y, header.frameRows);
+            scores[k] = quantizeScore(keyPoints[i].score);
+        }
+        
+        scores[numKeyPoints] = quantizeScore(score);
+    }
+    
+    bool PoseLogWriter::append(int64_t timestamp, const Person &person) {
+        uint8_t* record = nextRecord(timestamp, 1, 0);
+        
+        if (record != NULL) {
+            writePerson(record + sizeof(PoseLogFrame), person.keyPoints.data(), (int)person.keyPoints.size(), person.score);
+        }
+        
+        return record != NULL;
+    }
+    
+    bool PoseLogWriter::append(int64_t timestamp, const std::vector<Person> &persons) {
+        int count = std::min((int)persons.size(), (int)header.maxPersons);
+        uint8_t* record = nextRecord(timestamp, count, (int)persons.size() - count);
+        
+        if (record == NULL) {
+            return false;
+        }
+        
+        uint8_t* slot = record + sizeof(PoseLogFrame);
+        
+        if ((int)persons.size() <= count) {
+            for (int i = 0; i < count; i++, slot += header.personBytes) {
+                writePerson(slot, persons[i].keyPoints.data(), (int)persons[i].keyPoints.size(), persons[i].score);
+            }
+            
+            return true;
+        }
+        
+        //more people than slots: keep the highest scoring ones, in their original order
+        order.resize(persons.size());
+        
+        for (size_t i = 0; i < persons.size(); i++) {
+            order[i] = (int)i;
+        }
+        
+        std::partial_sort(order.begin(), order.begin() + count, order.end(), [&persons](int a, int b) {
+            return persons[a].score > persons[b].score;
+        });
+        std::sort(order.begin(), order.begin() + count);
+        
+        for (int i = 0; i < count; i++, slot += header.personBytes) {
+            const Person &person = persons[order[i]];
+            writePerson(slot, person.keyPoints.data(), (int)person.keyPoints.size(), person.score);
+        }
+        
+        return true;
+    }
+    
+    bool PoseLogWriter::flush() {
+        if (fd < 0) {
+            return false;
+        }
+        
+        bool ok = writeAll(buffer.data(), buffered);
+        buffered = 0;
+        
+        return ok;
+    }
+    
+    void PoseLogWriter::close() {
+        if (fd < 0) {
+            return;
+        }
+        
+        flush();
+        ::close(fd);
+        fd = -1;
+    }
+    
+    
+    PoseLogReader::PoseLogReader() {}
+    
+    PoseLogReader::~PoseLogReader() {
+        close();
+    }
+    
+    bool PoseLogReader::open(const std::string &path) {
+        close();
+        
+        fd = ::open(path.c_str(), O_RDONLY);
+        
+        if (fd < 0) {
+            LOGE("PoseLogReader: couldn't open %s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        
+        if (!map()) {
+            close();
+            return false;
+        }
+        
+        const PoseLogHeader &h = *header;
+        
+        bool valid = memcmp(h.magic, POSE_LOG_MAGIC, sizeof(h.magic)) == 0 && h.version == POSE_LOG_VERSION &&
+                     h.headerBytes >= sizeof(PoseLogHeader) && h.headerBytes <= size &&
+                     h.numKeyPoints > 0 && h.numKeyPoints <= (uint32_t)POSE_LOG_MAX_KEYPOINTS &&
+                     h.numEdges <= (uint32_t)POSE_LOG_MAX_EDGES && h.maxPersons > 0 &&
+                     h.personBytes >= 5 * h.numKeyPoints + 1 &&
+                     h.recordBytes >= sizeof(PoseLogFrame) + (uint64_t)h.maxPersons * h.personBytes;
+        
+        if (!valid) {
+            LOGE("PoseLogReader: %s is not a version %u pose log", path.c_str(), POSE_LOG_VERSION);
+            close();
+            return false;
+        }
+        
+        numFrames = (size - h.headerBytes) / h.recordBytes;
+        
+        LOGD("PoseLogReader: %s has %llu frames of up to %u people", path.c_str(), (unsigned long long)numFrames, h.maxPersons);
+        return true;
+    }
+    
+    //map the whole file; pages are only read in when a frame on them is touched
+    bool PoseLogReader::map() {
+        struct stat st;
+        
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PoseLogHeader)) {
+            LOGE("PoseLogReader: log is too short to hold a header");
+            return false;
+        }
+        
+        void* mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        
+        if (mapped == MAP_FAILED) {
+            LOGE("PoseLogReader: couldn't map %lld bytes: %s", (long long)st.st_size, strerror(errno));
+            return false;
+        }
+        
+        //lookups jump around the file, so readahead would mostly fetch pages nobody reads
+        madvise(mapped, (size_t)st.st_size, MADV_RANDOM);
+        
+        data = (uint8_t*)mapped;
+        size = (size_t)st.st_size;
+        header = (const PoseLogHeader*)data;
+        
+        return true;
+    }
+    
+    bool PoseLogReader::refresh() {
+        if (data == NULL) {
+            return false;
+        }
+        
+        struct stat st;
+        
+        if (fstat(fd, &st) != 0) {
+            return false;
+        }
+        
+        if ((size_t)st.st_size == size) {
+            return true;
+        }
+        
+        uint8_t* oldData = data;
+        size_t oldSize = size;
+        const PoseLogHeader* oldHeader = header;
+        
+        if (!map()) {
+            data = oldData;
+            size = oldSize;
+            header = oldHeader;
+            return false;
+        }
+        
+        munmap(oldData, oldSize);
+        
+        numFrames = (size - header->headerBytes) / header->recordBytes;
+        return true;
+    }
+    
+    void PoseLogReader::close() {
+        if (data != NULL) {
+            munmap(data, size);
+        }
+        
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        
+        fd = -1;
+        data = NULL;
+        size = 0;
+        header = NULL;
+        numFrames = 0;
+    }
+    
+    const uint8_t* PoseLogReader::record(uint64_t frame) const {
+        if (frame >= numFrames) {
+            return NULL;
+        }
+        
+        return data + header->headerBytes + frame * header->recordBytes;
+    }
+    
+    int64_t PoseLogReader::getTimestamp(uint64_t frame) const {
+        const uint8_t* r = record(frame);
+        
+        if (r == NULL) {
+            return 0;
+        }
+        
+        PoseLogFrame f;
+        memcpy(&f, r, sizeof(f));
+        
+        return f.timestamp;
+    }
+    
+    int PoseLogReader::getNumPersons(uint64_t frame) const {
+        const uint8_t* r = record(frame);
+        
+        if (r == NULL) {
+            return 0;
+        }
+        
+        PoseLogFrame f;
+        memcpy(&f, r, sizeof(f));
+        
+        return std::min((int)f.numPersons, (int)header->maxPersons);
+    }
+    
+    bool PoseLogReader::readPerson(uint64_t frame, int index, Person &person) const {
+        if (index < 0 || index >= getNumPersons(frame)) {
+            return false;
+        }
+        
+        int numKeyPoints = (int)header->numKeyPoints;
+        const uint8_t* slot = record(frame) + sizeof(PoseLogFrame) + (size_t)index * header->personBytes;
+        const uint16_t* xs = (const uint16_t*)slot;
+        const uint16_t* ys = xs + numKeyPoints;
+        const uint8_t* scores = (const uint8_t*)(ys + numKeyPoints);
+        
+        float scaleX = (float)header->frameCols / 65535.0f;
+        float scaleY = (float)header->frameRows / 65535.0f;
+        
+        person.keyPoints.resize(numKeyPoints);
+        
+        for (int k = 0; k < numKeyPoints; k++) {
+            KeyPoint &keyPoint = person.keyPoints[k];
+            keyPoint.bodyPart = (BodyPart)k;
+            keyPoint.position.x = xs[k] * scaleX;
+            keyPoint.position.y = ys[k] * scaleY;
+            keyPoint.score = scores[k] / 255.0f;
+        }
+        
+        person.score = scores[numKeyPoints] / 255.0f;
+        return true;
+    }
+    
+    bool PoseLogReader::readFrame(uint64_t frame, std::vector<Person> &persons) const {
+        if (frame >= numFrames) {
+            persons.clear();
+            return false;
+        }
+        
+        int count = getNumPersons(frame);
+        persons.resize(count);
+        
+        for (int i = 0; i < count; i++) {
+            readPerson(frame, i, persons[i]);
+        }
+        
+        return true;
+    }
+    
+    std::vector<Person> PoseLogReader::readFrame(uint64_t frame) const {
+        std::vector<Person> persons;
+        readFrame(frame, persons);
+        return persons;
+    }
+    
+    int64_t PoseLogReader::findFrame(int64_t timestamp) const {
+        //first frame later than timestamp
+        uint64_t low = 0;
+        uint64_t high = numFrames;
+        
+        while (low < high) {
+            uint64_t mid = low + (high - low) / 2;
+            
+            if (getTimestamp(mid) <= timestamp) {
+                low = mid + 1;
+            }
+            else {
+                high = mid;
+            }
+        }
+        
+        return (int64_t)low - 1;
+    }
+}
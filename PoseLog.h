@@ -0,0 +1,179 @@
+#ifndef POSE_LOG_H
+#define POSE_LOG_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "Posenet.h"
+
+
+namespace ORB_SLAM2 {
+
+    //pose log file layout (little-endian): a PoseLogHeader padded to headerBytes, then one fixed-size record per frame, so
+    //frame i is at headerBytes + i * recordBytes. A record is a PoseLogFrame followed by maxPersons person slots of
+    //    uint16 x[numKeyPoints], uint16 y[numKeyPoints]   coordinates as fractions of frameCols/frameRows in 1/65535 steps
+    //    uint8 score[numKeyPoints], uint8 personScore     scores in 1/255 steps
+    //padded to 4 bytes, with the record padded to 8. Slots past numPersons are zero
+    const uint32_t POSE_LOG_VERSION = 1;
+    const int POSE_LOG_MAX_KEYPOINTS = 64;
+    const int POSE_LOG_MAX_EDGES = 64;
+    const int POSE_LOG_NAME_BYTES = 24;
+
+    struct PoseLogHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerBytes;
+        uint32_t recordBytes;
+        uint32_t personBytes;
+
+        //skeleton: keypoint count and names, and the parent -> child edges between them
+        uint32_t numKeyPoints;
+        uint32_t numEdges;
+        uint8_t edges[POSE_LOG_MAX_EDGES][2];
+        char partNames[POSE_LOG_MAX_KEYPOINTS][POSE_LOG_NAME_BYTES];
+
+        //person slots per record, and the frame size the coordinates are quantized against
+        uint32_t maxPersons;
+        uint32_t frameRows;
+        uint32_t frameCols;
+        uint32_t reserved;
+    };
+
+    //start of every frame record
+    struct PoseLogFrame {
+        int64_t timestamp;
+
+        //people in the frame that were stored, and the ones that didn't fit in maxPersons slots
+        uint16_t numPersons;
+        uint16_t droppedPersons;
+        uint32_t reserved;
+    };
+
+    struct PoseLogConfig {
+        //frame size the keypoint coordinates are quantized against (coordinates are clamped to it, and keep about
+        //frameCols / 65535 pixels of precision)
+        int frameRows = 0;
+        int frameCols = 0;
+
+        //person slots in every record: 1 for single-pose archives; frames with more people keep the highest scoring ones
+        int maxPersons = 1;
+
+        //skeleton stored in the header (defaults: the 17 PoseNet keypoints and POSE_CHAIN)
+        int numKeyPoints = NUM_KEYPOINTS;
+        std::vector<std::string> partNames;
+        std::vector<std::pair<int, int>> edges;
+
+        //frames are collected in a buffer this big (rounded to whole records) and written in one go when it fills up
+        size_t bufferBytes = 256 * 1024;
+    };
+
+    //appends frames to a pose log through a user-space buffer, so a 30 fps stream costs one write() every few thousand frames.
+    //Frames become visible to readers on flush() (or when the buffer fills). Timestamps should not decrease, or lookup by
+    //timestamp won't find them. One writer per file; not thread-safe
+    class PoseLogWriter {
+        public:
+            PoseLogWriter();
+            ~PoseLogWriter();
+
+            PoseLogWriter(const PoseLogWriter&) = delete;
+            PoseLogWriter& operator=(const PoseLogWriter&) = delete;
+
+            //create (or truncate) the file and write the header
+            bool open(const std::string &path, const PoseLogConfig &pConfig);
+
+            //continue an existing log written with the same skeleton and record layout, dropping a partly written last record
+            //(e.g. from a crash). Creates the file if it doesn't exist
+            bool openAppend(const std::string &path, const PoseLogConfig &pConfig);
+
+            bool append(int64_t timestamp, const Person &person);
+            bool append(int64_t timestamp, const std::vector<Person> &persons);
+
+            template <int N>
+            bool append(int64_t timestamp, const FixedPerson<N> &person) {
+                uint8_t* record = nextRecord(timestamp, 1, 0);
+
+                if (record != NULL) {
+                    writePerson(record + sizeof(PoseLogFrame), person.keyPoints.data(), person.numKeyPoints, person.score);
+                }
+
+                return record != NULL;
+            }
+
+            //write out the buffered frames
+            bool flush();
+            void close();
+
+            bool isOpen() const { return fd >= 0; }
+            uint64_t getNumFrames() const { return numFrames; }
+
+        private:
+            int fd = -1;
+            PoseLogHeader header;
+            PoseLogConfig config;
+
+            std::vector<uint8_t> buffer;
+            size_t buffered = 0;
+            uint64_t numFrames = 0;
+
+            //person indices by score, for frames with more people than slots
+            std::vector<int> order;
+
+            bool buildHeader(const PoseLogConfig &pConfig);
+            bool writeHeader();
+            bool writeAll(const uint8_t* bytes, size_t count);
+
+            //a zeroed record in the buffer with its frame header filled in (NULL if a flush to make room failed)
+            uint8_t* nextRecord(int64_t timestamp, int numPersons, int droppedPersons);
+            void writePerson(uint8_t* slot, const KeyPoint* keyPoints, int count, float score);
+    };
+
+    //random access to a pose log through a read-only memory mapping: opening costs nothing beyond validating the header, and
+    //only the pages of the frames actually read (plus log2(frames) pages for a timestamp lookup) are ever loaded, so multi-GB
+    //logs are fine (the whole file is mapped at once, so logs bigger than a couple of GB need a 64-bit process). The const
+    //readers can be shared between threads, but refresh() and close() unmap the old mapping, so they need exclusive access:
+    //no other thread may be reading from the reader while they run (people already read are copies and stay valid)
+    class PoseLogReader {
+        public:
+            PoseLogReader();
+            ~PoseLogReader();
+
+            PoseLogReader(const PoseLogReader&) = delete;
+            PoseLogReader& operator=(const PoseLogReader&) = delete;
+
+            bool open(const std::string &path);
+            void close();
+
+            //remap if the file has grown, picking up frames a writer has flushed since; returns false if it couldn't be
+            //remapped (the old mapping stays usable). Not safe to call while other threads read from this reader
+            bool refresh();
+
+            bool isOpen() const { return data != NULL; }
+            uint64_t getNumFrames() const { return numFrames; }
+            const PoseLogHeader& getHeader() const { return *header; }
+
+            int64_t getTimestamp(uint64_t frame) const;
+            int getNumPersons(uint64_t frame) const;
+
+            //dequantized people of one frame (the reused overloads only allocate when the storage has to grow)
+            std::vector<Person> readFrame(uint64_t frame) const;
+            bool readFrame(uint64_t frame, std::vector<Person> &persons) const;
+            bool readPerson(uint64_t frame, int index, Person &person) const;
+
+            //the last frame with a timestamp at or before the given one (binary search), -1 if every frame is later
+            int64_t findFrame(int64_t timestamp) const;
+
+        private:
+            int fd = -1;
+            uint8_t* data = NULL;
+            size_t size = 0;
+            const PoseLogHeader* header = NULL;
+            uint64_t numFrames = 0;
+
+            bool map();
+            const uint8_t* record(uint64_t frame) const;
+    };
+}
+
+#endif //POSE_LOG_H
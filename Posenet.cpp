@@ -1,49 +1,145 @@
 #include "Posenet.h"
 #include <string>
 #include <stdio.h>
-#include <android/log.h>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <string.h>
+#include <unistd.h>
+#include "PosenetLog.h"
 #define LOG_TAG "POSENET.CC"
 
-#define LOG(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
-
 using namespace std;
 
 namespace ORB_SLAM2
 {    
     //get the score for a given KeyPoint
-    float KeyPoint::getScore() {
+    float KeyPoint::getScore() const {
         return score;
     }
     
     //get the KeyPoints vector for a given Person
-    std::vector<KeyPoint> Person::getKeyPoints() {
+    const std::vector<KeyPoint>& Person::getKeyPoints() const {
         return keyPoints;
     }
     
     //get the total confidence score for a given Person
-    float Person::getScore() {
+    float Person::getScore() const {
         return score;
     }
     
     
-    //Posenet object constructor
+    //Posenet object constructor. The model comes from the process-wide registry, so every instance built from the same file (e.g. one
+    //per camera stream) shares one memory-mapped copy of the weights and only the first one pays for loading it
     Posenet::Posenet(const char* pFilename, Device pDevice) {
+        stats = std::make_shared<PosenetStats>();
         filename = pFilename;
         device = pDevice;
-        model = TfLiteModelCreateFromFile(pFilename);
+        sharedModel = ModelRegistry::acquire(pFilename);
+        model = sharedModel.get();
+        ownsModel = false;
         
         //check if model initialization was successful
         if (model == NULL) {
-            LOG("Posenet model initialization failed");
+            LOGE("Posenet model initialization failed");
         }
         else {
-            LOG("Posenet model init success");
+            LOGI("Posenet model init success");
         }
     }
     
+    //same, running the interpreter on numThreads threads instead of the default 4
+    Posenet::Posenet(const char* pFilename, Device pDevice, int numThreads, const char* pWeightCachePath) : Posenet(pFilename, pDevice) {
+        NUM_LITE_THREADS = numThreads;
+        setWeightCachePath(pWeightCachePath);
+    }
+    
+    //Posenet object constructor sharing an already loaded model, which the caller keeps ownership of
+    Posenet::Posenet(TfLiteModel* pModel, Device pDevice, int numThreads, const char* pWeightCachePath) {
+        stats = std::make_shared<PosenetStats>();
+        device = pDevice;
+        model = pModel;
+        ownsModel = false;
+        NUM_LITE_THREADS = numThreads;
+        setWeightCachePath(pWeightCachePath);
+    }
+    
+    //Posenet object constructor holding a reference to a registry model
+    Posenet::Posenet(std::shared_ptr<TfLiteModel> pModel, Device pDevice, int numThreads, const char* pWeightCachePath) {
+        stats = std::make_shared<PosenetStats>();
+        device = pDevice;
+        sharedModel = pModel;
+        model = sharedModel.get();
+        ownsModel = false;
+        NUM_LITE_THREADS = numThreads;
+        setWeightCachePath(pWeightCachePath);
+    }
+    
+    //set how many threads the interpreter runs on (only takes effect for an interpreter that hasn't been created yet)
+    void Posenet::setNumThreads(int numThreads) {
+        NUM_LITE_THREADS = numThreads;
+    }
+    
+    int Posenet::getNumThreads() {
+        return NUM_LITE_THREADS;
+    }
+    
+    //set the file the delegate persists packed weights to (only takes effect for an interpreter that hasn't been created yet)
+    void Posenet::setWeightCachePath(const char* pPath) {
+        weightCachePath = (pPath == NULL) ? std::string() : std::string(pPath);
+    }
+    
     //default constructor to avoid errors when we declare a new Posenet in header files
-    Posenet::Posenet()
-    {}
+    Posenet::Posenet() {
+        stats = std::make_shared<PosenetStats>();
+    }
+    
+    //Posenet object constructor running on a backend the caller built, with no TFLite model behind it
+    Posenet::Posenet(std::shared_ptr<InferenceBackend> pBackend) {
+        stats = std::make_shared<PosenetStats>();
+        setBackend(pBackend);
+    }
+    
+    //switch inference to the given backend (NULL goes back to the TFLite model, if there is one)
+    void Posenet::setBackend(std::shared_ptr<InferenceBackend> pBackend) {
+        externalBackend = pBackend;
+        
+        //whatever the new backend's input is, it starts at batch 1 and needs its own quantization table
+        inputBatchSize = 1;
+        inputTableBuilt = false;
+        
+        if (externalBackend != NULL) {
+            LOGI("setBackend(): running on the %s backend", externalBackend->getName());
+        }
+    }
+    
+    InferenceBackend* Posenet::activeBackend() {
+        if (externalBackend != NULL) {
+            return externalBackend.get();
+        }
+        
+        //a pure read: tfliteBackend is pointed at the interpreter wherever that changes, so the pipeline threads can all call this
+        return interpreter == NULL ? NULL : &tfliteBackend;
+    }
+    
+    InferenceBackend* Posenet::getBackend() {
+        if (externalBackend == NULL && interpreter == NULL && getInterpreter() == NULL) {
+            return NULL;
+        }
+        
+        return activeBackend();
+    }
+    
+    //per-stage latency histograms and counters for this instance (shared with copies of it)
+    PosenetStats& Posenet::getStats() {
+        return *stats;
+    }
+    
+    //wall-clock duration of the last backend invoke, or -1 if nothing has run yet
+    int64_t Posenet::getLastInferenceTimeNanos() {
+        return lastInferenceTimeNanos;
+    }
     
     
     //set up the Tensorflow inference interpreter
@@ -54,7 +150,7 @@ namespace ORB_SLAM2
         }
         
         //otherwise we need to create a new interpreter
-        LOG("getInterpreter(): need to create new");
+        LOGD("getInterpreter(): need to create new");
         
         //create interpreter options
         options = TfLiteInterpreterOptionsCreate();
@@ -92,47 +188,322 @@ namespace ORB_SLAM2
         }
         
         
+        else if (device == Device::XNNPACK || device == Device::XNNPACK_FP16 || device == Device::XNNPACK_INT8) {
+            delegate = createXnnpackDelegate();
+            
+            if (delegate != NULL) {
+                TfLiteInterpreterOptionsAddDelegate(options, delegate);
+            }
+            else {
+                LOGW("getInterpreter(): XNNPACK delegate create failed, using the default CPU kernels");
+            }
+        }
+        
+        
         //instantiate the interpreter using the model we loaded
         TfLiteInterpreter* newInterpreter = TfLiteInterpreterCreate(model, options);
         
         if (newInterpreter == NULL) {
-            LOG("Interpreter create failed");
+            LOGE("Interpreter create failed");
+            
+            //don't leave this attempt's options and delegate behind for the next one to overwrite
+            CachedInterpreter failed;
+            failed.options = options;
+            failed.delegate = delegate;
+            deleteInterpreter(failed);
+            
+            options = NULL;
+            delegate = NULL;
+            
             return NULL;
         }
         
-        LOG("Interpreter create success");
+        LOGD("Interpreter create success");
         
-        LOG("getInterpreter(): allocating tensors for new interpreter");
+        LOGD("getInterpreter(): allocating tensors for new interpreter");
         
         //allocate tensors for the interpreter
         if (TfLiteInterpreterAllocateTensors(newInterpreter) != kTfLiteOk) {
-            LOG("TfLite allocate tensors failed");
+            LOGE("TfLite allocate tensors failed");
+            
+            CachedInterpreter failed;
+            failed.interpreter = newInterpreter;
+            failed.options = options;
+            failed.delegate = delegate;
+            deleteInterpreter(failed);
+            
+            options = NULL;
+            delegate = NULL;
+            
             return NULL;
         }
         
-        LOG("getInterpreter(): tensor allocation finished successfully");
+        LOGD("getInterpreter(): tensor allocation finished successfully");
         
         //save the newly created interpreter
         interpreter = newInterpreter;
+        tfliteBackend.setInterpreter(interpreter);
         
         return newInterpreter;
     
     }
     
-    //clean up the interpreter and possibly the gpuDelegate
-    void Posenet::close() {
+    //build the interpreter now and run a few invokes on synthetic mid-gray input, timing the cold one separately
+    WarmupReport Posenet::prepare(const WarmupOptions &warmup) {
+        WarmupReport report;
+        report.createdInterpreter = (activeBackend() == NULL);
+        
+        if (warmup.weightCachePath != NULL) {
+            //the delegate reads its cache when it's built, so an interpreter that already exists keeps going without it
+            if (!report.createdInterpreter && weightCachePath != warmup.weightCachePath) {
+                LOGW("prepare(): interpreter already built, weight cache %s only applies to the next one", warmup.weightCachePath);
+            }
+            
+            setWeightCachePath(warmup.weightCachePath);
+        }
+        
+        uint64_t createStartNanos = PosenetStats::nowNanos();
+        
+        InferenceBackend* backend = getBackend();
+        
+        if (backend == NULL) {
+            LOGE("prepare(): couldn't create the interpreter");
+            return report;
+        }
+        
+        report.createNanos = PosenetStats::nowNanos() - createStartNanos;
+        report.weightCacheFound = weightCacheLoaded;
+        
+        TensorView input = backend->getInputView();
+        void* inputData = backend->getInputBuffer();
+        
+        if (inputData == NULL || input.empty()) {
+            LOGE("prepare(): input tensor has no data buffer");
+            return report;
+        }
+        
+        //0.0 after normalization; quantized inputs encode it as their zero point (a raw 0 would be black)
+        memset(inputData, input.quantized() ? (uint8_t)input.zeroPoint : 0, input.byteSize());
+        
+        uint64_t warmTotalNanos = 0;
+        
+        for (int i = 0; i < warmup.warmupRuns; i++) {
+            if (!invoke()) {
+                LOGE("prepare(): warmup invoke %d failed", i);
+                return report;
+            }
+            
+            uint64_t invokeNanos = (uint64_t)lastInferenceTimeNanos;
+            
+            if (i == 0) {
+                report.coldInvokeNanos = invokeNanos;
+            }
+            else {
+                warmTotalNanos += invokeNanos;
+                report.warmMaxNanos = std::max(report.warmMaxNanos, invokeNanos);
+            }
+        }
+        
+        report.warmupRuns = warmup.warmupRuns;
+        
+        if (warmup.warmupRuns > 1) {
+            report.warmInvokeNanos = warmTotalNanos / (warmup.warmupRuns - 1);
+        }
+        
+        if (warmup.resetStats) {
+            stats->reset();
+            lastInferenceTimeNanos = -1;
+        }
+        
+        LOGI("prepare(): create %.2f ms, cold invoke %.2f ms, warm invoke %.2f ms (max %.2f ms) over %d runs", report.createNanos / 1e6,
+        report.coldInvokeNanos / 1e6, report.warmInvokeNanos / 1e6, report.warmMaxNanos / 1e6, report.warmupRuns);
+        
+        report.ok = true;
+        
+        return report;
+    }
+    
+    //XNNPACK delegate for the current device and thread count. The fp16 variant is refused by XNNPACK on CPUs without fp16
+    //arithmetic, in which case we retry in fp32
+    TfLiteDelegate* Posenet::createXnnpackDelegate() {
+        TfLiteXNNPackDelegateOptions xnnpackOptions = TfLiteXNNPackDelegateOptionsDefault();
+        xnnpackOptions.num_threads = NUM_LITE_THREADS;
+        
+        if (device == Device::XNNPACK_INT8) {
+            xnnpackOptions.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_QS8 | TFLITE_XNNPACK_DELEGATE_FLAG_QU8;
+        }
+        
+        //packed weights persist here across restarts (see prepare())
+        weightCacheLoaded = !weightCachePath.empty() && access(weightCachePath.c_str(), R_OK) == 0;
+        
+        if (!weightCachePath.empty()) {
+            xnnpackOptions.weight_cache_file_path = weightCachePath.c_str();
+        }
+        
+        if (device == Device::XNNPACK_FP16) {
+            TfLiteXNNPackDelegateOptions fp16Options = xnnpackOptions;
+            fp16Options.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_FORCE_FP16;
+            
+            TfLiteDelegate* fp16Delegate = TfLiteXNNPackDelegateCreate(&fp16Options);
+            
+            if (fp16Delegate != NULL) {
+                return fp16Delegate;
+            }
+            
+            LOGW("createXnnpackDelegate(): no fp16 support on this CPU, falling back to fp32");
+        }
+        
+        return TfLiteXNNPackDelegateCreate(&xnnpackOptions);
+    }
+    
+    void Posenet::deleteInterpreter(CachedInterpreter &cached) {
         //delete the interpreter we made, if it exists
+        if (cached.interpreter != NULL) {
+            TfLiteInterpreterDelete(cached.interpreter);
+            cached.interpreter = NULL;
+        }
+        
+        if (cached.options != NULL) {
+            TfLiteInterpreterOptionsDelete(cached.options);
+            cached.options = NULL;
+        }
+        
+        //the interpreter is gone, so nothing uses the delegate anymore
+        if (cached.delegate != NULL) {
+            TfLiteXNNPackDelegateDelete(cached.delegate);
+            cached.delegate = NULL;
+        }
+    }
+    
+    void Posenet::releaseInterpreter() {
+        CachedInterpreter current;
+        current.interpreter = interpreter;
+        current.options = options;
+        current.delegate = delegate;
+        
+        deleteInterpreter(current);
+        
+        interpreter = NULL;
+        options = NULL;
+        delegate = NULL;
+        tfliteBackend.setInterpreter(NULL);
+        
+        for (auto &cached : resolutionCache) {
+            deleteInterpreter(cached);
+        }
+        
+        resolutionCache.clear();
+        
+        //a new interpreter starts with the model's own input shape
+        inputBatchSize = 1;
+    }
+    
+    bool Posenet::rebuildInterpreter(int threads, int batchSize, int rows, int cols) {
+        releaseInterpreter();
+        NUM_LITE_THREADS = threads;
+        
+        if (getInterpreter() == NULL) {
+            return false;
+        }
+        
+        if (rows <= 0 || cols <= 0) {
+            return true;
+        }
+        
+        if (!activeBackend()->resizeInput(batchSize, rows, cols)) {
+            LOGW("rebuildInterpreter(): couldn't reshape the input to %d x %d x %d", batchSize, cols, rows);
+            return false;
+        }
+        
+        inputBatchSize = batchSize;
+        
+        return true;
+    }
+    
+    //try each thread count on synthetic input. For LATENCY the fastest invoke wins; for THROUGHPUT the most frames per second per
+    //core wins, since a server fills its cores with (cores / threads) interpreters running side by side
+    TuneResult Posenet::autotune(TuneObjective objective, int maxThreads, int runsPerSetting) {
+        TuneResult result;
+        int bestIndex = 0;
+        
+        //thread counts only mean something for interpreters we build ourselves
+        if (externalBackend != NULL) {
+            LOGW("autotune(): the %s backend has no thread setting to tune", externalBackend->getName());
+            return result;
+        }
+        
+        if (maxThreads <= 0) {
+            maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+        }
+        
+        //tune at the input shape in use, not the model's default one (every rebuild below starts from the model's shape)
+        int tuneRows = 0, tuneCols = 0;
+        int tuneBatchSize = inputBatchSize;
+        
         if (interpreter != NULL) {
-            TfLiteInterpreterDelete(interpreter);
+            getInputSize(tuneRows, tuneCols);
+        }
+        
+        //one warmup invoke to absorb kernel preparation, then the timed ones
+        WarmupOptions warmup;
+        warmup.warmupRuns = runsPerSetting + 1;
+        
+        for (int threads = 1; threads <= maxThreads; threads++) {
+            WarmupReport report;
+            
+            if (rebuildInterpreter(threads, tuneBatchSize, tuneRows, tuneCols)) {
+                report = prepare(warmup);
+            }
+            
+            if (!report.ok) {
+                LOGW("autotune(): couldn't run with %d threads", threads);
+                continue;
+            }
+            
+            ThreadTiming timing;
+            timing.threads = threads;
+            timing.meanInvokeNanos = std::max<uint64_t>(report.warmInvokeNanos, 1);
+            timing.framesPerCoreSecond = 1e9 / ((double)timing.meanInvokeNanos * threads);
+            
+            LOGI("autotune(): %d threads: %.3f ms per invoke, %.1f frames per core-second", threads, timing.meanInvokeNanos / 1e6,
+            timing.framesPerCoreSecond);
+            
+            bool better = result.timings.empty() || (objective == TuneObjective::LATENCY ?
+            timing.meanInvokeNanos < result.timings[bestIndex].meanInvokeNanos :
+            timing.framesPerCoreSecond > result.timings[bestIndex].framesPerCoreSecond);
+            
+            if (better) {
+                bestIndex = (int)result.timings.size();
+            }
+            
+            result.timings.push_back(timing);
         }
         
-        if (options != NULL) {
-            TfLiteInterpreterOptionsDelete(options);
+        if (result.timings.empty()) {
+            return result;
         }
         
-        if (model != NULL) {
+        result.bestThreads = result.timings[bestIndex].threads;
+        
+        result.ok = rebuildInterpreter(result.bestThreads, tuneBatchSize, tuneRows, tuneCols) && prepare().ok;
+        
+        LOGI("autotune(): picked %d threads", result.bestThreads);
+        
+        return result;
+    }
+    
+    //clean up the interpreter and possibly the gpuDelegate
+    void Posenet::close() {
+        releaseInterpreter();
+        externalBackend.reset();
+        
+        if (model != NULL && ownsModel) {
             TfLiteModelDelete(model);
         }
+        
+        //drop our reference to a shared model (the registry unmaps it once nobody holds it)
+        sharedModel.reset();
+        model = NULL;
     }
     
     //Scale the image pixels to a float array of [-1,1] values.
@@ -140,14 +511,14 @@ namespace ORB_SLAM2
         int bytesPerChannel = 4;
         int inputChannels = incomingImg.channels();
         
-        LOG("incoming Mat has %d channels", inputChannels);
+        LOGT("incoming Mat has %d channels", inputChannels);
         
         int batchSize = 1;
         
         int cols = incomingImg.cols;
         int rows = incomingImg.rows;
         
-        LOG("incoming Mat has %d rows, %d cols", rows, cols);
+        LOGT("incoming Mat has %d rows, %d cols", rows, cols);
         
         //allocate a float array for all 3 input channels (for each channel allocate space for the entire Mat)
         std::vector<float> inputBuffer(batchSize * bytesPerChannel * cols * rows * inputChannels / 4); //div by 4 because we were doing bytes
@@ -164,7 +535,7 @@ namespace ORB_SLAM2
         int cols2 = incomingImg.cols;
         int rows2 = incomingImg.rows;
         
-        LOG("incoming Mat AFTER CONVERSION has %d rows, %d cols", rows2, cols2);
+        LOGT("incoming Mat AFTER CONVERSION has %d rows, %d cols", rows2, cols2);
         
         //get pointer to the data (array of ints)
         const int* intValues = (int*) incomingImg.data;
@@ -194,6 +565,187 @@ namespace ORB_SLAM2
     }
     
     
+    //set the channel order of incoming Mats; 4-channel Mats are read as the matching RGBA/BGRA and 1-channel Mats as grayscale
+    void Posenet::setInputFormat(PixelFormat format) {
+        inputFormat = format;
+    }
+    
+    //resize, reorder to RGB and normalize the image to [-1,1] in one pass into dst, which has room for one model input
+    //(inputRows * inputCols * 3 floats)
+    bool Posenet::planInput(const cv::Mat &img, PixelFormat &format) {
+        if (img.empty() || img.depth() != CV_8U) {
+            LOGE("preprocess(): expected a non-empty 8-bit Mat");
+            return false;
+        }
+        
+        //work out the real pixel format from the channel count
+        bool bgr = (inputFormat == PixelFormat::BGR || inputFormat == PixelFormat::BGRA);
+        
+        switch (img.channels()) {
+            case 1:
+                format = PixelFormat::GRAY;
+                break;
+            case 3:
+                format = bgr ? PixelFormat::BGR : PixelFormat::RGB;
+                break;
+            case 4:
+                format = bgr ? PixelFormat::BGRA : PixelFormat::RGBA;
+                break;
+            default:
+                LOGE("preprocess(): unsupported channel count %d", img.channels());
+                return false;
+        }
+        
+        int inputRows, inputCols;
+        getInputSize(inputRows, inputCols);
+        
+        inputPlan.update(img.rows, img.cols, img.channels(), inputRows, inputCols);
+        
+        return true;
+    }
+    
+    bool Posenet::preprocess(const cv::Mat &img, float* dst) {
+        PixelFormat format;
+        
+        if (!planInput(img, format)) {
+            return false;
+        }
+        
+        preprocessToFloat(img.data, img.step, format, inputPlan, dst);
+        
+        return true;
+    }
+    
+    //a YUV frame is planned over its luma plane; the kernel finds the chroma samples from the same columns
+    bool Posenet::planInput(const YuvFrame &frame) {
+        if (frame.empty()) {
+            LOGE("preprocess(): expected a non-empty YUV frame with all of its planes");
+            return false;
+        }
+        
+        int inputRows, inputCols;
+        getInputSize(inputRows, inputCols);
+        
+        inputPlan.update(frame.rows, frame.cols, 1, inputRows, inputCols);
+        
+        return true;
+    }
+    
+    bool Posenet::preprocess(const YuvFrame &frame, float* dst) {
+        if (!planInput(frame)) {
+            return false;
+        }
+        
+        preprocessYuvToFloat(frame, inputPlan, dst);
+        
+        return true;
+    }
+    
+    //quantization table for the input tensor, rebuilt when its encoding changes; NULL when the raw pixels already are the encoding
+    const uint8_t* Posenet::inputQuantizeTable(const TensorView &input) {
+        if (!inputTableBuilt || input.type != inputTableType || input.scale != inputTableScale || input.zeroPoint != inputTableZeroPoint) {
+            inputTableRaw = buildQuantizeTable(input.scale, input.zeroPoint, input.type == TensorType::INT8, inputTable);
+            inputTableBuilt = true;
+            inputTableType = input.type;
+            inputTableScale = input.scale;
+            inputTableZeroPoint = input.zeroPoint;
+        }
+        
+        return inputTableRaw ? NULL : inputTable;
+    }
+    
+    //dispatch on the input tensor's type; quantized models skip normalization and take (normally) the raw resized pixels
+    bool Posenet::preprocessInput(const cv::Mat &img, void* dst) {
+        InferenceBackend* backend = activeBackend();
+        TensorView input = (backend == NULL) ? TensorView() : backend->getInputView();
+        
+        //the backend can't describe its input (e.g. an unsupported tensor type)
+        if (backend != NULL && input.empty()) {
+            LOGE("preprocessInput(): no usable input tensor on the %s backend", backend->getName());
+            return false;
+        }
+        
+        if (!input.quantized()) {
+            return preprocess(img, (float*)dst);
+        }
+        
+        PixelFormat format;
+        
+        if (!planInput(img, format)) {
+            return false;
+        }
+        
+        preprocessToBytes(img.data, img.step, format, inputPlan, inputQuantizeTable(input), (uint8_t*)dst);
+        
+        return true;
+    }
+    
+    bool Posenet::preprocessInput(const YuvFrame &frame, void* dst) {
+        InferenceBackend* backend = activeBackend();
+        TensorView input = (backend == NULL) ? TensorView() : backend->getInputView();
+        
+        //the backend can't describe its input (e.g. an unsupported tensor type)
+        if (backend != NULL && input.empty()) {
+            LOGE("preprocessInput(): no usable input tensor on the %s backend", backend->getName());
+            return false;
+        }
+        
+        if (!input.quantized()) {
+            return preprocess(frame, (float*)dst);
+        }
+        
+        if (!planInput(frame)) {
+            return false;
+        }
+        
+        preprocessYuvToBytes(frame, inputPlan, inputQuantizeTable(input), (uint8_t*)dst);
+        
+        return true;
+    }
+    
+    //bytes of one frame of input tensor 0
+    size_t Posenet::getInputBytes() {
+        int inputRows, inputCols;
+        getInputSize(inputRows, inputCols);
+        
+        InferenceBackend* backend = activeBackend();
+        bool quantizedInput = (backend != NULL && backend->getInputView().quantized());
+        
+        return (size_t)inputRows * inputCols * 3 * (quantizedInput ? 1 : sizeof(float));
+    }
+    
+    //start of slot batchIndex in the backend's input tensor, NULL if there's no tensor to write into
+    uint8_t* Posenet::inputSlot(int batchIndex) {
+        InferenceBackend* backend = activeBackend();
+        
+        if (backend == NULL) {
+            LOGE("fillInputTensor(): no backend to write into");
+            return NULL;
+        }
+        
+        uint8_t* dst = (uint8_t*)backend->getInputBuffer();
+        
+        if (dst == NULL) {
+            LOGE("fillInputTensor(): input tensor has no data buffer");
+            return NULL;
+        }
+        
+        return dst + batchIndex * getInputBytes();
+    }
+    
+    //preprocess the image directly into slot batchIndex of the backend's input tensor
+    bool Posenet::fillInputTensor(const cv::Mat &img, int batchIndex) {
+        uint8_t* dst = inputSlot(batchIndex);
+        
+        return dst != NULL && preprocessInput(img, dst);
+    }
+    
+    bool Posenet::fillInputTensor(const YuvFrame &frame, int batchIndex) {
+        uint8_t* dst = inputSlot(batchIndex);
+        
+        return dst != NULL && preprocessInput(frame, dst);
+    }
+    
     //Returns value within [0,1], for calculating confidence scores
     float Posenet::sigmoid(float x) {
         return (1.0 / (1.0 + exp(-x)));
@@ -206,14 +758,21 @@ namespace ORB_SLAM2
         //make a map from int to something (some object)
         std::unordered_map<int, std::vector<std::vector<std::vector<std::vector<float>>>> > outputMap;
         
-        int32_t out = TfLiteInterpreterGetOutputTensorCount(interpreter);
+        InferenceBackend* backend = activeBackend();
+        
+        if (backend == NULL) {
+            LOGE("initOutputMap(): no backend to size the outputs from");
+            return outputMap;
+        }
+        
+        int32_t out = backend->getNumOutputs();
         
-        LOG("initOutputMap(): interpreter has %d output tensors", out);
+        LOGT("initOutputMap(): %s backend has %d output tensors", backend->getName(), out);
         
         //HEATMAP -- 1 * 9 * 9 * 17 contains heatmaps
-        const TfLiteTensor* t0 = TfLiteInterpreterGetOutputTensor(interpreter, 0);
+        TensorView t0 = getOutputView(0);
         
-        int32_t numDims = TfLiteTensorNumDims(t0);
+        int32_t numDims = 4;
         
         //initialize int array to hold all dimens
         std::vector<int32_t> heatmapsShape;
@@ -221,7 +780,7 @@ namespace ORB_SLAM2
         //iterate over the num of dimensions this tensor has, getting each one and storing it
         for (int i = 0; i < numDims; i++) {
             //get this dimension and add it to the list
-            heatmapsShape.push_back(TfLiteTensorDim(t0, i));
+            heatmapsShape.push_back(t0.shape[i]);
         }
         
         //4D array of floats for the keypoints heatmap
@@ -244,7 +803,7 @@ namespace ORB_SLAM2
             }
         }
         
-        LOG("Heatmaps shape is %d x %d x %d x %d", heatmapsShape[0], heatmapsShape[1], heatmapsShape[2], heatmapsShape[3]);
+        LOGT("Heatmaps shape is %d x %d x %d x %d", heatmapsShape[0], heatmapsShape[1], heatmapsShape[2], heatmapsShape[3]);
         
         outputMap[0] = heatmaps;
         
@@ -252,10 +811,10 @@ namespace ORB_SLAM2
         
         //OFFSETS -- 1 * 9 * 9 * 34 contains offsets
         
-        const TfLiteTensor* t1 = TfLiteInterpreterGetOutputTensor(interpreter, 1);
+        TensorView t1 = getOutputView(1);
         
         
-        numDims = TfLiteTensorNumDims(t1);
+        numDims = 4;
         
         //initialize int array to hold all dimens
         std::vector<int32_t> offsetsShape;
@@ -263,7 +822,7 @@ namespace ORB_SLAM2
         //iterate over the num of dimensions this tensor has, getting each one and storing it
         for (int i = 0; i < numDims; i++) {
             //get this dimension and add it to the list
-            offsetsShape.push_back(TfLiteTensorDim(t1, i));
+            offsetsShape.push_back(t1.shape[i]);
         }
         
         //4D array of floats for the keypoints heatmap
@@ -286,15 +845,15 @@ namespace ORB_SLAM2
             }
         }
         
-        LOG("Offsets shape is %d x %d x %d x %d", offsetsShape[0], offsetsShape[1], offsetsShape[2], offsetsShape[3]);
+        LOGT("Offsets shape is %d x %d x %d x %d", offsetsShape[0], offsetsShape[1], offsetsShape[2], offsetsShape[3]);
         
         outputMap[1] = offsets;
         
         //FORWARD DISPLACEMENTS -- 1 * 9 * 9 * 32 contains forward displacements
-        const TfLiteTensor* t2 = TfLiteInterpreterGetOutputTensor(interpreter, 2);
+        TensorView t2 = getOutputView(2);
         
         
-        numDims = TfLiteTensorNumDims(t2);
+        numDims = 4;
         
         //initialize int array to hold all dimens
         std::vector<int32_t> displacementsFwdShape;
@@ -302,7 +861,7 @@ namespace ORB_SLAM2
         //iterate over the num of dimensions this tensor has, getting each one and storing it
         for (int i = 0; i < numDims; i++) {
             //get this dimension and add it to the list
-            displacementsFwdShape.push_back(TfLiteTensorDim(t2, i));
+            displacementsFwdShape.push_back(t2.shape[i]);
         }
         
         //4D array of floats for the keypoints heatmap
@@ -325,17 +884,17 @@ namespace ORB_SLAM2
             }
         }
         
-        LOG("Disp fwd shape is %d x %d x %d x %d", displacementsFwdShape[0], displacementsFwdShape[1], displacementsFwdShape[2], displacementsFwdShape[3]);
+        LOGT("Disp fwd shape is %d x %d x %d x %d", displacementsFwdShape[0], displacementsFwdShape[1], displacementsFwdShape[2], displacementsFwdShape[3]);
         
         outputMap[2] = displacementsFwd;
         
         
         
         //BACKWARD DISPLACEMENTS -- 1 * 9 * 9 * 32 contains backward displacements
-        const TfLiteTensor* t3 = TfLiteInterpreterGetOutputTensor(interpreter, 3);
+        TensorView t3 = getOutputView(3);
         
         
-        numDims = TfLiteTensorNumDims(t3);
+        numDims = 4;
         
         //initialize int array to hold all dimens
         std::vector<int32_t> displacementsBwdShape;
@@ -343,7 +902,7 @@ namespace ORB_SLAM2
         //iterate over the num of dimensions this tensor has, getting each one and storing it
         for (int i = 0; i < numDims; i++) {
             //get this dimension and add it to the list
-            displacementsBwdShape.push_back(TfLiteTensorDim(t3, i));
+            displacementsBwdShape.push_back(t3.shape[i]);
         }
         
         //4D array of floats for the keypoints heatmap
@@ -367,7 +926,7 @@ namespace ORB_SLAM2
         }
         
         
-        LOG("Disp bwd shape is %d x %d x %d x %d", displacementsBwdShape[0], displacementsBwdShape[1], displacementsBwdShape[2], displacementsBwdShape[3]);
+        LOGT("Disp bwd shape is %d x %d x %d x %d", displacementsBwdShape[0], displacementsBwdShape[1], displacementsBwdShape[2], displacementsBwdShape[3]);
         outputMap[3] = displacementsBwd;
         
         
@@ -400,139 +959,181 @@ namespace ORB_SLAM2
     }
     
     
-    void Posenet::runForMultipleInputsOutputs(std::vector<float> &inputs
-    , std::unordered_map<int, std::vector<std::vector<std::vector<std::vector<float>>>> > &outputs) {
-        //kep track of time it takes to run inference
-        //this.inferenceDurationNanoseconds = -1L;
-        
+    //copy the input floats into the model's input tensor and run the interpreter, leaving the results in the output tensors
+    bool Posenet::runInference(const std::vector<float> &inputs) {
         //make sure we have some input data
-        if (inputs.size() != 0) {
-            //make sure we have output map initialized
-            if (!outputs.empty()) {
-         
-                TfLiteTensor* curr_input_tensor = TfLiteInterpreterGetInputTensor(interpreter, 0);
-                if (curr_input_tensor == NULL) {
-                    LOG("This input tensor came up NULL");
-                    return;
-                }
-                
-                //copy the input float data to the input tensor
-                if (TfLiteTensorCopyFromBuffer(curr_input_tensor, inputs.data(), TfLiteTensorByteSize(curr_input_tensor)) != kTfLiteOk) {
-                    LOG("TfLite copyFROMbuffer failure! Returning...");
-                    return;
-                }
-                else {
-                    LOG("TfLite copyFROMbuffer success");
-                }
-                
-                //long inferenceStartNanos = System.nanoTime();
-                
-                LOG("Running inference...");
-                
-                //invoke interpreter to run the model
-                if (TfLiteInterpreterInvoke(interpreter) != kTfLiteOk) {
-                    LOG("TfLiteInterpreterInvoke FAILED");
-                    return;
-                }
-                else {
-                    LOG("TfLiteInterpreterInvoke SUCCESS");
-                }
-                
-                
-                //long inferenceDurationNanoseconds = System.nanoTime() - inferenceStartNanos;
-                
-                
-                //check how many output tensors -- FOUR
-                int32_t out_tens = TfLiteInterpreterGetOutputTensorCount(interpreter);
-                
-                LOG("We have %d output tensors", out_tens);
-                
-                LOG("Our map size is %d", outputs.size());
-                
-                
-                //iterate over each key-value pair in the output map (should iterate 4 times)
-                for (auto& element : outputs) { //make sure we're modifying the actual element
-                    LOG("Running unordered_map iteration...");
-                    
-                    //copy output tensor data into output map
-                    const TfLiteTensor* curr_output_tensor = TfLiteInterpreterGetOutputTensor(interpreter, element.first);
-                    
-                    if (curr_output_tensor == NULL) {
-                        LOG("This output tensor came up NULL");
-                        return;
-                    }
-                    else {
-                        LOG("This output tensor found successfully");
-                    }
-                    
-                    LOG("This output tensor has size %d, or %d floats", TfLiteTensorByteSize(curr_output_tensor), TfLiteTensorByteSize(curr_output_tensor)/4);
-                    
-                    
-                    //get underlying data as float*
-                    float* data = (float*)TfLiteTensorData(curr_output_tensor);
-                    
-                    //make sure we got data successfully
-                    if (data == NULL) {
-                        LOG("Problem getting underlying data buffer from this output tensor");
-                        return;
-                    }
-                    
-                    //I think we need a function similar to
-                    //private static native void readMultiDimensionalArray(long var0, Object var2) from Posenet Java lib, since our output
-                    //tensors have one FLAT data buffer and we want
-                    //to copy the data into our multidimensional (4D) initialized output arrays
-                    readFlatIntoMultiDimensionalArray(data, element.second);
-                }
-                
-                //this.inferenceDurationNanoseconds = inferenceDurationNanoseconds;
-            }
-            
-            else {
-                LOG("runForMultipleInputsOutpus: Input error: Outputs should not be null or empty.");
-            }
+        if (inputs.size() == 0) {
+            LOGE("runInference: Inputs should not be null or empty.");
+            return false;
         }
         
-        else {
-            LOG("runForMultipleInputsOutputs: Inputs should not be null or empty.");
+        InferenceBackend* backend = activeBackend();
+        TensorView input = (backend == NULL) ? TensorView() : backend->getInputView();
+        
+        if (input.empty()) {
+            LOGE("This input tensor came up NULL");
+            return false;
+        }
+        
+        //normalized floats only make sense for a float model (quantized models go through fillInputTensor/preprocessInput)
+        if (input.quantized()) {
+            LOGE("runInference: model input is quantized, float inputs can't be copied in");
+            return false;
+        }
+        
+        uint64_t copyStartNanos = PosenetStats::nowNanos();
+        
+        //copy the input float data to the input tensor
+        if (!backend->setInput(inputs.data(), inputs.size() * sizeof(float))) {
+            LOGE("runInference: copying %d floats into the input failed! Returning...", (int)inputs.size());
+            stats->increment(Counter::FAILURES);
+            return false;
         }
+        
+        stats->recordSpan(Stage::INPUT_COPY, copyStartNanos, PosenetStats::nowNanos());
+        
+        return invoke();
     }
     
-    //main function/entry point for running a Posenet inference on an input image
-    Person Posenet::estimateSinglePose(const cv::Mat &img, TfLiteInterpreter* pInterpreter) {
-        clock_t estimationStartTimeNanos = clock();
+    //run the backend on whatever is in the input tensor, timing it with the monotonic clock
+    bool Posenet::invoke() {
+        InferenceBackend* backend = activeBackend();
         
-        std::vector<float> inputArray = initInputArray(img);
+        uint64_t inferenceStartNanos = PosenetStats::nowNanos();
         
-        //print out how long scaling took
-        //Log.i("posenet", String.format("Scaling to [-1,1] took %.2f ms", 1.0f * (SystemClock.elapsedRealtimeNanos() - estimationStartTimeNanos) / 1_000_000))
+        if (backend == NULL || !backend->invoke()) {
+            LOGE("invoke(): inference FAILED");
+            stats->increment(Counter::FAILURES);
+            return false;
+        }
         
-        TfLiteInterpreter* mInterpreter;
+        uint64_t inferenceEndNanos = PosenetStats::nowNanos();
         
-        if (interpreter == NULL) {
-            mInterpreter = getInterpreter();
+        lastInferenceTimeNanos = (int64_t)(inferenceEndNanos - inferenceStartNanos);
+        stats->recordSpan(Stage::INVOKE, inferenceStartNanos, inferenceEndNanos);
+        
+        return true;
+    }
+    
+    
+    //view of an output of the backend (no copy, valid until the next invoke)
+    TensorView Posenet::getOutputView(int index) {
+        InferenceBackend* backend = activeBackend();
+        
+        if (backend == NULL) {
+            LOGE("getOutputView(): no backend to read output %d from", index);
+            return TensorView();
         }
-        else {
-            LOG("estimateSinglePose: already have interpreter");
-            mInterpreter = interpreter;
+        
+        return backend->getOutputView(index);
+    }
+    
+    
+    void Posenet::runForMultipleInputsOutputs(std::vector<float> &inputs
+    , std::unordered_map<int, std::vector<std::vector<std::vector<std::vector<float>>>> > &outputs) {
+        //compatibility shim over runInference(): the outputs get copied into the caller's 4D vectors
+        
+        //make sure we have output map initialized
+        if (outputs.empty()) {
+            LOGE("runForMultipleInputsOutpus: Input error: Outputs should not be null or empty.");
+            return;
+        }
+        
+        if (!runInference(inputs)) {
+            return;
         }
         
-        std::unordered_map<int, std::vector<std::vector<std::vector<std::vector<float>>>> > outputMap = initOutputMap();
+        StageTimer outputTimer(stats.get(), Stage::OUTPUT_READ);
         
-        //get the elapsed time since system boot
-        clock_t inferenceStartTimeNanos = clock();
+        //iterate over each key-value pair in the output map (should iterate 4 times)
+        for (auto& element : outputs) { //make sure we're modifying the actual element
+            TensorView view = getOutputView(element.first);
+            
+            if (view.empty()) {
+                return;
+            }
+            
+            //our output tensors have one FLAT data buffer and we want to copy the data into our multidimensional (4D)
+            //initialized output arrays
+            if (!view.quantized()) {
+                readFlatIntoMultiDimensionalArray((float*)view.data, element.second);
+                continue;
+            }
+            
+            //quantized outputs get dequantized element by element on the way
+            auto &map = element.second;
+            
+            for (size_t n = 0; n < map.size(); n++) {
+                for (size_t h = 0; h < map[n].size(); h++) {
+                    for (size_t w = 0; w < map[n][h].size(); w++) {
+                        for (size_t c = 0; c < map[n][h][w].size(); c++) {
+                            map[n][h][w][c] = view.at((int)n, (int)h, (int)w, (int)c);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    //input rows/cols of the stock posenet_model.tflite
+    static const int DEFAULT_INPUT_SIZE = 257;
+    
+    //run the model on an image (a Mat or a YuvFrame), leaving the results in the backend's output tensors
+    template <typename Frame>
+    bool Posenet::runModel(const Frame &img) {
+        if (getBackend() == NULL) {
+            LOGE("runModel: no backend available");
+            return false;
+        }
         
-        //from https://www.tensorflow.org/lite/guide/inference: each entry in inputArray corresponds to an input tensor and
-        //outputMap maps indices of output tensors to the corresponding output data.
-        runForMultipleInputsOutputs(inputArray, outputMap);
+        //go back to a single frame if the last call was a batch
+        if (!setBatchSize(1)) {
+            return false;
+        }
         
-        //get the elapsed time since system boot again, and subtract the first split we took to find how long running the model took
-        clock_t lastInferenceTimeNanos = clock() - inferenceStartTimeNanos;
+        uint64_t preprocessStartNanos = PosenetStats::nowNanos();
         
-        //print out how long the interpreter took
-        //Log.i("posenet", String.format("Interpreter took %.2f ms", 1.0f * lastInferenceTimeNanos / 1_000_000))
+        //preprocess straight into input tensor 0
+        if (!fillInputTensor(img)) {
+            stats->increment(Counter::FAILURES);
+            return false;
+        }
         
+        stats->recordSpan(Stage::PREPROCESS, preprocessStartNanos, PosenetStats::nowNanos());
         
-        //***at this point the output data we need from the model is in outputMap
+        //from https://www.tensorflow.org/lite/guide/inference: the results are left in the output tensors, which we read in
+        //place afterwards
+        return invoke();
+    }
+    
+    //get the rows and cols the model's input tensor expects (257 x 257 for the stock model)
+    void Posenet::getInputSize(int &inputRows, int &inputCols) {
+        InferenceBackend* backend = activeBackend();
+        TensorView input = (backend == NULL) ? TensorView() : backend->getInputView();
+        
+        //without a backend (e.g. decoding outputs made elsewhere) assume the stock model
+        if (input.empty()) {
+            inputRows = DEFAULT_INPUT_SIZE;
+            inputCols = DEFAULT_INPUT_SIZE;
+            return;
+        }
+        
+        //input is 1 * rows * cols * 3
+        inputRows = input.height();
+        inputCols = input.width();
+    }
+    
+    //run the model on the image and hand back views of the heatmaps and offsets (no copies)
+    bool Posenet::runSinglePose(const cv::Mat &img, TensorView &heatmaps, TensorView &offsets) {
+        return runModel(img) && singlePoseOutputs(heatmaps, offsets);
+    }
+    
+    bool Posenet::runSinglePose(const YuvFrame &frame, TensorView &heatmaps, TensorView &offsets) {
+        return runModel(frame) && singlePoseOutputs(heatmaps, offsets);
+    }
+    
+    bool Posenet::singlePoseOutputs(TensorView &heatmaps, TensorView &offsets) {
+        //***at this point the output data we need from the model is in the interpreter's output tensors
 
         /*The output consist of 2 parts:
          - heatmaps (9,9,17) - corresponds to the probability of appearance of 
@@ -557,114 +1158,868 @@ namespace ORB_SLAM2
             if the position lies inside the shape of resized image:
                 set the flag for visualisation to True*/
         
-        std::vector<std::vector<std::vector<std::vector<float>>>> heatmaps = outputMap[0];
-        std::vector<std::vector<std::vector<std::vector<float>>>> offsets = outputMap[1];
+        heatmaps = getOutputView(0);
+        offsets = getOutputView(1);
         
-        //get dimensions of levels 1 and 2 of heatmap (should be 9 and 9)
-        int height = heatmaps[0].size();
-        int width = heatmaps[0][0].size();
-        LOG("Heatmap dimensions are %d x %d", height, width);
+        return !heatmaps.empty() && !offsets.empty();
+    }
+    
+    void Posenet::recordSinglePose(uint64_t totalStartNanos, uint64_t decodeStartNanos) {
+        uint64_t endNanos = PosenetStats::nowNanos();
         
-        //get dim of level 3 of heatmap (should be 17, for 17 joints found by the model)
-        int numKeypoints = heatmaps[0][0][0].size();
-        LOG("numKeypoints is %d", numKeypoints);
+        stats->recordSpan(Stage::DECODE, decodeStartNanos, endNanos);
+        stats->recordSpan(Stage::TOTAL, totalStartNanos, endNanos);
+        stats->increment(Counter::FRAMES);
+        
+        if (adaptiveResolution) {
+            adaptResolution(endNanos - totalStartNanos);
+        }
+    }
+    
+    //main function/entry point for running a Posenet inference on an input image
+    Person Posenet::estimateSinglePose(const cv::Mat &img) {
+        Person person = Person();
+        
+        estimateSinglePose(img, person);
+        
+        return person;
+    }
+    
+    Person Posenet::estimateSinglePose(const cv::Mat &img, TfLiteInterpreter* pInterpreter) {
+        return estimateSinglePose(img);
+    }
+    
+    //decode into the caller's person; once its keyPoints vector has grown to 17 it is only overwritten, never reallocated
+    template <typename Frame>
+    bool Posenet::estimateSinglePoseInto(const Frame &img, Person &person) {
+        uint64_t totalStartNanos = PosenetStats::nowNanos();
+        
+        //in tracking mode only the region around the last pose goes through the model
+        cv::Rect region;
+        bool cropped = trackingCrop(img.rows, img.cols, region);
+        Frame input = cropped ? cropFrame(img, region) : img;
+        
+        TensorView heatmaps, offsets;
+        
+        if (!runSinglePose(input, heatmaps, offsets)) {
+            person.keyPoints.clear();
+            person.score = 0.0f;
+            trackingRegion = cv::Rect();
+            return false;
+        }
+        
+        uint64_t decodeStartNanos = PosenetStats::nowNanos();
+        
+        bool decoded = decodeSinglePose(heatmaps, offsets, input.rows, input.cols, person);
+        
+        if (tracking) {
+            trackPose(person.keyPoints.data(), (int)person.keyPoints.size(), person.score, region, img.rows, img.cols);
+        }
+        
+        recordSinglePose(totalStartNanos, decodeStartNanos);
+        
+        return decoded;
+    }
+    
+    bool Posenet::estimateSinglePose(const cv::Mat &img, Person &person) {
+        return estimateSinglePoseInto(img, person);
+    }
+    
+    bool Posenet::estimateSinglePose(const YuvFrame &frame, Person &person) {
+        return estimateSinglePoseInto(frame, person);
+    }
+    
+    //resize the input tensor to hold batchSize frames (the outputs follow), reallocating the interpreter's tensors only when the
+    //size actually changes
+    bool Posenet::setBatchSize(int batchSize) {
+        if (batchSize == inputBatchSize) {
+            return true;
+        }
+        
+        InferenceBackend* backend = getBackend();
+        
+        if (backend == NULL) {
+            return false;
+        }
+        
+        int inputRows, inputCols;
+        getInputSize(inputRows, inputCols);
         
-        //Finds the (row, col) locations of where the keypoints are most likely to be.
-        std::vector<std::pair<int, int>> keypointPositions(numKeypoints);
+        if (!backend->resizeInput(batchSize, inputRows, inputCols)) {
+            LOGE("setBatchSize(): resizing input tensor to batch %d failed", batchSize);
+            return false;
+        }
+        
+        inputBatchSize = batchSize;
+        
+        return true;
+    }
+    
+    //swap in an interpreter for the new resolution: the current one goes to the front of the cache, a cached one for width x height
+    //comes back out if we have it, otherwise a new one is built and resized
+    bool Posenet::setInputResolution(int width, int height) {
+        if (width <= 0 || height <= 0) {
+            LOGE("setInputResolution(): bad resolution %d x %d", width, height);
+            return false;
+        }
         
+        if (getBackend() == NULL) {
+            LOGE("setInputResolution(): no backend available");
+            return false;
+        }
+        
+        int inputRows, inputCols;
+        getInputSize(inputRows, inputCols);
+        
+        if (inputRows == height && inputCols == width) {
+            return true;
+        }
         
-        //iterate over the number of keypoints (17?)
-        for (int keypoint = 0; keypoint < numKeypoints; keypoint++) {
-            //take an initial max value
-            float maxVal = heatmaps[0][0][0][keypoint];
+        //a handed-in backend just reshapes in place (there are no interpreters of ours to cache)
+        if (externalBackend != NULL) {
+            if (!externalBackend->resizeInput(1, height, width)) {
+                LOGW("setInputResolution(): the %s backend can't do %d x %d", externalBackend->getName(), width, height);
+                return false;
+            }
             
-            //initialize these maxes to 0
-            int maxRow = 0;
-            int maxCol = 0;
+            inputBatchSize = 1;
             
-            //iterate over every vector in our 9x9 grid of float vectors
-            for (int row = 0; row < height; row++) {
-                for (int col = 0; col < width; col++) {
-                    //check the float at this joint slot at this place in our 9x9 grid, which is prob that the joint appears in this cell
-                    float testVal = heatmaps[0][row][col][keypoint];
-                    
-                    if (testVal > maxVal) {
-                        //if this float was higher than our running max, then we accept this location as our current "most likely to hold 
-                        //joint" location
-                        maxVal = testVal;
-                        maxRow = row;
-                        maxCol = col;
-                    }
-                }
+            return true;
+        }
+        
+        CachedInterpreter previous;
+        previous.rows = inputRows;
+        previous.cols = inputCols;
+        previous.batchSize = inputBatchSize;
+        previous.interpreter = interpreter;
+        previous.options = options;
+        previous.delegate = delegate;
+        
+        interpreter = NULL;
+        options = NULL;
+        delegate = NULL;
+        inputBatchSize = 1;
+        tfliteBackend.setInterpreter(NULL);
+        
+        auto cached = std::find_if(resolutionCache.begin(), resolutionCache.end(), [&](const CachedInterpreter &entry) {
+            return entry.rows == height && entry.cols == width;
+        });
+        
+        if (cached != resolutionCache.end()) {
+            interpreter = cached->interpreter;
+            options = cached->options;
+            delegate = cached->delegate;
+            inputBatchSize = cached->batchSize;
+            tfliteBackend.setInterpreter(interpreter);
+            
+            resolutionCache.erase(cached);
+        }
+        else {
+            bool resized = getInterpreter() != NULL && activeBackend()->resizeInput(1, height, width);
+            
+            if (!resized) {
+                LOGW("setInputResolution(): couldn't build an interpreter for %d x %d, staying at %d x %d", width, height, inputCols, inputRows);
+                
+                CachedInterpreter failed;
+                failed.interpreter = interpreter;
+                failed.options = options;
+                failed.delegate = delegate;
+                deleteInterpreter(failed);
+                
+                interpreter = previous.interpreter;
+                options = previous.options;
+                delegate = previous.delegate;
+                inputBatchSize = previous.batchSize;
+                tfliteBackend.setInterpreter(interpreter);
+                
+                return false;
             }
+        }
+        
+        resolutionCache.insert(resolutionCache.begin(), previous);
+        
+        //evict the least recently used resolutions
+        while (resolutionCache.size() > maxCachedResolutions) {
+            deleteInterpreter(resolutionCache.back());
+            resolutionCache.pop_back();
+        }
+        
+        LOGI("setInputResolution(): now %d x %d (%d other resolutions cached)", width, height, (int)resolutionCache.size());
+        
+        return true;
+    }
+    
+    //how many resolutions besides the current one keep an allocated interpreter
+    void Posenet::setMaxCachedResolutions(int maxResolutions) {
+        maxCachedResolutions = (size_t)std::max(maxResolutions, 0);
+        
+        while (resolutionCache.size() > maxCachedResolutions) {
+            deleteInterpreter(resolutionCache.back());
+            resolutionCache.pop_back();
+        }
+    }
+    
+    bool Posenet::enableAdaptiveResolution(const AdaptiveResolutionConfig &config) {
+        if (config.sizes.empty()) {
+            LOGE("enableAdaptiveResolution(): no sizes given");
+            return false;
+        }
+        
+        //keep every rung of the ladder allocated, so stepping never pays for interpreter creation mid-stream
+        maxCachedResolutions = std::max(maxCachedResolutions, config.sizes.size());
+        
+        for (int i = (int)config.sizes.size() - 1; i >= 0; i--) {
+            if (!setInputResolution(config.sizes[i], config.sizes[i])) {
+                return false;
+            }
+        }
+        
+        adaptiveConfig = config;
+        adaptiveResolution = true;
+        resolutionLevel = 0;
+        framesAtLevel = 0;
+        averageFrameNanos = 0.0;
+        
+        return true;
+    }
+    
+    void Posenet::disableAdaptiveResolution() {
+        adaptiveResolution = false;
+    }
+    
+    //weight of the newest frame in the latency average
+    static const double FRAME_LATENCY_ALPHA = 0.2;
+    
+    void Posenet::adaptResolution(uint64_t frameNanos) {
+        framesAtLevel++;
+        
+        averageFrameNanos = (framesAtLevel == 1) ? (double)frameNanos :
+        averageFrameNanos + FRAME_LATENCY_ALPHA * ((double)frameNanos - averageFrameNanos);
+        
+        if (framesAtLevel < adaptiveConfig.settleFrames) {
+            return;
+        }
+        
+        int level = resolutionLevel;
+        const std::vector<int> &sizes = adaptiveConfig.sizes;
+        
+        if (averageFrameNanos > adaptiveConfig.budgetNanos && level + 1 < (int)sizes.size()) {
+            level++;
+        }
+        else if (level > 0) {
+            //latency scales roughly with the number of input pixels
+            double pixelRatio = (double)sizes[level - 1] * sizes[level - 1] / ((double)sizes[level] * sizes[level]);
             
-            //add the location that was most likely to contain this joint point to our keypoint positions array
-            keypointPositions[keypoint] = std::pair<int, int>(maxRow, maxCol);
+            if (averageFrameNanos * pixelRatio < adaptiveConfig.budgetNanos * adaptiveConfig.stepUpMargin) {
+                level--;
+            }
         }
         
+        if (level == resolutionLevel) {
+            return;
+        }
         
-        //Calculating the x and y coordinates of the keypoints with offset adjustment.
-        std::vector<int> xCoords(numKeypoints);
+        LOGI("adaptResolution(): average frame %.2f ms vs budget %.2f ms, switching %d -> %d", averageFrameNanos / 1e6,
+        adaptiveConfig.budgetNanos / 1e6, sizes[resolutionLevel], sizes[level]);
         
-        std::vector<int> yCoords(numKeypoints);
+        if (setInputResolution(sizes[level], sizes[level])) {
+            resolutionLevel = level;
+        }
         
-        //Initialize float vector to store confidence scores of each keypoint
-        std::vector<float> confidenceScores(numKeypoints);
+        framesAtLevel = 0;
+    }
+    
+    void Posenet::enableTracking(const TrackingConfig &config) {
+        tracking = true;
+        trackingConfig = config;
+        trackingRegion = cv::Rect();
+    }
+    
+    void Posenet::disableTracking() {
+        tracking = false;
+        trackingRegion = cv::Rect();
+    }
+    
+    cv::Rect Posenet::getTrackingRegion() {
+        return trackingRegion;
+    }
+    
+    //the region to run this frame on, if tracking has one that still fits the frame (a new stream size drops it)
+    bool Posenet::trackingCrop(int imgRows, int imgCols, cv::Rect &region) {
+        if (!tracking || trackingRegion.area() <= 0) {
+            return false;
+        }
         
-        //iterate over all keypoints
-        for (int i = 0; i < numKeypoints; i++) {
-            //get position of the keypoint (which cell contains max probability for this specific joint)
-            std::pair<int, int> thisKP = keypointPositions[i];
+        if (trackingRegion.x + trackingRegion.width > imgCols || trackingRegion.y + trackingRegion.height > imgRows) {
+            trackingRegion = cv::Rect();
+            return false;
+        }
+        
+        region = trackingRegion;
+        
+        return true;
+    }
+    
+    cv::Mat Posenet::cropFrame(const cv::Mat &img, const cv::Rect &region) {
+        return img(region);
+    }
+    
+    YuvFrame Posenet::cropFrame(const YuvFrame &frame, const cv::Rect &region) {
+        YuvFrame crop = frame;
+        crop.rows = region.height;
+        crop.cols = region.width;
+        
+        //chroma is subsampled 2x2, and interleaved (two bytes per sample) unless it's I420
+        int chromaBytes = (frame.layout == YuvLayout::I420) ? 1 : 2;
+        
+        crop.planes[0] = frame.planes[0] + region.y * frame.strides[0] + region.x;
+        crop.planes[1] = frame.planes[1] + (region.y / 2) * frame.strides[1] + (region.x / 2) * chromaBytes;
+        
+        if (frame.layout == YuvLayout::I420) {
+            crop.planes[2] = frame.planes[2] + (region.y / 2) * frame.strides[2] + region.x / 2;
+        }
+        
+        return crop;
+    }
+    
+    void Posenet::trackPose(KeyPoint* keyPoints, int numKeyPoints, float score, const cv::Rect &region, int imgRows, int imgCols) {
+        //keypoints were decoded relative to the crop
+        if (region.area() > 0) {
+            for (int i = 0; i < numKeyPoints; i++) {
+                keyPoints[i].position.x += region.x;
+                keyPoints[i].position.y += region.y;
+            }
             
-            int positionY = thisKP.first; //which row
-            int positionX = thisKP.second; //which column
+            stats->increment(Counter::TRACKED_FRAMES);
+        }
+        
+        //box around the confident keypoints
+        float minX = (float)imgCols, minY = (float)imgRows, maxX = 0.0f, maxY = 0.0f;
+        int confident = 0;
+        
+        for (int i = 0; i < numKeyPoints; i++) {
+            if (keyPoints[i].score < trackingConfig.minKeyPointScore) {
+                continue;
+            }
             
-            //store the y coordinate of these keypoint in the image as calculated offset + the most likely position of this joint div by (8 * 257)
-            yCoords[i] = (int)(positionY / ((float)(height - 1.0f)) * img.rows + offsets[0][positionY][positionX][i]);
-
-            //NOTE: 8 comes from fact that row/col indices start at 0
+            minX = std::min(minX, keyPoints[i].position.x);
+            minY = std::min(minY, keyPoints[i].position.y);
+            maxX = std::max(maxX, keyPoints[i].position.x);
+            maxY = std::max(maxY, keyPoints[i].position.y);
+            confident++;
+        }
+        
+        if (score < trackingConfig.minPoseScore || confident < trackingConfig.minKeyPoints) {
+            if (region.area() > 0) {
+                LOGD("trackPose(): lost the pose (score %f, %d confident keypoints), back to the full frame", score, confident);
+                stats->increment(Counter::TRACKING_LOST);
+            }
             
-            //store the y coordinate of these keypoint in the image as calculated offset + the most likely position of this joint div by (8 * 257)
-            xCoords[i] = (int)(positionX / ((float)(width - 1.0f)) * img.cols + offsets[0][positionY][positionX][i + numKeypoints]);
-            //(need to index into the second 17 of offset vectors' third dim as noted above)
+            trackingRegion = cv::Rect();
+            return;
+        }
+        
+        //pad the box, then grow it to the model input's aspect ratio so the crop isn't distorted on the way in
+        int inputRows, inputCols;
+        getInputSize(inputRows, inputCols);
+        
+        float aspect = inputCols / (float)inputRows;
+        float pad = std::max(maxX - minX, maxY - minY) * trackingConfig.padding;
+        
+        float cropRows = std::max(maxY - minY + 2.0f * pad, (maxX - minX + 2.0f * pad) / aspect);
+        cropRows = std::max(cropRows, trackingConfig.minCropFraction * std::min(imgRows, imgCols));
+        float cropCols = cropRows * aspect;
+        
+        //a crop as big as the frame is no crop at all
+        if (cropCols >= imgCols && cropRows >= imgRows) {
+            trackingRegion = cv::Rect();
+            return;
+        }
+        
+        int width = std::min((int)cropCols, imgCols);
+        int height = std::min((int)cropRows, imgRows);
+        
+        //center on the box and slide back inside the frame; even offsets keep YUV crops aligned with their chroma
+        int x = (int)((minX + maxX - width) * 0.5f);
+        int y = (int)((minY + maxY - height) * 0.5f);
+        x = std::min(std::max(x, 0), imgCols - width) & ~1;
+        y = std::min(std::max(y, 0), imgRows - height) & ~1;
+        
+        trackingRegion = cv::Rect(x, y, width, height);
+    }
+    
+    //don't bother spinning up a decode thread for fewer frames than this (decoding one frame takes microseconds)
+    static const int MIN_FRAMES_PER_DECODE_THREAD = 8;
+    
+    //batched version of estimateSinglePose for offline processing: one invoke for all frames amortizes the per-invoke overhead and
+    //gives the kernels bigger matrices to work on
+    std::vector<Person> Posenet::estimateSinglePoseBatch(const std::vector<cv::Mat> &imgs) {
+        std::vector<Person> persons(imgs.size());
+        
+        int batchSize = (int)imgs.size();
+        
+        if (batchSize == 0) {
+            return persons;
+        }
+        
+        if (getBackend() == NULL) {
+            LOGE("estimateSinglePoseBatch: no backend available");
+            return persons;
+        }
+        
+        //models with a fixed batch dimension can't be resized, so fall back to one frame at a time
+        if (!setBatchSize(batchSize)) {
+            setBatchSize(1);
+            
+            for (int i = 0; i < batchSize; i++) {
+                persons[i] = estimateSinglePose(imgs[i]);
+            }
             
-            //compute arbitrary confidence value between 0 and 1 for this keypoint
-            confidenceScores[i] = sigmoid(heatmaps[0][positionY][positionX][i]);
+            return persons;
+        }
+        
+        uint64_t totalStartNanos = PosenetStats::nowNanos();
+        
+        for (int i = 0; i < batchSize; i++) {
+            if (!fillInputTensor(imgs[i], i)) {
+                stats->increment(Counter::FAILURES);
+                return persons;
+            }
+        }
+        
+        stats->recordSpan(Stage::PREPROCESS, totalStartNanos, PosenetStats::nowNanos());
+        
+        if (!invoke()) {
+            return persons;
+        }
+        
+        TensorView heatmaps = getOutputView(0);
+        TensorView offsets = getOutputView(1);
+        
+        if (heatmaps.empty() || offsets.empty()) {
+            return persons;
+        }
+        
+        uint64_t decodeStartNanos = PosenetStats::nowNanos();
+        
+        //each batch slice decodes independently, so split the frames across threads
+        int numThreads = std::min(NUM_LITE_THREADS, batchSize / MIN_FRAMES_PER_DECODE_THREAD);
+        
+        if (numThreads <= 1) {
+            for (int i = 0; i < batchSize; i++) {
+                decodeSinglePose(heatmaps, offsets, imgs[i].rows, imgs[i].cols, persons[i], i);
+            }
+        }
+        else {
+            std::vector<std::thread> workers;
+            
+            for (int t = 0; t < numThreads; t++) {
+                workers.push_back(std::thread([&, t] {
+                    for (int i = t; i < batchSize; i += numThreads) {
+                        decodeSinglePose(heatmaps, offsets, imgs[i].rows, imgs[i].cols, persons[i], i);
+                    }
+                }));
+            }
+            
+            for (auto &worker : workers) {
+                worker.join();
+            }
         }
         
+        uint64_t endNanos = PosenetStats::nowNanos();
+        
+        stats->recordSpan(Stage::DECODE, decodeStartNanos, endNanos);
+        stats->recordSpan(Stage::TOTAL, totalStartNanos, endNanos);
+        stats->increment(Counter::FRAMES, batchSize);
+        
+        return persons;
+    }
+    
+    //find the most likely cell for each keypoint, refine it with the offset vectors, and build the Person
+    Person Posenet::decodeSinglePose(const TensorView &heatmaps, const TensorView &offsets, int imgRows, int imgCols, int batch) {
         //instantiate new person to return
         Person person = Person();
         
-        //initialize array of KeyPoints of size 17
-        std::vector<KeyPoint> keypointList(numKeypoints, KeyPoint());
+        decodeSinglePose(heatmaps, offsets, imgRows, imgCols, person, batch);
+        
+        return person;
+    }
+    
+    //same, reusing the person's keypoint storage (resize() only allocates the first time)
+    bool Posenet::decodeSinglePose(const TensorView &heatmaps, const TensorView &offsets, int imgRows, int imgCols, Person &person,
+    int batch) {
+        int numKeypoints = heatmaps.channels();
+        
+        person.keyPoints.resize(numKeypoints);
+        
+        int numDecoded = decodeKeyPoints(heatmaps, offsets, imgRows, imgCols, person.keyPoints.data(), numKeypoints, person.score, batch);
+        
+        if (numDecoded < 0) {
+            person.keyPoints.clear();
+            return false;
+        }
+        
+        return true;
+    }
+    
+    //the decoder proper, writing into caller storage of maxKeyPoints entries so that nothing here touches the heap
+    int Posenet::decodeKeyPoints(const TensorView &heatmaps, const TensorView &offsets, int imgRows, int imgCols, KeyPoint* keyPoints,
+    int maxKeyPoints, float &score, int batch) {
+        //get dimensions of levels 1 and 2 of heatmap (should be 9 and 9)
+        int height = heatmaps.height();
+        int width = heatmaps.width();
+        
+        //get dim of level 3 of heatmap (should be 17, for 17 joints found by the model)
+        int numKeypoints = heatmaps.channels();
+        LOGT("Heatmap dimensions are %d x %d, numKeypoints is %d", height, width, numKeypoints);
+        
+        score = 0.0f;
+        
+        if (numKeypoints > MAX_KEYPOINTS || numKeypoints > maxKeyPoints) {
+            LOGE("decodeSinglePose(): %d keypoints is more than the decoder (%d) or the person (%d) can hold", numKeypoints,
+            MAX_KEYPOINTS, maxKeyPoints);
+            return -1;
+        }
+        
+        //Finds the cell where each keypoint is most likely to be, in one contiguous pass over the heatmap (all keypoints at once)
+        float maxValues[MAX_KEYPOINTS];
+        int32_t maxCells[MAX_KEYPOINTS];
+        
+        if (!heatmaps.quantized()) {
+            argmaxChannels(heatmaps.cell(batch, 0, 0), height * width, numKeypoints, maxValues, maxCells);
+        }
+        else {
+            //argmax on the raw 8-bit values, then dequantize only the winners
+            int32_t maxQuantized[MAX_KEYPOINTS];
+            
+            if (heatmaps.type == TensorType::INT8) {
+                argmaxChannels((const int8_t*)heatmaps.quantizedCell(batch, 0, 0), height * width, numKeypoints, maxQuantized, maxCells);
+            }
+            else {
+                argmaxChannels(heatmaps.quantizedCell(batch, 0, 0), height * width, numKeypoints, maxQuantized, maxCells);
+            }
+            
+            for (int i = 0; i < numKeypoints; i++) {
+                maxValues[i] = (maxQuantized[i] - heatmaps.zeroPoint) * heatmaps.scale;
+            }
+        }
+        
+        //the maxima are the raw heatmap values at the winning cells, so turning them into confidence values between 0 and 1 is
+        //one vectorized sigmoid pass
+        sigmoidInPlace(maxValues, numKeypoints);
+        
+        //the offsets are in model input pixels, so work out the position in model input space first and then scale to the image
+        int inputRows, inputCols;
+        getInputSize(inputRows, inputCols);
+        
+        float outputStrideY = (inputRows - 1) / (float)(height - 1);
+        float outputStrideX = (inputCols - 1) / (float)(width - 1);
+        
+        float scaleY = imgRows / (float)inputRows;
+        float scaleX = imgCols / (float)inputCols;
         
         float totalScore = 0.0;
         
-        //copy data into the keypoint list
+        //iterate over all keypoints
         for (int i = 0; i < numKeypoints; i++) {
-            keypointList[i].bodyPart = static_cast<BodyPart>(i);
+            //get position of the keypoint (which cell contains max probability for this specific joint)
+            int positionY = maxCells[i] / width; //which row
+            int positionX = maxCells[i] % width; //which column
             
-            keypointList[i].position.x = (float)xCoords[i];
+            keyPoints[i].bodyPart = static_cast<BodyPart>(i);
             
-            keypointList[i].position.y = (float)yCoords[i];
+            //the y coordinate of this keypoint is the most likely cell times the output stride (32 for 257 -> 9x9) plus the
+            //calculated offset, scaled from model input space to the image (and truncated to whole pixels)
+            keyPoints[i].position.y = (float)(int)((positionY * outputStrideY + offsets.at(batch, positionY, positionX, i)) * scaleY);
             
-            LOG("estimateSinglePose(): adding this keypoint at %f, %f, score %f", keypointList[i].position.x, keypointList[i].position.y,
-            confidenceScores[i]);
+            //same for the x coordinate
+            keyPoints[i].position.x = (float)(int)((positionX * outputStrideX + offsets.at(batch, positionY, positionX, i + numKeypoints)) *
+            scaleX);
+            //(need to index into the second 17 of offset vectors' third dim as noted above)
             
-            keypointList[i].score = confidenceScores[i];
+            keyPoints[i].score = maxValues[i];
             
-            totalScore += confidenceScores[i];
+            LOGT("estimateSinglePose(): adding this keypoint at %f, %f, score %f", keyPoints[i].position.x, keyPoints[i].position.y,
+            keyPoints[i].score);
+            
+            totalScore += maxValues[i];
         }
         
-        //store the list of keypoints for the person object
-        person.keyPoints = keypointList;
-        
         //calculate overall score of person as the total for all joints divided by number of joints (avg score)
-        person.score = totalScore / numKeypoints;
+        score = totalScore / numKeypoints;
         
-        return person;
+        return numKeypoints;
+    }
+    
+    
+    //radius (in heatmap cells) a part score has to be the maximum over to become a candidate root
+    static const int LOCAL_MAXIMUM_RADIUS = 1;
+    
+    //how many times to re-snap a displaced keypoint to the heatmap grid and refine it with the offsets
+    static const int OFFSET_REFINE_STEPS = 2;
+    
+    //order candidates so that std::push_heap/pop_heap give us a max-heap on score
+    static bool candidateLess(const PartCandidate &a, const PartCandidate &b) {
+        return a.score < b.score;
+    }
+    
+    //nearest heatmap cell to a point in model input space
+    static inline int nearestCell(float coord, float outputStride, int size) {
+        int cell = (int)std::round(coord / outputStride);
+        
+        if (cell < 0) {
+            return 0;
+        }
+        
+        return cell < size ? cell : size - 1;
+    }
+    
+    //follow one skeleton edge from a decoded source keypoint to its target keypoint using the given displacement field
+    static void traverseToTargetKeypoint(int edge, const Position &source, int targetKeypoint, const TensorView &heatmaps,
+    const TensorView &offsets, const TensorView &displacements, float outputStrideY, float outputStrideX, int batch,
+    Position &target, float &targetScore) {
+        int height = heatmaps.height();
+        int width = heatmaps.width();
+        int numKeypoints = heatmaps.channels();
+        
+        //displace the source point along the edge
+        int sourceRow = nearestCell(source.y, outputStrideY, height);
+        int sourceCol = nearestCell(source.x, outputStrideX, width);
+        
+        target.y = source.y + displacements.at(batch, sourceRow, sourceCol, edge);
+        target.x = source.x + displacements.at(batch, sourceRow, sourceCol, edge + NUM_POSE_EDGES);
+        
+        //snap to the grid and refine with the target keypoint's own offsets
+        for (int i = 0; i < OFFSET_REFINE_STEPS; i++) {
+            int row = nearestCell(target.y, outputStrideY, height);
+            int col = nearestCell(target.x, outputStrideX, width);
+            
+            target.y = row * outputStrideY + offsets.at(batch, row, col, targetKeypoint);
+            target.x = col * outputStrideX + offsets.at(batch, row, col, targetKeypoint + numKeypoints);
+        }
+        
+        int row = nearestCell(target.y, outputStrideY, height);
+        int col = nearestCell(target.x, outputStrideX, width);
+        
+        targetScore = 1.0f / (1.0f + std::exp(-heatmaps.at(batch, row, col, targetKeypoint)));
+    }
+    
+    //decode a full skeleton starting from one root part, writing into decodedPositions/decodedScores
+    void Posenet::decodePoseFromRoot(const PartCandidate &root, const TensorView &heatmaps, const TensorView &offsets,
+    const TensorView &displacementsFwd, const TensorView &displacementsBwd, float outputStrideY, float outputStrideX, int batch) {
+        int numKeypoints = heatmaps.channels();
+        
+        std::fill(decodedValid.begin(), decodedValid.end(), false);
+        
+        //the root keypoint position is its cell center plus its offset vector
+        decodedPositions[root.keypoint].y = root.row * outputStrideY + offsets.at(batch, root.row, root.col, root.keypoint);
+        decodedPositions[root.keypoint].x = root.col * outputStrideX + offsets.at(batch, root.row, root.col, root.keypoint + numKeypoints);
+        decodedScores[root.keypoint] = 1.0f / (1.0f + std::exp(-root.score));
+        decodedValid[root.keypoint] = true;
+        
+        //walk up the tree (child -> parent) following the backward displacements
+        for (int edge = NUM_POSE_EDGES - 1; edge >= 0; edge--) {
+            int source = (int)POSE_CHAIN[edge][1];
+            int target = (int)POSE_CHAIN[edge][0];
+            
+            if (decodedValid[source] && !decodedValid[target]) {
+                traverseToTargetKeypoint(edge, decodedPositions[source], target, heatmaps, offsets, displacementsBwd,
+                outputStrideY, outputStrideX, batch, decodedPositions[target], decodedScores[target]);
+                decodedValid[target] = true;
+            }
+        }
+        
+        //then walk down the tree (parent -> child) following the forward displacements
+        for (int edge = 0; edge < NUM_POSE_EDGES; edge++) {
+            int source = (int)POSE_CHAIN[edge][0];
+            int target = (int)POSE_CHAIN[edge][1];
+            
+            if (decodedValid[source] && !decodedValid[target]) {
+                traverseToTargetKeypoint(edge, decodedPositions[source], target, heatmaps, offsets, displacementsFwd,
+                outputStrideY, outputStrideX, batch, decodedPositions[target], decodedScores[target]);
+                decodedValid[target] = true;
+            }
+        }
+    }
+    
+    //run the model once and decode every person in the image
+    std::vector<Person> Posenet::estimateMultiplePoses(const cv::Mat &img, int maxPoses, float scoreThreshold, float nmsRadius) {
+        uint64_t totalStartNanos = PosenetStats::nowNanos();
+        
+        if (!runModel(img)) {
+            return std::vector<Person>();
+        }
+        
+        TensorView heatmaps = getOutputView(0);
+        TensorView offsets = getOutputView(1);
+        TensorView displacementsFwd = getOutputView(2);
+        TensorView displacementsBwd = getOutputView(3);
+        
+        if (heatmaps.empty() || offsets.empty() || displacementsFwd.empty() || displacementsBwd.empty()) {
+            return std::vector<Person>();
+        }
+        
+        uint64_t decodeStartNanos = PosenetStats::nowNanos();
+        
+        std::vector<Person> poses = decodeMultiplePoses(heatmaps, offsets, displacementsFwd, displacementsBwd, img.rows, img.cols,
+        maxPoses, scoreThreshold, nmsRadius);
+        
+        uint64_t endNanos = PosenetStats::nowNanos();
+        
+        stats->recordSpan(Stage::DECODE, decodeStartNanos, endNanos);
+        stats->recordSpan(Stage::TOTAL, totalStartNanos, endNanos);
+        stats->increment(Counter::FRAMES);
+        
+        if (adaptiveResolution) {
+            adaptResolution(endNanos - totalStartNanos);
+        }
+        
+        return poses;
+    }
+    
+    //multi-person decoding: collect local-maximum parts as candidate roots, pop them strongest first, skip roots that land on an
+    //already-decoded person, grow a skeleton from each remaining root along the displacement fields, and score each person
+    //only by the keypoints that don't overlap earlier people
+    std::vector<Person> Posenet::decodeMultiplePoses(const TensorView &heatmaps, const TensorView &offsets, const TensorView &displacementsFwd,
+    const TensorView &displacementsBwd, int imgRows, int imgCols, int maxPoses, float scoreThreshold, float nmsRadius, int batch) {
+        std::vector<Person> poses;
+        
+        int height = heatmaps.height();
+        int width = heatmaps.width();
+        int numKeypoints = heatmaps.channels();
+        
+        //the skeleton walk follows POSE_CHAIN, so only the 17-keypoint PoseNet layout can be decoded
+        if (numKeypoints != NUM_KEYPOINTS || offsets.channels() != 2 * numKeypoints ||
+            displacementsFwd.channels() != 2 * NUM_POSE_EDGES || displacementsBwd.channels() != 2 * NUM_POSE_EDGES) {
+            LOGE("decodeMultiplePoses(): unexpected output channels (heatmaps %d, offsets %d, displacements %d/%d)", numKeypoints,
+            offsets.channels(), displacementsFwd.channels(), displacementsBwd.channels());
+            return poses;
+        }
+        
+        int inputRows, inputCols;
+        getInputSize(inputRows, inputCols);
+        
+        //distance in model input pixels between neighbouring heatmap cells (32 for 257 -> 9x9, 8 for 257 -> 33x33)
+        float outputStrideY = (inputRows - 1) / (float)(height - 1);
+        float outputStrideX = (inputCols - 1) / (float)(width - 1);
+        
+        //factors to go from model input space to image space
+        float scaleY = imgRows / (float)inputRows;
+        float scaleX = imgCols / (float)inputCols;
+        
+        //compare raw heatmap values against the threshold mapped through the inverse sigmoid, so we only compute sigmoids for
+        //parts we actually use
+        float logitThreshold = std::log(scoreThreshold / (1.0f - scoreThreshold));
+        
+        float squaredNmsRadius = nmsRadius * nmsRadius;
+        
+        //build the max-heap of candidate roots
+        candidateQueue.clear();
+        
+        for (int row = 0; row < height; row++) {
+            for (int col = 0; col < width; col++) {
+                for (int keypoint = 0; keypoint < numKeypoints; keypoint++) {
+                    float score = heatmaps.at(batch, row, col, keypoint);
+                    
+                    if (score < logitThreshold) {
+                        continue;
+                    }
+                    
+                    //only keep the part if nothing in its neighbourhood has a higher score for the same keypoint
+                    bool localMaximum = true;
+                    
+                    int rowStart = std::max(row - LOCAL_MAXIMUM_RADIUS, 0);
+                    int rowEnd = std::min(row + LOCAL_MAXIMUM_RADIUS + 1, height);
+                    int colStart = std::max(col - LOCAL_MAXIMUM_RADIUS, 0);
+                    int colEnd = std::min(col + LOCAL_MAXIMUM_RADIUS + 1, width);
+                    
+                    for (int r = rowStart; r < rowEnd && localMaximum; r++) {
+                        for (int c = colStart; c < colEnd; c++) {
+                            if (heatmaps.at(batch, r, c, keypoint) > score) {
+                                localMaximum = false;
+                                break;
+                            }
+                        }
+                    }
+                    
+                    if (localMaximum) {
+                        candidateQueue.push_back(PartCandidate{score, row, col, keypoint});
+                    }
+                }
+            }
+        }
+        
+        std::make_heap(candidateQueue.begin(), candidateQueue.end(), candidateLess);
+        
+        decodedPositions.resize(numKeypoints);
+        decodedScores.resize(numKeypoints);
+        decodedValid.resize(numKeypoints);
+        
+        //keypoint positions of the people decoded so far, in model input space, for NMS
+        acceptedPositions.clear();
+        
+        while ((int)poses.size() < maxPoses && !candidateQueue.empty()) {
+            std::pop_heap(candidateQueue.begin(), candidateQueue.end(), candidateLess);
+            PartCandidate root = candidateQueue.back();
+            candidateQueue.pop_back();
+            
+            //position of the root part in model input space
+            float rootY = root.row * outputStrideY + offsets.at(batch, root.row, root.col, root.keypoint);
+            float rootX = root.col * outputStrideX + offsets.at(batch, root.row, root.col, root.keypoint + numKeypoints);
+            
+            //skip this root if it's within the NMS radius of the same keypoint of a person we already have
+            bool suppressed = false;
+            
+            for (size_t p = 0; p < poses.size() && !suppressed; p++) {
+                const Position &existing = acceptedPositions[p * numKeypoints + root.keypoint];
+                float dy = existing.y - rootY;
+                float dx = existing.x - rootX;
+                
+                suppressed = dy * dy + dx * dx <= squaredNmsRadius;
+            }
+            
+            if (suppressed) {
+                continue;
+            }
+            
+            decodePoseFromRoot(root, heatmaps, offsets, displacementsFwd, displacementsBwd, outputStrideY, outputStrideX, batch);
+            
+            //the instance score only counts keypoints that aren't within the NMS radius of an existing person's same keypoint
+            float totalScore = 0.0;
+            
+            for (int i = 0; i < numKeypoints; i++) {
+                bool overlaps = false;
+                
+                for (size_t p = 0; p < poses.size() && !overlaps; p++) {
+                    const Position &existing = acceptedPositions[p * numKeypoints + i];
+                    float dy = existing.y - decodedPositions[i].y;
+                    float dx = existing.x - decodedPositions[i].x;
+                    
+                    overlaps = dy * dy + dx * dx <= squaredNmsRadius;
+                }
+                
+                if (!overlaps) {
+                    totalScore += decodedScores[i];
+                }
+            }
+            
+            Person person = Person();
+            person.keyPoints.resize(numKeypoints);
+            
+            for (int i = 0; i < numKeypoints; i++) {
+                acceptedPositions.push_back(decodedPositions[i]);
+                
+                person.keyPoints[i].bodyPart = static_cast<BodyPart>(i);
+                person.keyPoints[i].position.x = decodedPositions[i].x * scaleX;
+                person.keyPoints[i].position.y = decodedPositions[i].y * scaleY;
+                person.keyPoints[i].score = decodedScores[i];
+            }
+            
+            person.score = totalScore / numKeypoints;
+            
+            poses.push_back(person);
+        }
+        
+        return poses;
     }
 }
-
-
-
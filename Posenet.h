@@ -3,11 +3,21 @@
 
 #include <opencv2/core/core.hpp>
 #include <vector>
+#include <string>
+#include <array>
+#include <algorithm>
 #include <unordered_map>
+#include <memory>
 #include <time.h>
 
 #include "c_api.h"
 #include "delegate.h"
+#include "xnnpack_delegate.h"
+#include "PosenetKernels.h"
+#include "InferenceBackend.h"
+#include "TfLiteBackend.h"
+#include "PosenetStats.h"
+#include "ModelRegistry.h"
 
 
 namespace ORB_SLAM2 {
@@ -32,6 +42,30 @@ namespace ORB_SLAM2 {
        RIGHT_ANKLE
     };
 
+    //number of edges in the PoseNet skeleton
+    const int NUM_POSE_EDGES = 16;
+
+    //the parent -> child edges of the PoseNet skeleton, in the order the displacement outputs use (so the displacement tensors
+    //have 32 channels: first 16 are y, second 16 are x)
+    const BodyPart POSE_CHAIN[NUM_POSE_EDGES][2] = {
+        {BodyPart::NOSE, BodyPart::LEFT_EYE},
+        {BodyPart::LEFT_EYE, BodyPart::LEFT_EAR},
+        {BodyPart::NOSE, BodyPart::RIGHT_EYE},
+        {BodyPart::RIGHT_EYE, BodyPart::RIGHT_EAR},
+        {BodyPart::NOSE, BodyPart::LEFT_SHOULDER},
+        {BodyPart::LEFT_SHOULDER, BodyPart::LEFT_ELBOW},
+        {BodyPart::LEFT_ELBOW, BodyPart::LEFT_WRIST},
+        {BodyPart::LEFT_SHOULDER, BodyPart::LEFT_HIP},
+        {BodyPart::LEFT_HIP, BodyPart::LEFT_KNEE},
+        {BodyPart::LEFT_KNEE, BodyPart::LEFT_ANKLE},
+        {BodyPart::NOSE, BodyPart::RIGHT_SHOULDER},
+        {BodyPart::RIGHT_SHOULDER, BodyPart::RIGHT_ELBOW},
+        {BodyPart::RIGHT_ELBOW, BodyPart::RIGHT_WRIST},
+        {BodyPart::RIGHT_SHOULDER, BodyPart::RIGHT_HIP},
+        {BodyPart::RIGHT_HIP, BodyPart::RIGHT_KNEE},
+        {BodyPart::RIGHT_KNEE, BodyPart::RIGHT_ANKLE}
+    };
+
     class Position {
         public:
             float x;
@@ -45,7 +79,7 @@ namespace ORB_SLAM2 {
           float score;
 
           //convenient but unnecessary functions for retrieving the score of a given KeyPoint instance
-          float getScore();
+          float getScore() const;
     };
 
     class Person {
@@ -54,47 +88,444 @@ namespace ORB_SLAM2 {
           float score;
 
           //convenient but unnecessary functions for retrieving the KeyPoints and score for a Person object
-          std::vector<KeyPoint> getKeyPoints();
-          float getScore();
+          const std::vector<KeyPoint>& getKeyPoints() const;
+          float getScore() const;
+    };
+
+    //number of keypoints the stock PoseNet model finds
+    const int NUM_KEYPOINTS = 17;
+
+    //Person with the keypoints stored inline instead of on the heap, so decoding into one that is reused every frame never
+    //allocates. N is the most keypoints it can hold (17 for PoseNet, more for other skeleton models)
+    template <int N = NUM_KEYPOINTS>
+    class FixedPerson {
+        public:
+          std::array<KeyPoint, N> keyPoints;
+
+          //how many entries of keyPoints the decoder actually filled
+          int numKeyPoints = 0;
+          float score = 0.0f;
+
+          const std::array<KeyPoint, N>& getKeyPoints() const { return keyPoints; }
+          int getNumKeyPoints() const { return numKeyPoints; }
+          float getScore() const { return score; }
+
+          //copy into a heap-backed Person (allocates, so keep it off the per-frame path)
+          Person toPerson() const {
+              Person person;
+              person.keyPoints.assign(keyPoints.begin(), keyPoints.begin() + numKeyPoints);
+              person.score = score;
+              return person;
+          }
     };
 
     enum class Device {
         CPU,
         NNAPI,
-        GPU
+        GPU,
+
+        //XNNPACK CPU kernels in fp32, fp16 (falls back to fp32 if the CPU has no fp16 arithmetic) and with the int8/uint8
+        //quantized operators enabled (for quantized models)
+        XNNPACK,
+        XNNPACK_FP16,
+        XNNPACK_INT8
+    };
+
+    //what autotune() optimizes for: latency of one frame on one interpreter, or frames per second per core (for servers that run
+    //as many interpreters side by side as the cores allow)
+    enum class TuneObjective {
+        LATENCY,
+        THROUGHPUT
+    };
+
+    //mean invoke latency measured by autotune() for one thread count
+    struct ThreadTiming {
+        int threads = 0;
+        uint64_t meanInvokeNanos = 0;
+
+        //frames per second per core at this setting: 1e9 / (meanInvokeNanos * threads)
+        double framesPerCoreSecond = 0.0;
+    };
+
+    //adaptive resolution: step the input size down a ladder of sizes when a frame's measured latency (an average over recent
+    //frames) goes over budget, and back up when the next size up is predicted to fit again
+    struct AdaptiveResolutionConfig {
+        //square input sizes to move between, largest (most accurate) first
+        std::vector<int> sizes = {353, 257, 225, 161};
+
+        //per-frame latency budget (preprocess + invoke + decode); 33 ms keeps up with 30 fps
+        uint64_t budgetNanos = 33000000;
+
+        //only step up when the larger size's predicted latency (current average scaled by the pixel ratio) is below this fraction of
+        //the budget, so we don't bounce between two sizes
+        float stepUpMargin = 0.8f;
+
+        //frames to run at a new size before judging it (lets the average settle after a switch)
+        int settleFrames = 15;
+    };
+
+    //tracking mode: crop each frame to a padded box around the previous frame's pose instead of squashing the whole frame into
+    //the model input
+    struct TrackingConfig {
+        //keypoints at least this confident define the box, and at least minKeyPoints of them are needed to trust it
+        float minKeyPointScore = 0.3f;
+        int minKeyPoints = 5;
+
+        //pose score below which the subject counts as lost and the next frame runs on the full frame again
+        float minPoseScore = 0.25f;
+
+        //margin added on every side, as a fraction of the box's longer side (people move between frames, and the model wants some
+        //context around the body)
+        float padding = 0.3f;
+
+        //never crop smaller than this fraction of the frame's shorter side, so a partly-detected pose can't shrink the box onto a
+        //few joints
+        float minCropFraction = 0.2f;
+    };
+
+    struct TuneResult {
+        bool ok = false;
+        int bestThreads = 0;
+        std::vector<ThreadTiming> timings;
+    };
+
+    //a (row, col) heatmap cell that is a local maximum for one keypoint, used as a candidate root for multi-pose decoding
+    struct PartCandidate {
+        float score;
+        int row;
+        int col;
+        int keypoint;
+    };
+
+    //what Posenet::prepare() does before the first real frame
+    struct WarmupOptions {
+        //invokes on synthetic input after the interpreter is built; the first is the cold one, the rest show steady state
+        int warmupRuns = 3;
+
+        //file the delegate persists its packed weights to, so a restarted process can skip repacking (NULL = no cache). Only
+        //applies if prepare() builds the interpreter; pass it to the constructor otherwise
+        const char* weightCachePath = NULL;
+
+        //clear the stage histograms afterwards so warmup doesn't show up in the production latency numbers
+        bool resetStats = true;
+    };
+
+    //what prepare() measured
+    struct WarmupReport {
+        bool ok = false;
+
+        //true if prepare() had to build the interpreter (false if it already existed)
+        bool createdInterpreter = false;
+
+        //true if the interpreter's delegate was built with a weight cache file that already existed, i.e. it could reuse
+        //weights packed by an earlier run
+        bool weightCacheFound = false;
+
+        //TfLiteInterpreterCreate + AllocateTensors
+        uint64_t createNanos = 0;
+
+        //first invoke (kernel preparation, lazy packing) vs the mean and worst of the ones after it
+        uint64_t coldInvokeNanos = 0;
+        uint64_t warmInvokeNanos = 0;
+        uint64_t warmMaxNanos = 0;
+        int warmupRuns = 0;
     };
 
     class Posenet {
-        const char* filename;
-        Device device;
-        long lastInferenceTimeNanos = -1;
+        const char* filename = NULL;
+        Device device = Device::CPU;
+        int64_t lastInferenceTimeNanos = -1;
+
+        //stage timings and counters (held by pointer so Posenet stays copyable)
+        std::shared_ptr<PosenetStats> stats;
 
         //the model
-        TfLiteModel* model;
+        TfLiteModel* model = NULL;
+
+        //false when the model is borrowed from someone else (e.g. a PosenetPool) and must not be deleted in close()
+        bool ownsModel = true;
+
+        //our reference to a model shared through the ModelRegistry (model points into it); released in close()
+        std::shared_ptr<TfLiteModel> sharedModel;
 
         //the options for the interpreter (like settings)
-        TfLiteInterpreterOptions* options;
+        TfLiteInterpreterOptions* options = NULL;
 
         //interpreter for tflite model
         TfLiteInterpreter* interpreter = NULL;
 
+        //delegate the interpreter runs on (XNNPACK devices only); must outlive the interpreter
+        TfLiteDelegate* delegate = NULL;
+
+        //what inference goes through: the TFLite backend pointed at the current interpreter, unless a backend was handed in
+        //(then there's no model or interpreter at all)
+        TfLiteBackend tfliteBackend;
+        std::shared_ptr<InferenceBackend> externalBackend;
+
+        //interpreters already allocated for other input resolutions, most recently used first, so switching back to a resolution
+        //we've used is just a pointer swap
+        struct CachedInterpreter {
+            int rows = 0;
+            int cols = 0;
+            int batchSize = 1;
+            TfLiteInterpreter* interpreter = NULL;
+            TfLiteInterpreterOptions* options = NULL;
+            TfLiteDelegate* delegate = NULL;
+        };
+
+        std::vector<CachedInterpreter> resolutionCache;
+        size_t maxCachedResolutions = 4;
+
+        //adaptive resolution state: which rung of the ladder we're on, frames since the last switch, and the running latency average
+        bool adaptiveResolution = false;
+        AdaptiveResolutionConfig adaptiveConfig;
+        int resolutionLevel = 0;
+        int framesAtLevel = 0;
+        double averageFrameNanos = 0.0;
+
+        //tracking mode state: the region of the frame the next single-pose estimate runs on (empty = whole frame)
+        bool tracking = false;
+        TrackingConfig trackingConfig;
+        cv::Rect trackingRegion;
+
         //number of threads to run on
         int NUM_LITE_THREADS = 4;
 
+        //where a delegate that supports it keeps its packed weights between runs (empty = no cache), and whether the file
+        //was already there when the current delegate was built
+        std::string weightCachePath;
+        bool weightCacheLoaded = false;
+
+        //channel order of the Mats handed to estimateSinglePose (the model wants RGB)
+        PixelFormat inputFormat = PixelFormat::RGB;
+
+        //cached resize tables for the last input size we saw
+        PreprocessPlan inputPlan;
+
+        //pixel value -> quantized input encoding for uint8/int8 models, rebuilt when the input tensor's quantization changes
+        uint8_t inputTable[256];
+        bool inputTableBuilt = false;
+        bool inputTableRaw = false;
+        TensorType inputTableType = TensorType::FLOAT32;
+        float inputTableScale = 0.0f;
+        int32_t inputTableZeroPoint = 0;
+
+        //how many frames the input tensor currently holds (the first dimension of input tensor 0)
+        int inputBatchSize = 1;
+
+        //scratch space for multi-pose decoding, kept around so repeated calls don't reallocate
+        std::vector<PartCandidate> candidateQueue;
+        std::vector<Position> decodedPositions;
+        std::vector<float> decodedScores;
+        std::vector<bool> decodedValid;
+        std::vector<Position> acceptedPositions;
+
+        //copy the image (cv::Mat or YuvFrame) into the input tensor and invoke the interpreter
+        template <typename Frame>
+        bool runModel(const Frame &img);
+
+        //check the Mat and update inputPlan for it, returning the pixel format the kernels should read it as
+        bool planInput(const cv::Mat &img, PixelFormat &format);
+        bool planInput(const YuvFrame &frame);
+
+        const uint8_t* inputQuantizeTable(const TensorView &input);
+        uint8_t* inputSlot(int batchIndex);
+
+        TfLiteDelegate* createXnnpackDelegate();
+
+        //the backend if there already is one (a handed-in backend, or the interpreter has been built), without building anything
+        InferenceBackend* activeBackend();
+
+        //delete the interpreter, its options and delegate (and any cached for other resolutions) but keep the model, so
+        //getInterpreter() can rebuild with new settings
+        void releaseInterpreter();
+        static void deleteInterpreter(CachedInterpreter &cached);
+
+        //releaseInterpreter() and build a new interpreter with the given thread count, reshaped to batch x rows x cols (rows = 0
+        //keeps the model's own input shape)
+        bool rebuildInterpreter(int threads, int batchSize, int rows, int cols);
+
+        //feed one frame's end-to-end latency to the adaptive resolution controller
+        void adaptResolution(uint64_t frameNanos);
+
+        //single-pose plumbing shared by the Person and FixedPerson overloads: run the model and hand back views of the outputs,
+        //decode into caller storage (returns the number of keypoints written, -1 if they don't fit), and record the timings
+        bool runSinglePose(const cv::Mat &img, TensorView &heatmaps, TensorView &offsets);
+        bool runSinglePose(const YuvFrame &frame, TensorView &heatmaps, TensorView &offsets);
+        bool singlePoseOutputs(TensorView &heatmaps, TensorView &offsets);
+        int decodeKeyPoints(const TensorView &heatmaps, const TensorView &offsets, int imgRows, int imgCols, KeyPoint* keyPoints,
+        int maxKeyPoints, float &score, int batch);
+        void recordSinglePose(uint64_t totalStartNanos, uint64_t decodeStartNanos);
+
+        //tracking mode: the part of the frame the next estimate should run on (no copy; a YUV crop starts on an even pixel so the
+        //chroma planes line up), and afterwards moving the keypoints back to frame coordinates and picking the next region
+        bool trackingCrop(int imgRows, int imgCols, cv::Rect &region);
+        static cv::Mat cropFrame(const cv::Mat &img, const cv::Rect &region);
+        static YuvFrame cropFrame(const YuvFrame &frame, const cv::Rect &region);
+        void trackPose(KeyPoint* keyPoints, int numKeyPoints, float score, const cv::Rect &region, int imgRows, int imgCols);
+
+        //estimateSinglePose for either kind of frame
+        template <typename Frame>
+        bool estimateSinglePoseInto(const Frame &img, Person &person);
+
+        template <typename Frame, int N>
+        bool estimateSinglePoseInto(const Frame &img, FixedPerson<N> &person) {
+            uint64_t totalStartNanos = PosenetStats::nowNanos();
+
+            cv::Rect region;
+            bool cropped = trackingCrop(img.rows, img.cols, region);
+            Frame input = cropped ? cropFrame(img, region) : img;
+
+            TensorView heatmaps, offsets;
+
+            if (!runSinglePose(input, heatmaps, offsets)) {
+                person.numKeyPoints = 0;
+                person.score = 0.0f;
+                trackingRegion = cv::Rect();
+                return false;
+            }
+
+            uint64_t decodeStartNanos = PosenetStats::nowNanos();
+
+            bool decoded = decodeSinglePose(heatmaps, offsets, input.rows, input.cols, person);
+
+            if (tracking) {
+                trackPose(person.keyPoints.data(), person.numKeyPoints, person.score, region, img.rows, img.cols);
+            }
+
+            recordSinglePose(totalStartNanos, decodeStartNanos);
+
+            return decoded;
+        }
+        void decodePoseFromRoot(const PartCandidate &root, const TensorView &heatmaps, const TensorView &offsets,
+        const TensorView &displacementsFwd, const TensorView &displacementsBwd, float outputStrideY, float outputStrideX, int batch);
+
         //helper functions for running a cv::Mat through the TfLite Posenet model
         public:
             Posenet();
             Posenet(const char* pFilename, Device pDevice);
+            //pWeightCachePath: file an XNNPACK delegate persists its packed weights to (see setWeightCachePath)
+            Posenet(const char* pFilename, Device pDevice, int numThreads, const char* pWeightCachePath = NULL);
+            Posenet(TfLiteModel* pModel, Device pDevice, int numThreads, const char* pWeightCachePath = NULL);
+            Posenet(std::shared_ptr<TfLiteModel> pModel, Device pDevice, int numThreads, const char* pWeightCachePath = NULL);
+
+            //run on the given backend instead of a TFLite model (e.g. a SyntheticBackend for tests and decode benchmarks)
+            explicit Posenet(std::shared_ptr<InferenceBackend> pBackend);
+            void setBackend(std::shared_ptr<InferenceBackend> pBackend);
+            void setNumThreads(int numThreads);
+            void setWeightCachePath(const char* pPath);
+
+            //build the interpreter and run warmup invokes up front, so the first real frame doesn't pay hundreds of ms for
+            //interpreter creation, tensor allocation and kernel preparation
+            WarmupReport prepare(const WarmupOptions &warmup = WarmupOptions());
+
+            //time invokes with 1..maxThreads interpreter threads (0 = all hardware threads), keep the best setting for the
+            //objective and leave the interpreter rebuilt and warmed up with it. Tunes at the current input shape (after
+            //setInputResolution / setBatchSize); interpreters cached for other resolutions are dropped
+            TuneResult autotune(TuneObjective objective, int maxThreads = 0, int runsPerSetting = 10);
+            int getNumThreads();
             void close();
             TfLiteInterpreter* getInterpreter();
+
+            //the backend inference runs on, building the interpreter first if needed (NULL if that fails)
+            InferenceBackend* getBackend();
             std::vector<float> initInputArray(const cv::Mat &incomingImg);
             float sigmoid(float x);
             std::unordered_map<int, std::vector<std::vector<std::vector<std::vector<float>>>> > initOutputMap();
             void runForMultipleInputsOutputs(std::vector<float> &inputs, std::unordered_map<int,
             std::vector<std::vector<std::vector<std::vector<float>>>> > &outputs);
 
+            //fused resize + channel reorder + normalize of an 8-bit Mat of any size, written straight into the input tensor
+            bool fillInputTensor(const cv::Mat &img, int batchIndex = 0);
+            bool fillInputTensor(const YuvFrame &frame, int batchIndex = 0);
+            bool preprocess(const cv::Mat &img, float* dst);
+            bool preprocess(const YuvFrame &frame, float* dst);
+
+            //preprocess into a buffer laid out like input tensor 0, whatever its type: normalized floats for float models, pixels in
+            //the tensor's quantized encoding (normally just the raw pixels) for uint8/int8 models. getInputBytes() is its size
+            bool preprocessInput(const cv::Mat &img, void* dst);
+            bool preprocessInput(const YuvFrame &frame, void* dst);
+            size_t getInputBytes();
+            void setInputFormat(PixelFormat format);
+
+            //zero-copy path: copy the input into the input tensor, invoke, then read outputs through TensorViews
+            bool runInference(const std::vector<float> &inputs);
+            bool invoke();
+            TensorView getOutputView(int index);
+
             //"main" function for human pose estimation using the model
+            Person estimateSinglePose(const cv::Mat &img);
+
+            //same; the interpreter argument is ignored (this always runs on getBackend()) and only kept for existing callers
             Person estimateSinglePose(const cv::Mat &img, TfLiteInterpreter* pInterpreter);
+
+            //same, but decoding into a caller-owned person that is reused across frames, so the steady state doesn't allocate.
+            //Return false (leaving the person empty) if the model couldn't be run
+            bool estimateSinglePose(const cv::Mat &img, Person &person);
+
+            template <int N>
+            bool estimateSinglePose(const cv::Mat &img, FixedPerson<N> &person) {
+                return estimateSinglePoseInto(img, person);
+            }
+
+            //the same straight from a camera frame's YUV planes: the color conversion is fused into the resize, so only the
+            //pixels sampled for the model input are converted. Keypoints come back in frame (luma) coordinates
+            bool estimateSinglePose(const YuvFrame &frame, Person &person);
+
+            template <int N>
+            bool estimateSinglePose(const YuvFrame &frame, FixedPerson<N> &person) {
+                return estimateSinglePoseInto(frame, person);
+            }
+
+            //run all the frames through the model in one invoke (input tensor resized to batch N), then decode the slices in parallel
+            std::vector<Person> estimateSinglePoseBatch(const std::vector<cv::Mat> &imgs);
+            bool setBatchSize(int batchSize);
+            void getInputSize(int &inputRows, int &inputCols);
+
+            //switch the model input to width x height (the output grid follows), keeping the interpreter for the previous resolution
+            //allocated so switching back costs nothing
+            bool setInputResolution(int width, int height);
+            void setMaxCachedResolutions(int maxResolutions);
+
+            //turn on latency-driven resolution switching for this instance (builds an interpreter for every size up front and starts
+            //at the largest), or turn it off, leaving the current resolution in place
+            bool enableAdaptiveResolution(const AdaptiveResolutionConfig &config = AdaptiveResolutionConfig());
+            void disableAdaptiveResolution();
+
+            //tracking mode for single-subject streams: once a confident pose is found, single-pose estimates only run the padded box
+            //around it through the model (so a smaller input resolution still sees the person at full detail, and preprocessing
+            //only touches the crop), falling back to the full frame when the pose score drops below config.minPoseScore.
+            //Keypoints are always returned in frame coordinates
+            void enableTracking(const TrackingConfig &config = TrackingConfig());
+            void disableTracking();
+
+            //where the next frame will be cropped (empty = full frame)
+            cv::Rect getTrackingRegion();
+
+            PosenetStats& getStats();
+            int64_t getLastInferenceTimeNanos();
+
+            //multi-person estimation: returns up to maxPoses people whose root keypoint scores at least scoreThreshold, where
+            //nmsRadius (in model input pixels) is how close the same keypoint of two people may be before one is suppressed
+            std::vector<Person> estimateMultiplePoses(const cv::Mat &img, int maxPoses = 10, float scoreThreshold = 0.5f, float nmsRadius = 20.0f);
+            std::vector<Person> decodeMultiplePoses(const TensorView &heatmaps, const TensorView &offsets, const TensorView &displacementsFwd,
+            const TensorView &displacementsBwd, int imgRows, int imgCols, int maxPoses, float scoreThreshold, float nmsRadius, int batch = 0);
+
+            //turn heatmaps (1 * h * w * 17) and offsets (1 * h * w * 34) into a Person scaled to an imgRows x imgCols image
+            Person decodeSinglePose(const TensorView &heatmaps, const TensorView &offsets, int imgRows, int imgCols, int batch = 0);
+            bool decodeSinglePose(const TensorView &heatmaps, const TensorView &offsets, int imgRows, int imgCols, Person &person,
+            int batch = 0);
+
+            template <int N>
+            bool decodeSinglePose(const TensorView &heatmaps, const TensorView &offsets, int imgRows, int imgCols, FixedPerson<N> &person,
+            int batch = 0) {
+                int numDecoded = decodeKeyPoints(heatmaps, offsets, imgRows, imgCols, person.keyPoints.data(), N, person.score, batch);
+
+                person.numKeyPoints = std::max(numDecoded, 0);
+
+                return numDecoded >= 0;
+            }
+
             void readFlatIntoMultiDimensionalArray(float* data, std::vector<std::vector<std::vector<std::vector<float>>>> &map);
     };
 }
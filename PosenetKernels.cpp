@@ -0,0 +1,1029 @@
+#include "PosenetKernels.h"
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+namespace ORB_SLAM2
+{
+    //[0,255] -> [-1,1] is x * NORM_SCALE + NORM_BIAS (same as (x - 127.5) / 127.5)
+    static const float NORM_SCALE = 1.0f / 127.5f;
+    static const float NORM_BIAS = -1.0f;
+    
+    int bytesPerPixel(PixelFormat format) {
+        switch (format) {
+            case PixelFormat::RGB:
+            case PixelFormat::BGR:
+                return 3;
+            case PixelFormat::RGBA:
+            case PixelFormat::BGRA:
+                return 4;
+            case PixelFormat::GRAY:
+                return 1;
+        }
+        
+        return 3;
+    }
+    
+    void PreprocessPlan::update(int pSrcRows, int pSrcCols, int pSrcChannels, int pDstRows, int pDstCols) {
+        //nothing to do if the sizes haven't changed since last frame
+        if (pSrcRows == srcRows && pSrcCols == srcCols && pSrcChannels == srcChannels && pDstRows == dstRows && pDstCols == dstCols) {
+            return;
+        }
+        
+        srcRows = pSrcRows;
+        srcCols = pSrcCols;
+        srcChannels = pSrcChannels;
+        dstRows = pDstRows;
+        dstCols = pDstCols;
+        
+        identity = (srcRows == dstRows && srcCols == dstCols);
+        
+        xOffset0.resize(dstCols);
+        xOffset1.resize(dstCols);
+        xWeight.resize(dstCols);
+        
+        //same pixel-center convention as cv::resize with INTER_LINEAR
+        float xScale = srcCols / (float)dstCols;
+        
+        for (int x = 0; x < dstCols; x++) {
+            float sx = std::max((x + 0.5f) * xScale - 0.5f, 0.0f);
+            
+            int x0 = std::min((int)sx, srcCols - 1);
+            int x1 = std::min(x0 + 1, srcCols - 1);
+            
+            xOffset0[x] = x0 * srcChannels;
+            xOffset1[x] = x1 * srcChannels;
+            xWeight[x] = (x0 == x1) ? 0.0f : sx - x0;
+        }
+    }
+    
+    
+    //load one pixel as a little-endian uint32 with bytes R, G, B (and a don't-care 4th byte), doing the channel reorder on the
+    //packed integer so the SIMD code never has to shuffle
+    template <PixelFormat F>
+    static inline uint32_t loadPixel(const uint8_t* p) {
+        uint32_t v;
+        
+        if (F == PixelFormat::GRAY) {
+            return p[0] * 0x010101u;
+        }
+        
+        //only read the bytes this pixel has, so we never read past the end of the image. 3-byte pixels are assembled in registers:
+        //memcpy-ing them into a 4-byte stack slot and reading that back defeats store forwarding on every tap
+        if (F == PixelFormat::RGBA || F == PixelFormat::BGRA) {
+            memcpy(&v, p, 4);
+        }
+        else {
+            v = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+        }
+        
+        if (F == PixelFormat::BGR || F == PixelFormat::BGRA) {
+            //swap bytes 0 and 2
+            v = (v & 0xFF00FF00u) | ((v >> 16) & 0xFFu) | ((v & 0xFFu) << 16);
+        }
+        
+        return v;
+    }
+    
+    //scalar version of one output pixel, used for the scalar fallback and for the last pixel of each row (where a 4-wide store
+    //would run past the end of the tensor)
+    template <PixelFormat F>
+    static inline void samplePixelScalar(const uint8_t* row0, const uint8_t* row1, int32_t offset0, int32_t offset1, float fx, float fy,
+    float* out) {
+        uint32_t p00 = loadPixel<F>(row0 + offset0);
+        uint32_t p01 = loadPixel<F>(row0 + offset1);
+        uint32_t p10 = loadPixel<F>(row1 + offset0);
+        uint32_t p11 = loadPixel<F>(row1 + offset1);
+        
+        for (int c = 0; c < 3; c++) {
+            int shift = c * 8;
+            
+            float top = (float)((p00 >> shift) & 0xFF) + ((float)((p01 >> shift) & 0xFF) - (float)((p00 >> shift) & 0xFF)) * fx;
+            float bottom = (float)((p10 >> shift) & 0xFF) + ((float)((p11 >> shift) & 0xFF) - (float)((p10 >> shift) & 0xFF)) * fx;
+            
+            out[c] = (top + (bottom - top) * fy) * NORM_SCALE + NORM_BIAS;
+        }
+    }
+    
+#if defined(POSENET_SSE41)
+    static inline __m128 pixelToFloat4(uint32_t v) {
+        return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128((int)v)));
+    }
+    
+    static inline __m128 lerp4(__m128 a, __m128 b, __m128 t) {
+    #if defined(__FMA__)
+        return _mm_fmadd_ps(_mm_sub_ps(b, a), t, a);
+    #else
+        return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+    #endif
+    }
+#elif defined(POSENET_NEON)
+    static inline float32x4_t pixelToFloat4(uint32_t v) {
+        uint16x8_t wide = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(v)));
+        return vcvtq_f32_u32(vmovl_u16(vget_low_u16(wide)));
+    }
+    
+    static inline float32x4_t lerp4(float32x4_t a, float32x4_t b, float32x4_t t) {
+        return vmlaq_f32(a, vsubq_f32(b, a), t);
+    }
+#endif
+    
+    //convert a run of already-RGB bytes straight to normalized floats (the no-resize, no-reorder case)
+    static void convertContiguous(const uint8_t* in, int count, float* out) {
+        int i = 0;
+        
+#if defined(POSENET_AVX2)
+        const __m256 scale = _mm256_set1_ps(NORM_SCALE);
+        const __m256 bias = _mm256_set1_ps(NORM_BIAS);
+        
+        for (; i + 8 <= count; i += 8) {
+            __m256i ints = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i)));
+            _mm256_storeu_ps(out + i, _mm256_fmadd_ps(_mm256_cvtepi32_ps(ints), scale, bias));
+        }
+#elif defined(POSENET_SSE41)
+        const __m128 scale = _mm_set1_ps(NORM_SCALE);
+        const __m128 bias = _mm_set1_ps(NORM_BIAS);
+        
+        for (; i + 4 <= count; i += 4) {
+            int32_t packed;
+            memcpy(&packed, in + i, 4);
+            
+            __m128 values = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(values, scale), bias));
+        }
+#elif defined(POSENET_NEON)
+        const float32x4_t scale = vdupq_n_f32(NORM_SCALE);
+        const float32x4_t bias = vdupq_n_f32(NORM_BIAS);
+        
+        for (; i + 8 <= count; i += 8) {
+            uint16x8_t wide = vmovl_u8(vld1_u8(in + i));
+            
+            vst1q_f32(out + i, vmlaq_f32(bias, vcvtq_f32_u32(vmovl_u16(vget_low_u16(wide))), scale));
+            vst1q_f32(out + i + 4, vmlaq_f32(bias, vcvtq_f32_u32(vmovl_u16(vget_high_u16(wide))), scale));
+        }
+#endif
+        
+        for (; i < count; i++) {
+            out[i] = in[i] * NORM_SCALE + NORM_BIAS;
+        }
+    }
+    
+    template <PixelFormat F>
+    static void preprocessRows(const uint8_t* src, size_t srcStep, const PreprocessPlan &plan, float* dst) {
+        int dstCols = plan.dstCols;
+        float yScale = plan.srcRows / (float)plan.dstRows;
+        
+        for (int y = 0; y < plan.dstRows; y++) {
+            float* out = dst + (size_t)y * dstCols * 3;
+            
+            //source rows to blend for this output row
+            float sy = std::max((y + 0.5f) * yScale - 0.5f, 0.0f);
+            int y0 = std::min((int)sy, plan.srcRows - 1);
+            int y1 = std::min(y0 + 1, plan.srcRows - 1);
+            float fy = (y0 == y1) ? 0.0f : sy - y0;
+            
+            if (plan.identity) {
+                y0 = y1 = y;
+                fy = 0.0f;
+                
+                //already the right size and order: this is just a contiguous convert
+                if (F == PixelFormat::RGB) {
+                    convertContiguous(src + y * srcStep, dstCols * 3, out);
+                    continue;
+                }
+            }
+            
+            const uint8_t* row0 = src + y0 * srcStep;
+            const uint8_t* row1 = src + y1 * srcStep;
+            
+            int x = 0;
+            
+#if defined(POSENET_SSE41) || defined(POSENET_NEON)
+            //each pixel is done as one 4-lane vector (R, G, B, junk); the junk lane gets overwritten by the next pixel's store, so
+            //the last pixel of the row is left to the scalar loop
+        #if defined(POSENET_SSE41)
+            const __m128 scale = _mm_set1_ps(NORM_SCALE);
+            const __m128 bias = _mm_set1_ps(NORM_BIAS);
+            const __m128 wy = _mm_set1_ps(fy);
+        #else
+            const float32x4_t scale = vdupq_n_f32(NORM_SCALE);
+            const float32x4_t bias = vdupq_n_f32(NORM_BIAS);
+            const float32x4_t wy = vdupq_n_f32(fy);
+        #endif
+            
+            for (; x < dstCols - 1; x++) {
+                int32_t offset0 = plan.xOffset0[x];
+                int32_t offset1 = plan.xOffset1[x];
+                
+            #if defined(POSENET_SSE41)
+                const __m128 wx = _mm_set1_ps(plan.xWeight[x]);
+                
+                __m128 top = lerp4(pixelToFloat4(loadPixel<F>(row0 + offset0)), pixelToFloat4(loadPixel<F>(row0 + offset1)), wx);
+                __m128 bottom = lerp4(pixelToFloat4(loadPixel<F>(row1 + offset0)), pixelToFloat4(loadPixel<F>(row1 + offset1)), wx);
+                __m128 value = lerp4(top, bottom, wy);
+                
+                _mm_storeu_ps(out + x * 3, _mm_add_ps(_mm_mul_ps(value, scale), bias));
+            #else
+                const float32x4_t wx = vdupq_n_f32(plan.xWeight[x]);
+                
+                float32x4_t top = lerp4(pixelToFloat4(loadPixel<F>(row0 + offset0)), pixelToFloat4(loadPixel<F>(row0 + offset1)), wx);
+                float32x4_t bottom = lerp4(pixelToFloat4(loadPixel<F>(row1 + offset0)), pixelToFloat4(loadPixel<F>(row1 + offset1)), wx);
+                float32x4_t value = lerp4(top, bottom, wy);
+                
+                vst1q_f32(out + x * 3, vmlaq_f32(bias, value, scale));
+            #endif
+            }
+#endif
+            
+            for (; x < dstCols; x++) {
+                samplePixelScalar<F>(row0, row1, plan.xOffset0[x], plan.xOffset1[x], plan.xWeight[x], fy, out + x * 3);
+            }
+        }
+    }
+    
+    void preprocessToFloat(const uint8_t* src, size_t srcStep, PixelFormat format, const PreprocessPlan &plan, float* dst) {
+        //dispatch once per frame so the per-pixel code has the format baked in
+        switch (format) {
+            case PixelFormat::RGB:
+                preprocessRows<PixelFormat::RGB>(src, srcStep, plan, dst);
+                break;
+            case PixelFormat::BGR:
+                preprocessRows<PixelFormat::BGR>(src, srcStep, plan, dst);
+                break;
+            case PixelFormat::RGBA:
+                preprocessRows<PixelFormat::RGBA>(src, srcStep, plan, dst);
+                break;
+            case PixelFormat::BGRA:
+                preprocessRows<PixelFormat::BGRA>(src, srcStep, plan, dst);
+                break;
+            case PixelFormat::GRAY:
+                preprocessRows<PixelFormat::GRAY>(src, srcStep, plan, dst);
+                break;
+        }
+    }
+    
+    
+    //bilinear sample of one output pixel rounded back to 0..255 per channel, then mapped through the quantization table
+    template <PixelFormat F>
+    static inline void samplePixelBytes(const uint8_t* row0, const uint8_t* row1, int32_t offset0, int32_t offset1, float fx, float fy,
+    const uint8_t* table, uint8_t* out) {
+        uint32_t p00 = loadPixel<F>(row0 + offset0);
+        uint32_t p01 = loadPixel<F>(row0 + offset1);
+        uint32_t p10 = loadPixel<F>(row1 + offset0);
+        uint32_t p11 = loadPixel<F>(row1 + offset1);
+        
+        for (int c = 0; c < 3; c++) {
+            int shift = c * 8;
+            
+            float top = (float)((p00 >> shift) & 0xFF) + ((float)((p01 >> shift) & 0xFF) - (float)((p00 >> shift) & 0xFF)) * fx;
+            float bottom = (float)((p10 >> shift) & 0xFF) + ((float)((p11 >> shift) & 0xFF) - (float)((p10 >> shift) & 0xFF)) * fx;
+            
+            uint8_t value = (uint8_t)(top + (bottom - top) * fy + 0.5f);
+            
+            out[c] = (table == NULL) ? value : table[value];
+        }
+    }
+    
+    template <PixelFormat F>
+    static void preprocessRowsBytes(const uint8_t* src, size_t srcStep, const PreprocessPlan &plan, const uint8_t* table, uint8_t* dst) {
+        int dstCols = plan.dstCols;
+        float yScale = plan.srcRows / (float)plan.dstRows;
+        
+        for (int y = 0; y < plan.dstRows; y++) {
+            uint8_t* out = dst + (size_t)y * dstCols * 3;
+            
+            if (plan.identity) {
+                const uint8_t* row = src + y * srcStep;
+                
+                //already the right size, order and encoding: nothing to do but copy
+                if (F == PixelFormat::RGB && table == NULL) {
+                    memcpy(out, row, (size_t)dstCols * 3);
+                    continue;
+                }
+                
+                for (int x = 0; x < dstCols; x++) {
+                    uint32_t pixel = loadPixel<F>(row + plan.xOffset0[x]);
+                    
+                    for (int c = 0; c < 3; c++) {
+                        uint8_t value = (uint8_t)(pixel >> (c * 8));
+                        out[x * 3 + c] = (table == NULL) ? value : table[value];
+                    }
+                }
+                
+                continue;
+            }
+            
+            float sy = std::max((y + 0.5f) * yScale - 0.5f, 0.0f);
+            int y0 = std::min((int)sy, plan.srcRows - 1);
+            int y1 = std::min(y0 + 1, plan.srcRows - 1);
+            float fy = (y0 == y1) ? 0.0f : sy - y0;
+            
+            const uint8_t* row0 = src + y0 * srcStep;
+            const uint8_t* row1 = src + y1 * srcStep;
+            
+            for (int x = 0; x < dstCols; x++) {
+                samplePixelBytes<F>(row0, row1, plan.xOffset0[x], plan.xOffset1[x], plan.xWeight[x], fy, table, out + x * 3);
+            }
+        }
+    }
+    
+    void preprocessToBytes(const uint8_t* src, size_t srcStep, PixelFormat format, const PreprocessPlan &plan, const uint8_t* table,
+    uint8_t* dst) {
+        switch (format) {
+            case PixelFormat::RGB:
+                preprocessRowsBytes<PixelFormat::RGB>(src, srcStep, plan, table, dst);
+                break;
+            case PixelFormat::BGR:
+                preprocessRowsBytes<PixelFormat::BGR>(src, srcStep, plan, table, dst);
+                break;
+            case PixelFormat::RGBA:
+                preprocessRowsBytes<PixelFormat::RGBA>(src, srcStep, plan, table, dst);
+                break;
+            case PixelFormat::BGRA:
+                preprocessRowsBytes<PixelFormat::BGRA>(src, srcStep, plan, table, dst);
+                break;
+            case PixelFormat::GRAY:
+                preprocessRowsBytes<PixelFormat::GRAY>(src, srcStep, plan, table, dst);
+                break;
+        }
+    }
+    
+    
+    //BT.601 limited range: RGB = 1.164 (Y - 16) + the chroma terms below, with U and V centered on 128
+    static const float YUV_LUMA = 1.164f;
+    static const float YUV_V_TO_R = 1.596f;
+    static const float YUV_U_TO_G = -0.391f;
+    static const float YUV_V_TO_G = -0.813f;
+    static const float YUV_U_TO_B = 2.018f;
+    
+    //the source rows one output row blends: luma rows y0/y1 and the chroma rows that cover them (chromaV only for I420)
+    struct YuvRows {
+        const uint8_t* luma0;
+        const uint8_t* luma1;
+        const uint8_t* chroma0;
+        const uint8_t* chroma1;
+        const uint8_t* chromaV0;
+        const uint8_t* chromaV1;
+    };
+    
+    static inline YuvRows yuvRows(const YuvFrame &frame, int y0, int y1) {
+        YuvRows rows;
+        rows.luma0 = frame.planes[0] + y0 * frame.strides[0];
+        rows.luma1 = frame.planes[0] + y1 * frame.strides[0];
+        rows.chroma0 = frame.planes[1] + (y0 >> 1) * frame.strides[1];
+        rows.chroma1 = frame.planes[1] + (y1 >> 1) * frame.strides[1];
+        rows.chromaV0 = (frame.layout == YuvLayout::I420) ? frame.planes[2] + (y0 >> 1) * frame.strides[2] : NULL;
+        rows.chromaV1 = (frame.layout == YuvLayout::I420) ? frame.planes[2] + (y1 >> 1) * frame.strides[2] : NULL;
+        
+        return rows;
+    }
+    
+    //pack the luma sample at column x and the (nearest, 2x2-shared) chroma samples for it as bytes Y, U, V (and a zero 4th byte),
+    //the same layout loadPixel produces for RGB so the blending code is shared
+    template <YuvLayout L>
+    static inline uint32_t loadYuv(const uint8_t* lumaRow, const uint8_t* chromaRow, const uint8_t* chromaVRow, int32_t x) {
+        int32_t c = x >> 1;
+        uint32_t u, v;
+        
+        if (L == YuvLayout::NV12) {
+            u = chromaRow[c * 2];
+            v = chromaRow[c * 2 + 1];
+        }
+        else if (L == YuvLayout::NV21) {
+            v = chromaRow[c * 2];
+            u = chromaRow[c * 2 + 1];
+        }
+        else {
+            u = chromaRow[c];
+            v = chromaVRow[c];
+        }
+        
+        return lumaRow[x] | (u << 8) | (v << 16);
+    }
+    
+    //bilinear blend of the four taps around one output pixel in YUV, then one conversion to RGB clamped to 0..255 (YUV -> RGB is
+    //linear, so this matches converting the taps first everywhere but at the clamp)
+    template <YuvLayout L>
+    static inline void sampleYuvScalar(const YuvRows &rows, int32_t x0, int32_t x1, float fx, float fy, float* rgb) {
+        uint32_t p00 = loadYuv<L>(rows.luma0, rows.chroma0, rows.chromaV0, x0);
+        uint32_t p01 = loadYuv<L>(rows.luma0, rows.chroma0, rows.chromaV0, x1);
+        uint32_t p10 = loadYuv<L>(rows.luma1, rows.chroma1, rows.chromaV1, x0);
+        uint32_t p11 = loadYuv<L>(rows.luma1, rows.chroma1, rows.chromaV1, x1);
+        
+        float yuv[3];
+        
+        for (int c = 0; c < 3; c++) {
+            int shift = c * 8;
+            
+            float top = (float)((p00 >> shift) & 0xFF) + ((float)((p01 >> shift) & 0xFF) - (float)((p00 >> shift) & 0xFF)) * fx;
+            float bottom = (float)((p10 >> shift) & 0xFF) + ((float)((p11 >> shift) & 0xFF) - (float)((p10 >> shift) & 0xFF)) * fx;
+            
+            yuv[c] = top + (bottom - top) * fy;
+        }
+        
+        float luma = (yuv[0] - 16.0f) * YUV_LUMA;
+        float u = yuv[1] - 128.0f;
+        float v = yuv[2] - 128.0f;
+        
+        rgb[0] = std::min(std::max(luma + YUV_V_TO_R * v, 0.0f), 255.0f);
+        rgb[1] = std::min(std::max(luma + YUV_U_TO_G * u + YUV_V_TO_G * v, 0.0f), 255.0f);
+        rgb[2] = std::min(std::max(luma + YUV_U_TO_B * u, 0.0f), 255.0f);
+    }
+    
+    template <YuvLayout L>
+    static void preprocessYuvRows(const YuvFrame &frame, const PreprocessPlan &plan, float* dst) {
+        int dstCols = plan.dstCols;
+        float yScale = plan.srcRows / (float)plan.dstRows;
+        
+#if defined(POSENET_SSE41)
+        //[R, G, B, 0] = Y * lumaWeights + U * uWeights + V * vWeights + offsets, with the -16 / -128 centering folded into offsets
+        const __m128 lumaWeights = _mm_setr_ps(YUV_LUMA, YUV_LUMA, YUV_LUMA, 0.0f);
+        const __m128 uWeights = _mm_setr_ps(0.0f, YUV_U_TO_G, YUV_U_TO_B, 0.0f);
+        const __m128 vWeights = _mm_setr_ps(YUV_V_TO_R, YUV_V_TO_G, 0.0f, 0.0f);
+        const __m128 offsets = _mm_setr_ps(-16.0f * YUV_LUMA - 128.0f * YUV_V_TO_R, -16.0f * YUV_LUMA - 128.0f * (YUV_U_TO_G + YUV_V_TO_G),
+        -16.0f * YUV_LUMA - 128.0f * YUV_U_TO_B, 0.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 maxValue = _mm_set1_ps(255.0f);
+        const __m128 scale = _mm_set1_ps(NORM_SCALE);
+        const __m128 bias = _mm_set1_ps(NORM_BIAS);
+#elif defined(POSENET_NEON)
+        const float lumaArray[4] = {YUV_LUMA, YUV_LUMA, YUV_LUMA, 0.0f};
+        const float uArray[4] = {0.0f, YUV_U_TO_G, YUV_U_TO_B, 0.0f};
+        const float vArray[4] = {YUV_V_TO_R, YUV_V_TO_G, 0.0f, 0.0f};
+        const float offsetArray[4] = {-16.0f * YUV_LUMA - 128.0f * YUV_V_TO_R, -16.0f * YUV_LUMA - 128.0f * (YUV_U_TO_G + YUV_V_TO_G),
+        -16.0f * YUV_LUMA - 128.0f * YUV_U_TO_B, 0.0f};
+        const float32x4_t lumaWeights = vld1q_f32(lumaArray);
+        const float32x4_t uWeights = vld1q_f32(uArray);
+        const float32x4_t vWeights = vld1q_f32(vArray);
+        const float32x4_t offsets = vld1q_f32(offsetArray);
+        const float32x4_t zero = vdupq_n_f32(0.0f);
+        const float32x4_t maxValue = vdupq_n_f32(255.0f);
+        const float32x4_t scale = vdupq_n_f32(NORM_SCALE);
+        const float32x4_t bias = vdupq_n_f32(NORM_BIAS);
+#endif
+        
+        for (int y = 0; y < plan.dstRows; y++) {
+            float* out = dst + (size_t)y * dstCols * 3;
+            
+            float sy = std::max((y + 0.5f) * yScale - 0.5f, 0.0f);
+            int y0 = std::min((int)sy, plan.srcRows - 1);
+            int y1 = std::min(y0 + 1, plan.srcRows - 1);
+            float fy = (y0 == y1) ? 0.0f : sy - y0;
+            
+            YuvRows rows = yuvRows(frame, y0, y1);
+            
+            int x = 0;
+            
+#if defined(POSENET_SSE41) || defined(POSENET_NEON)
+            //same one-pixel-per-vector scheme as preprocessRows: lanes are Y, U, V, 0 while blending and R, G, B, 0 after
+            //converting, and the last pixel of the row goes to the scalar loop
+            for (; x < dstCols - 1; x++) {
+                int32_t x0 = plan.xOffset0[x];
+                int32_t x1 = plan.xOffset1[x];
+                
+            #if defined(POSENET_SSE41)
+                const __m128 wx = _mm_set1_ps(plan.xWeight[x]);
+                
+                __m128 top = lerp4(pixelToFloat4(loadYuv<L>(rows.luma0, rows.chroma0, rows.chromaV0, x0)),
+                pixelToFloat4(loadYuv<L>(rows.luma0, rows.chroma0, rows.chromaV0, x1)), wx);
+                __m128 bottom = lerp4(pixelToFloat4(loadYuv<L>(rows.luma1, rows.chroma1, rows.chromaV1, x0)),
+                pixelToFloat4(loadYuv<L>(rows.luma1, rows.chroma1, rows.chromaV1, x1)), wx);
+                __m128 yuv = lerp4(top, bottom, _mm_set1_ps(fy));
+                
+                __m128 rgb = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(yuv, yuv, _MM_SHUFFLE(0, 0, 0, 0)), lumaWeights), offsets);
+                rgb = _mm_add_ps(rgb, _mm_mul_ps(_mm_shuffle_ps(yuv, yuv, _MM_SHUFFLE(1, 1, 1, 1)), uWeights));
+                rgb = _mm_add_ps(rgb, _mm_mul_ps(_mm_shuffle_ps(yuv, yuv, _MM_SHUFFLE(2, 2, 2, 2)), vWeights));
+                rgb = _mm_min_ps(_mm_max_ps(rgb, zero), maxValue);
+                
+                _mm_storeu_ps(out + x * 3, _mm_add_ps(_mm_mul_ps(rgb, scale), bias));
+            #else
+                const float32x4_t wx = vdupq_n_f32(plan.xWeight[x]);
+                
+                float32x4_t top = lerp4(pixelToFloat4(loadYuv<L>(rows.luma0, rows.chroma0, rows.chromaV0, x0)),
+                pixelToFloat4(loadYuv<L>(rows.luma0, rows.chroma0, rows.chromaV0, x1)), wx);
+                float32x4_t bottom = lerp4(pixelToFloat4(loadYuv<L>(rows.luma1, rows.chroma1, rows.chromaV1, x0)),
+                pixelToFloat4(loadYuv<L>(rows.luma1, rows.chroma1, rows.chromaV1, x1)), wx);
+                float32x4_t yuv = lerp4(top, bottom, vdupq_n_f32(fy));
+                
+                float32x4_t rgb = vmlaq_n_f32(offsets, lumaWeights, vgetq_lane_f32(yuv, 0));
+                rgb = vmlaq_n_f32(rgb, uWeights, vgetq_lane_f32(yuv, 1));
+                rgb = vmlaq_n_f32(rgb, vWeights, vgetq_lane_f32(yuv, 2));
+                rgb = vminq_f32(vmaxq_f32(rgb, zero), maxValue);
+                
+                vst1q_f32(out + x * 3, vmlaq_f32(bias, rgb, scale));
+            #endif
+            }
+#endif
+            
+            for (; x < dstCols; x++) {
+                float rgb[3];
+                sampleYuvScalar<L>(rows, plan.xOffset0[x], plan.xOffset1[x], plan.xWeight[x], fy, rgb);
+                
+                for (int c = 0; c < 3; c++) {
+                    out[x * 3 + c] = rgb[c] * NORM_SCALE + NORM_BIAS;
+                }
+            }
+        }
+    }
+    
+    template <YuvLayout L>
+    static void preprocessYuvRowsBytes(const YuvFrame &frame, const PreprocessPlan &plan, const uint8_t* table, uint8_t* dst) {
+        int dstCols = plan.dstCols;
+        float yScale = plan.srcRows / (float)plan.dstRows;
+        
+        for (int y = 0; y < plan.dstRows; y++) {
+            uint8_t* out = dst + (size_t)y * dstCols * 3;
+            
+            float sy = std::max((y + 0.5f) * yScale - 0.5f, 0.0f);
+            int y0 = std::min((int)sy, plan.srcRows - 1);
+            int y1 = std::min(y0 + 1, plan.srcRows - 1);
+            float fy = (y0 == y1) ? 0.0f : sy - y0;
+            
+            YuvRows rows = yuvRows(frame, y0, y1);
+            
+            for (int x = 0; x < dstCols; x++) {
+                float rgb[3];
+                sampleYuvScalar<L>(rows, plan.xOffset0[x], plan.xOffset1[x], plan.xWeight[x], fy, rgb);
+                
+                for (int c = 0; c < 3; c++) {
+                    uint8_t value = (uint8_t)(rgb[c] + 0.5f);
+                    out[x * 3 + c] = (table == NULL) ? value : table[value];
+                }
+            }
+        }
+    }
+    
+    void preprocessYuvToFloat(const YuvFrame &frame, const PreprocessPlan &plan, float* dst) {
+        switch (frame.layout) {
+            case YuvLayout::NV12:
+                preprocessYuvRows<YuvLayout::NV12>(frame, plan, dst);
+                break;
+            case YuvLayout::NV21:
+                preprocessYuvRows<YuvLayout::NV21>(frame, plan, dst);
+                break;
+            case YuvLayout::I420:
+                preprocessYuvRows<YuvLayout::I420>(frame, plan, dst);
+                break;
+        }
+    }
+    
+    void preprocessYuvToBytes(const YuvFrame &frame, const PreprocessPlan &plan, const uint8_t* table, uint8_t* dst) {
+        switch (frame.layout) {
+            case YuvLayout::NV12:
+                preprocessYuvRowsBytes<YuvLayout::NV12>(frame, plan, table, dst);
+                break;
+            case YuvLayout::NV21:
+                preprocessYuvRowsBytes<YuvLayout::NV21>(frame, plan, table, dst);
+                break;
+            case YuvLayout::I420:
+                preprocessYuvRowsBytes<YuvLayout::I420>(frame, plan, table, dst);
+                break;
+        }
+    }
+    
+    //samples per thumbnail cell along each axis
+    static const int THUMBNAIL_SAMPLES = 4;
+    
+    void motionThumbnail(const uint8_t* src, size_t srcStep, int srcRows, int srcCols, int channels, int thumbRows, int thumbCols,
+    uint8_t* thumb) {
+        //source column byte offsets of the samples, shared by every row of cells
+        int32_t columns[THUMBNAIL_SAMPLES * MAX_THUMBNAIL_COLS];
+        int samplesPerRow = thumbCols * THUMBNAIL_SAMPLES;
+        
+        for (int i = 0; i < samplesPerRow; i++) {
+            columns[i] = (int32_t)(((2 * i + 1) * (int64_t)srcCols) / (2 * samplesPerRow)) * channels;
+        }
+        
+        int samplesPerCol = thumbRows * THUMBNAIL_SAMPLES;
+        int divisor = THUMBNAIL_SAMPLES * THUMBNAIL_SAMPLES * channels;
+        
+        for (int ty = 0; ty < thumbRows; ty++) {
+            uint32_t sums[MAX_THUMBNAIL_COLS] = {0};
+            
+            for (int sy = 0; sy < THUMBNAIL_SAMPLES; sy++) {
+                int row = (int)(((2 * (ty * THUMBNAIL_SAMPLES + sy) + 1) * (int64_t)srcRows) / (2 * samplesPerCol));
+                const uint8_t* line = src + row * srcStep;
+                
+                for (int i = 0; i < samplesPerRow; i++) {
+                    const uint8_t* pixel = line + columns[i];
+                    uint32_t sum = 0;
+                    
+                    for (int c = 0; c < channels; c++) {
+                        sum += pixel[c];
+                    }
+                    
+                    sums[i / THUMBNAIL_SAMPLES] += sum;
+                }
+            }
+            
+            for (int tx = 0; tx < thumbCols; tx++) {
+                thumb[ty * thumbCols + tx] = (uint8_t)(sums[tx] / divisor);
+            }
+        }
+    }
+    
+    float meanAbsDifference(const uint8_t* a, const uint8_t* b, int count) {
+        uint64_t total = 0;
+        int i = 0;
+        
+#if defined(POSENET_SSE41)
+        //psadbw sums the absolute differences of 8 bytes into each 64-bit half
+        __m128i sums = _mm_setzero_si128();
+        
+        for (; i + 16 <= count; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+            sums = _mm_add_epi64(sums, _mm_sad_epu8(va, vb));
+        }
+        
+        //each half is far below 2^32 for any thumbnail, so the low words are enough (and work on 32-bit targets too)
+        total = (uint32_t)_mm_cvtsi128_si32(sums) + (uint32_t)_mm_extract_epi32(sums, 2);
+#elif defined(POSENET_NEON)
+        uint32x4_t sums = vdupq_n_u32(0);
+        
+        for (; i + 16 <= count; i += 16) {
+            uint8x16_t diff = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+            sums = vpadalq_u16(sums, vpaddlq_u8(diff));
+        }
+        
+        uint32_t lanes[4];
+        vst1q_u32(lanes, sums);
+        total = (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+        
+        for (; i < count; i++) {
+            total += (uint32_t)abs((int)a[i] - (int)b[i]);
+        }
+        
+        return count > 0 ? (float)total / count : 0.0f;
+    }
+    
+    bool buildQuantizeTable(float scale, int32_t zeroPoint, bool isSigned, uint8_t* table) {
+        int32_t minValue = isSigned ? -128 : 0;
+        int32_t maxValue = isSigned ? 127 : 255;
+        
+        //zero point that would make the encoding the raw pixel value (uint8) or the pixel value - 128 (int8)
+        int32_t rawZeroPoint = isSigned ? 0 : 128;
+        
+        if (fabsf(scale * 127.5f - 1.0f) < 0.01f && abs(zeroPoint - rawZeroPoint) <= 1) {
+            for (int p = 0; p < 256; p++) {
+                table[p] = isSigned ? (uint8_t)(p ^ 0x80) : (uint8_t)p;
+            }
+            
+            return !isSigned;
+        }
+        
+        for (int p = 0; p < 256; p++) {
+            float normalized = p * NORM_SCALE + NORM_BIAS;
+            int32_t q = (int32_t)lrintf(normalized / scale) + zeroPoint;
+            
+            table[p] = (uint8_t)std::min(std::max(q, minValue), maxValue);
+        }
+        
+        return false;
+    }
+    
+    
+    //shared argmax over 8-bit heatmaps. The vector compares are signed, so uint8 data is flipped into signed order by xor-ing
+    //with 0x80 (BIAS) on the way in and back on the way out. 16 channels per register with 16-bit cell indices, so up to 65536
+    //cells (a 513 input at output stride 8 is 65 x 65 = 4225)
+    template <uint8_t BIAS, typename T>
+    static void argmaxBytes(const T* typedData, int numCells, int channels, int32_t* maxValues, int32_t* maxCells) {
+        for (int c = 0; c < channels; c++) {
+            maxValues[c] = typedData[c];
+            maxCells[c] = 0;
+        }
+        
+        int vectorChannels = 0;
+        
+#if defined(POSENET_SSE41) || defined(POSENET_NEON)
+        const uint8_t* data = (const uint8_t*)typedData;
+        const int LANES = 16;
+        const int MAX_CHUNKS = (MAX_KEYPOINTS + LANES - 1) / LANES;
+        int chunks = (numCells <= 65536) ? channels / LANES : 0;
+        
+    #if defined(POSENET_SSE41)
+        const __m128i bias = _mm_set1_epi8((char)BIAS);
+        __m128i maxv[MAX_CHUNKS];
+        __m128i idxLo[MAX_CHUNKS];
+        __m128i idxHi[MAX_CHUNKS];
+        
+        for (int j = 0; j < chunks; j++) {
+            maxv[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(data + j * LANES)), bias);
+            idxLo[j] = _mm_setzero_si128();
+            idxHi[j] = _mm_setzero_si128();
+        }
+        
+        for (int cell = 1; cell < numCells; cell++) {
+            const uint8_t* values = data + (size_t)cell * channels;
+            const __m128i cellv = _mm_set1_epi16((short)cell);
+            
+            for (int j = 0; j < chunks; j++) {
+                __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(values + j * LANES)), bias);
+                __m128i greater = _mm_cmpgt_epi8(v, maxv[j]);
+                
+                maxv[j] = _mm_max_epi8(maxv[j], v);
+                
+                //widen the byte mask to the 16-bit index lanes
+                idxLo[j] = _mm_blendv_epi8(idxLo[j], cellv, _mm_unpacklo_epi8(greater, greater));
+                idxHi[j] = _mm_blendv_epi8(idxHi[j], cellv, _mm_unpackhi_epi8(greater, greater));
+            }
+        }
+        
+        for (int j = 0; j < chunks; j++) {
+            uint8_t maxBytes[LANES];
+            uint16_t cells[LANES];
+            
+            _mm_storeu_si128((__m128i*)maxBytes, _mm_xor_si128(maxv[j], bias));
+            _mm_storeu_si128((__m128i*)cells, idxLo[j]);
+            _mm_storeu_si128((__m128i*)(cells + 8), idxHi[j]);
+            
+            for (int k = 0; k < LANES; k++) {
+                maxValues[j * LANES + k] = (T)maxBytes[k];
+                maxCells[j * LANES + k] = cells[k];
+            }
+        }
+    #else
+        const int8x16_t bias = vdupq_n_s8((int8_t)BIAS);
+        int8x16_t maxv[MAX_CHUNKS];
+        uint16x8_t idxLo[MAX_CHUNKS];
+        uint16x8_t idxHi[MAX_CHUNKS];
+        
+        for (int j = 0; j < chunks; j++) {
+            maxv[j] = veorq_s8(vld1q_s8((const int8_t*)(data + j * LANES)), bias);
+            idxLo[j] = vdupq_n_u16(0);
+            idxHi[j] = vdupq_n_u16(0);
+        }
+        
+        for (int cell = 1; cell < numCells; cell++) {
+            const uint8_t* values = data + (size_t)cell * channels;
+            const uint16x8_t cellv = vdupq_n_u16((uint16_t)cell);
+            
+            for (int j = 0; j < chunks; j++) {
+                int8x16_t v = veorq_s8(vld1q_s8((const int8_t*)(values + j * LANES)), bias);
+                int8x16_t greater = vreinterpretq_s8_u8(vcgtq_s8(v, maxv[j]));
+                
+                maxv[j] = vmaxq_s8(maxv[j], v);
+                
+                //sign-extending the all-ones/all-zeros byte mask widens it to the 16-bit index lanes
+                idxLo[j] = vbslq_u16(vreinterpretq_u16_s16(vmovl_s8(vget_low_s8(greater))), cellv, idxLo[j]);
+                idxHi[j] = vbslq_u16(vreinterpretq_u16_s16(vmovl_s8(vget_high_s8(greater))), cellv, idxHi[j]);
+            }
+        }
+        
+        for (int j = 0; j < chunks; j++) {
+            uint8_t maxBytes[LANES];
+            uint16_t cells[LANES];
+            
+            vst1q_u8(maxBytes, vreinterpretq_u8_s8(veorq_s8(maxv[j], bias)));
+            vst1q_u16(cells, idxLo[j]);
+            vst1q_u16(cells + 8, idxHi[j]);
+            
+            for (int k = 0; k < LANES; k++) {
+                maxValues[j * LANES + k] = (T)maxBytes[k];
+                maxCells[j * LANES + k] = cells[k];
+            }
+        }
+    #endif
+        
+        vectorChannels = chunks * LANES;
+#endif
+        
+        if (vectorChannels < channels) {
+            for (int cell = 1; cell < numCells; cell++) {
+                const T* values = typedData + (size_t)cell * channels;
+                
+                for (int c = vectorChannels; c < channels; c++) {
+                    if (values[c] > maxValues[c]) {
+                        maxValues[c] = values[c];
+                        maxCells[c] = cell;
+                    }
+                }
+            }
+        }
+    }
+    
+    void argmaxChannels(const uint8_t* data, int numCells, int channels, int32_t* maxValues, int32_t* maxCells) {
+        argmaxBytes<0x80>(data, numCells, channels, maxValues, maxCells);
+    }
+    
+    void argmaxChannels(const int8_t* data, int numCells, int channels, int32_t* maxValues, int32_t* maxCells) {
+        argmaxBytes<0x00>(data, numCells, channels, maxValues, maxCells);
+    }
+    
+    
+    void argmaxChannels(const float* data, int numCells, int channels, float* maxValues, int32_t* maxCells) {
+        //the first cell seeds every maximum
+        for (int c = 0; c < channels; c++) {
+            maxValues[c] = data[c];
+            maxCells[c] = 0;
+        }
+        
+        int vectorChannels = 0;
+        
+#if defined(POSENET_AVX2)
+        const int LANES = 8;
+        const int MAX_CHUNKS = MAX_KEYPOINTS / LANES;
+        
+        __m256 maxv[MAX_CHUNKS];
+        __m256i idxv[MAX_CHUNKS];
+        int chunks = channels / LANES;
+        
+        for (int j = 0; j < chunks; j++) {
+            maxv[j] = _mm256_loadu_ps(data + j * LANES);
+            idxv[j] = _mm256_setzero_si256();
+        }
+        
+        for (int cell = 1; cell < numCells; cell++) {
+            const float* values = data + (size_t)cell * channels;
+            const __m256i cellv = _mm256_set1_epi32(cell);
+            
+            for (int j = 0; j < chunks; j++) {
+                __m256 v = _mm256_loadu_ps(values + j * LANES);
+                __m256 greater = _mm256_cmp_ps(v, maxv[j], _CMP_GT_OQ);
+                
+                maxv[j] = _mm256_blendv_ps(maxv[j], v, greater);
+                idxv[j] = _mm256_blendv_epi8(idxv[j], cellv, _mm256_castps_si256(greater));
+            }
+        }
+        
+        for (int j = 0; j < chunks; j++) {
+            _mm256_storeu_ps(maxValues + j * LANES, maxv[j]);
+            _mm256_storeu_si256((__m256i*)(maxCells + j * LANES), idxv[j]);
+        }
+        
+        vectorChannels = chunks * LANES;
+#elif defined(POSENET_SSE41) || defined(POSENET_NEON)
+        const int LANES = 4;
+        const int MAX_CHUNKS = MAX_KEYPOINTS / LANES;
+        int chunks = channels / LANES;
+        
+    #if defined(POSENET_SSE41)
+        __m128 maxv[MAX_CHUNKS];
+        __m128i idxv[MAX_CHUNKS];
+        
+        for (int j = 0; j < chunks; j++) {
+            maxv[j] = _mm_loadu_ps(data + j * LANES);
+            idxv[j] = _mm_setzero_si128();
+        }
+        
+        for (int cell = 1; cell < numCells; cell++) {
+            const float* values = data + (size_t)cell * channels;
+            const __m128i cellv = _mm_set1_epi32(cell);
+            
+            for (int j = 0; j < chunks; j++) {
+                __m128 v = _mm_loadu_ps(values + j * LANES);
+                __m128 greater = _mm_cmpgt_ps(v, maxv[j]);
+                
+                maxv[j] = _mm_blendv_ps(maxv[j], v, greater);
+                idxv[j] = _mm_blendv_epi8(idxv[j], cellv, _mm_castps_si128(greater));
+            }
+        }
+        
+        for (int j = 0; j < chunks; j++) {
+            _mm_storeu_ps(maxValues + j * LANES, maxv[j]);
+            _mm_storeu_si128((__m128i*)(maxCells + j * LANES), idxv[j]);
+        }
+    #else
+        float32x4_t maxv[MAX_CHUNKS];
+        uint32x4_t idxv[MAX_CHUNKS];
+        
+        for (int j = 0; j < chunks; j++) {
+            maxv[j] = vld1q_f32(data + j * LANES);
+            idxv[j] = vdupq_n_u32(0);
+        }
+        
+        for (int cell = 1; cell < numCells; cell++) {
+            const float* values = data + (size_t)cell * channels;
+            const uint32x4_t cellv = vdupq_n_u32((uint32_t)cell);
+            
+            for (int j = 0; j < chunks; j++) {
+                float32x4_t v = vld1q_f32(values + j * LANES);
+                uint32x4_t greater = vcgtq_f32(v, maxv[j]);
+                
+                maxv[j] = vbslq_f32(greater, v, maxv[j]);
+                idxv[j] = vbslq_u32(greater, cellv, idxv[j]);
+            }
+        }
+        
+        for (int j = 0; j < chunks; j++) {
+            vst1q_f32(maxValues + j * LANES, maxv[j]);
+            vst1q_u32((uint32_t*)(maxCells + j * LANES), idxv[j]);
+        }
+    #endif
+        
+        vectorChannels = chunks * LANES;
+#endif
+        
+        //channels that don't fill a whole vector (e.g. the 17th keypoint)
+        if (vectorChannels < channels) {
+            for (int cell = 1; cell < numCells; cell++) {
+                const float* values = data + (size_t)cell * channels;
+                
+                for (int c = vectorChannels; c < channels; c++) {
+                    if (values[c] > maxValues[c]) {
+                        maxValues[c] = values[c];
+                        maxCells[c] = cell;
+                    }
+                }
+            }
+        }
+    }
+    
+    
+    //Cephes-style expf: e^x = 2^n * e^r with |r| <= ln(2)/2 and a degree-5 polynomial for e^r
+    static const float EXP_HI = 88.3762626647949f;
+    static const float EXP_LO = -88.3762626647949f;
+    static const float LOG2EF = 1.44269504088896341f;
+    static const float EXP_C1 = 0.693359375f;
+    static const float EXP_C2 = -2.12194440e-4f;
+    static const float EXP_P0 = 1.9875691500e-4f;
+    static const float EXP_P1 = 1.3981999507e-3f;
+    static const float EXP_P2 = 8.3334519073e-3f;
+    static const float EXP_P3 = 4.1665795894e-2f;
+    static const float EXP_P4 = 1.6666665459e-1f;
+    static const float EXP_P5 = 5.0000001201e-1f;
+    
+#if defined(POSENET_SSE41)
+    static inline __m128 exp4(__m128 x) {
+        x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(EXP_LO)), _mm_set1_ps(EXP_HI));
+        
+        __m128 n = _mm_floor_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(LOG2EF)), _mm_set1_ps(0.5f)));
+        
+        x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(EXP_C1)));
+        x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(EXP_C2)));
+        
+        __m128 z = _mm_mul_ps(x, x);
+        __m128 y = _mm_set1_ps(EXP_P0);
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P1));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P2));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P3));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P4));
+        y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P5));
+        y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), _mm_set1_ps(1.0f));
+        
+        //scale by 2^n by building the float exponent directly
+        __m128i pow2n = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+        
+        return _mm_mul_ps(y, _mm_castsi128_ps(pow2n));
+    }
+#elif defined(POSENET_NEON)
+    static inline float32x4_t exp4(float32x4_t x) {
+        x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(EXP_LO)), vdupq_n_f32(EXP_HI));
+        
+        //floor without ARMv8's vrndmq: truncate, then step down where truncation rounded up
+        float32x4_t t = vmlaq_f32(vdupq_n_f32(0.5f), x, vdupq_n_f32(LOG2EF));
+        float32x4_t n = vcvtq_f32_s32(vcvtq_s32_f32(t));
+        n = vsubq_f32(n, vreinterpretq_f32_u32(vandq_u32(vcgtq_f32(n, t), vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+        
+        x = vmlsq_f32(x, n, vdupq_n_f32(EXP_C1));
+        x = vmlsq_f32(x, n, vdupq_n_f32(EXP_C2));
+        
+        float32x4_t z = vmulq_f32(x, x);
+        float32x4_t y = vdupq_n_f32(EXP_P0);
+        y = vmlaq_f32(vdupq_n_f32(EXP_P1), y, x);
+        y = vmlaq_f32(vdupq_n_f32(EXP_P2), y, x);
+        y = vmlaq_f32(vdupq_n_f32(EXP_P3), y, x);
+        y = vmlaq_f32(vdupq_n_f32(EXP_P4), y, x);
+        y = vmlaq_f32(vdupq_n_f32(EXP_P5), y, x);
+        y = vaddq_f32(vmlaq_f32(x, y, z), vdupq_n_f32(1.0f));
+        
+        int32x4_t pow2n = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+        
+        return vmulq_f32(y, vreinterpretq_f32_s32(pow2n));
+    }
+#endif
+    
+    void sigmoidInPlace(float* values, int count) {
+        int i = 0;
+        
+#if defined(POSENET_SSE41)
+        const __m128 one = _mm_set1_ps(1.0f);
+        
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(values + i);
+            __m128 e = exp4(_mm_sub_ps(_mm_setzero_ps(), x));
+            
+            _mm_storeu_ps(values + i, _mm_div_ps(one, _mm_add_ps(one, e)));
+        }
+#elif defined(POSENET_NEON)
+        const float32x4_t one = vdupq_n_f32(1.0f);
+        
+        for (; i + 4 <= count; i += 4) {
+            float32x4_t denominator = vaddq_f32(one, exp4(vnegq_f32(vld1q_f32(values + i))));
+            
+            //reciprocal estimate plus two Newton-Raphson steps (ARMv7 has no vector divide)
+            float32x4_t reciprocal = vrecpeq_f32(denominator);
+            reciprocal = vmulq_f32(vrecpsq_f32(denominator, reciprocal), reciprocal);
+            reciprocal = vmulq_f32(vrecpsq_f32(denominator, reciprocal), reciprocal);
+            
+            vst1q_f32(values + i, reciprocal);
+        }
+#endif
+        
+        for (; i < count; i++) {
+            values[i] = 1.0f / (1.0f + expf(-values[i]));
+        }
+    }
+}
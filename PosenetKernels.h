@@ -0,0 +1,129 @@
+#ifndef POSENET_KERNELS_H
+#define POSENET_KERNELS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+//pick the widest instruction set the compiler was told it can use (-mavx2 -mfma, -msse4.1, or NEON on ARM); everything falls
+//back to plain scalar code otherwise
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define POSENET_AVX2 1
+    #define POSENET_SSE41 1
+#elif defined(__SSE4_1__)
+    #include <smmintrin.h>
+    #define POSENET_SSE41 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define POSENET_NEON 1
+#endif
+
+
+namespace ORB_SLAM2 {
+
+    //byte layout of the pixels handed to the preprocessing kernel (the model always wants RGB)
+    enum class PixelFormat {
+        RGB,
+        BGR,
+        RGBA,
+        BGRA,
+        GRAY
+    };
+
+    //chroma layout of a 4:2:0 camera frame: NV12 (Y plane + interleaved UV), NV21 (Y + interleaved VU, the Android camera
+    //default) or I420 (Y, U and V planes)
+    enum class YuvLayout {
+        NV12,
+        NV21,
+        I420
+    };
+
+    //one YUV 4:2:0 frame as it comes off the camera: plane 0 is luma (rows x cols), plane 1 the interleaved chroma (NV12/NV21)
+    //or U (I420), plane 2 V (I420 only). Each plane has its own row stride in bytes, which may include padding
+    struct YuvFrame {
+        YuvLayout layout = YuvLayout::NV21;
+        int rows = 0;
+        int cols = 0;
+        const uint8_t* planes[3] = {NULL, NULL, NULL};
+        size_t strides[3] = {0, 0, 0};
+
+        bool empty() const {
+            return rows <= 0 || cols <= 0 || planes[0] == NULL || planes[1] == NULL || (layout == YuvLayout::I420 && planes[2] == NULL);
+        }
+    };
+
+    //precomputed horizontal sampling positions for resizing one source size to one model input size, so each frame only
+    //does the per-pixel work (rebuilt only when the source or destination size changes)
+    class PreprocessPlan {
+        public:
+            int srcRows = 0;
+            int srcCols = 0;
+            int dstRows = 0;
+            int dstCols = 0;
+            int srcChannels = 0;
+
+            //true when no resampling is needed
+            bool identity = false;
+
+            //byte offsets of the left/right source pixels for each output column, and the weight of the right one
+            std::vector<int32_t> xOffset0;
+            std::vector<int32_t> xOffset1;
+            std::vector<float> xWeight;
+
+            //(re)build the plan if the sizes don't match what it was built for
+            void update(int pSrcRows, int pSrcCols, int pSrcChannels, int pDstRows, int pDstCols);
+    };
+
+    //one fused pass over the source image: bilinear resize to the plan's destination size, reorder the channels to RGB, and
+    //normalize to [-1,1], writing dstRows * dstCols * 3 floats straight into dst (normally the input tensor's buffer)
+    void preprocessToFloat(const uint8_t* src, size_t srcStep, PixelFormat format, const PreprocessPlan &plan, float* dst);
+
+    //same fused resize + reorder for quantized (uint8/int8) input tensors: the resampled 0..255 RGB value of each channel is mapped
+    //through table (built by buildQuantizeTable) to the tensor's encoding, or written as is when table is NULL
+    void preprocessToBytes(const uint8_t* src, size_t srcStep, PixelFormat format, const PreprocessPlan &plan, const uint8_t* table,
+    uint8_t* dst);
+
+    //table[p] = the quantized encoding (scale, zeroPoint; int8 stored as its byte) of pixel value p normalized to [-1,1]. Models
+    //whose encoding is within a quantum of the raw pixel values (the usual scale 1/128, zero point 128 uint8 models) get exactly
+    //the raw pixels, in which case true is returned and the table can be skipped altogether
+    bool buildQuantizeTable(float scale, int32_t zeroPoint, bool isSigned, uint8_t* table);
+
+    //the same fused pass straight from YUV planes (plan built with one channel, i.e. over luma columns): only the luma and chroma
+    //samples the bilinear taps touch are read, and YUV -> RGB (BT.601 limited range, as the Android camera and OpenCV's
+    //COLOR_YUV2RGB_NV21 use) is done once per output pixel rather than over the whole frame
+    void preprocessYuvToFloat(const YuvFrame &frame, const PreprocessPlan &plan, float* dst);
+    void preprocessYuvToBytes(const YuvFrame &frame, const PreprocessPlan &plan, const uint8_t* table, uint8_t* dst);
+
+    //how many bytes one pixel of the given format takes up
+    int bytesPerPixel(PixelFormat format);
+
+    //widest thumbnail motionThumbnail makes
+    const int MAX_THUMBNAIL_COLS = 64;
+
+    //grayscale thumbnail for cheap frame differencing: each of the thumbRows x thumbCols cells gets the mean of a 4x4 grid of samples
+    //spread over it (channels averaged), so sensor noise mostly cancels out and the cost doesn't depend on the frame size.
+    //thumbCols must be at most MAX_THUMBNAIL_COLS
+    void motionThumbnail(const uint8_t* src, size_t srcStep, int srcRows, int srcCols, int channels, int thumbRows, int thumbCols,
+    uint8_t* thumb);
+
+    //mean absolute difference (0..255) of two byte arrays, e.g. two thumbnails
+    float meanAbsDifference(const uint8_t* a, const uint8_t* b, int count);
+
+    //most heatmap channels (keypoints) the decode kernels handle
+    const int MAX_KEYPOINTS = 64;
+
+    //one contiguous pass over a numCells x channels (HWC) heatmap, keeping a running maximum and its cell index for every channel
+    //in vector registers; ties keep the earliest cell. channels must be at most MAX_KEYPOINTS.
+    void argmaxChannels(const float* data, int numCells, int channels, float* maxValues, int32_t* maxCells);
+
+    //the same on quantized heatmaps, comparing the raw uint8/int8 values (dequantization is monotonic, so the winners are the same);
+    //maxValues gets the raw quantized maxima for the caller to dequantize
+    void argmaxChannels(const uint8_t* data, int numCells, int channels, int32_t* maxValues, int32_t* maxCells);
+    void argmaxChannels(const int8_t* data, int numCells, int channels, int32_t* maxValues, int32_t* maxCells);
+
+    //values[i] = 1 / (1 + e^-values[i]), vectorized with a polynomial exp (about 1e-7 relative error)
+    void sigmoidInPlace(float* values, int count);
+}
+
+#endif //POSENET_KERNELS_H
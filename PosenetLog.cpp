@@ -0,0 +1,86 @@
+#include "PosenetLog.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+#if defined(__ANDROID__)
+    #include <android/log.h>
+#elif defined(POSENET_LOG_SYSLOG)
+    #include <syslog.h>
+#else
+    #include <mutex>
+#endif
+
+namespace ORB_SLAM2
+{
+#if defined(__ANDROID__)
+    static int androidPriority(int level) {
+        switch (level) {
+            case POSENET_LOG_LEVEL_TRACE:
+                return ANDROID_LOG_VERBOSE;
+            case POSENET_LOG_LEVEL_DEBUG:
+                return ANDROID_LOG_DEBUG;
+            case POSENET_LOG_LEVEL_INFO:
+                return ANDROID_LOG_INFO;
+            case POSENET_LOG_LEVEL_WARN:
+                return ANDROID_LOG_WARN;
+            default:
+                return ANDROID_LOG_ERROR;
+        }
+    }
+#else
+    static const char* levelName(int level) {
+        switch (level) {
+            case POSENET_LOG_LEVEL_TRACE:
+                return "TRACE";
+            case POSENET_LOG_LEVEL_DEBUG:
+                return "DEBUG";
+            case POSENET_LOG_LEVEL_INFO:
+                return "INFO";
+            case POSENET_LOG_LEVEL_WARN:
+                return "WARN";
+            default:
+                return "ERROR";
+        }
+    }
+    
+#if defined(POSENET_LOG_SYSLOG)
+    static int syslogPriority(int level) {
+        switch (level) {
+            case POSENET_LOG_LEVEL_TRACE:
+            case POSENET_LOG_LEVEL_DEBUG:
+                return LOG_DEBUG;
+            case POSENET_LOG_LEVEL_INFO:
+                return LOG_INFO;
+            case POSENET_LOG_LEVEL_WARN:
+                return LOG_WARNING;
+            default:
+                return LOG_ERR;
+        }
+    }
+#endif
+#endif
+    
+    void posenetLog(int level, const char* tag, const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        
+#if defined(__ANDROID__)
+        __android_log_vprint(androidPriority(level), tag, format, args);
+#elif defined(POSENET_LOG_SYSLOG)
+        //syslog takes one format, so format the message first and then tag it
+        char message[1024];
+        vsnprintf(message, sizeof(message), format, args);
+        syslog(syslogPriority(level), "%s %s: %s", levelName(level), tag, message);
+#else
+        //one lock around the whole line so messages from the stream/pool threads don't interleave
+        static std::mutex stderrMutex;
+        std::lock_guard<std::mutex> lock(stderrMutex);
+        
+        fprintf(stderr, "%s %s: ", levelName(level), tag);
+        vfprintf(stderr, format, args);
+        fputc('\n', stderr);
+#endif
+        
+        va_end(args);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef POSENET_LOG_H
+#define POSENET_LOG_H
+
+//severity levels, lowest first. Call sites below POSENET_LOG_LEVEL compile to nothing: no call, no argument evaluation and
+//no string formatting, so trace logging can sit on the per-frame path for free in release builds
+#define POSENET_LOG_LEVEL_TRACE 0
+#define POSENET_LOG_LEVEL_DEBUG 1
+#define POSENET_LOG_LEVEL_INFO 2
+#define POSENET_LOG_LEVEL_WARN 3
+#define POSENET_LOG_LEVEL_ERROR 4
+#define POSENET_LOG_LEVEL_OFF 5
+
+//release builds (NDEBUG) keep setup messages, warnings and errors, debug builds add debug messages. Build with
+//-DPOSENET_LOG_LEVEL=POSENET_LOG_LEVEL_TRACE to see the per-frame ones too, or POSENET_LOG_LEVEL_OFF for silence
+#ifndef POSENET_LOG_LEVEL
+    #ifdef NDEBUG
+        #define POSENET_LOG_LEVEL POSENET_LOG_LEVEL_INFO
+    #else
+        #define POSENET_LOG_LEVEL POSENET_LOG_LEVEL_DEBUG
+    #endif
+#endif
+
+
+namespace ORB_SLAM2 {
+
+    //write one printf-style message to the platform log: logcat on Android, syslog when built with POSENET_LOG_SYSLOG,
+    //stderr otherwise. Use the LOG* macros rather than calling this directly, they're what make disabled levels free
+    void posenetLog(int level, const char* tag, const char* format, ...) __attribute__((format(printf, 3, 4)));
+}
+
+//the level test is a constant expression, so the compiler drops disabled sites entirely (their arguments are still
+//type-checked). Each .cpp defines LOG_TAG before using these
+#define POSENET_LOG_AT(level, ...) \
+    do { \
+        if ((level) >= POSENET_LOG_LEVEL) { \
+            ORB_SLAM2::posenetLog((level), LOG_TAG, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOGT(...) POSENET_LOG_AT(POSENET_LOG_LEVEL_TRACE, __VA_ARGS__)
+#define LOGD(...) POSENET_LOG_AT(POSENET_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOGI(...) POSENET_LOG_AT(POSENET_LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOGW(...) POSENET_LOG_AT(POSENET_LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOGE(...) POSENET_LOG_AT(POSENET_LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif //POSENET_LOG_H
@@ -0,0 +1,242 @@
+#include "PosenetPool.h"
+#include "PosenetLog.h"
+#define LOG_TAG "POSENETPOOL.CC"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+    static uint64_t nanosBetween(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+        return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+    }
+    
+    
+    PosenetPool::Lease::Lease()
+    {}
+    
+    PosenetPool::Lease::Lease(PosenetPool* pPool, int pSlot) {
+        pool = pPool;
+        slot = pSlot;
+    }
+    
+    PosenetPool::Lease::Lease(Lease &&other) {
+        pool = other.pool;
+        slot = other.slot;
+        
+        other.pool = NULL;
+        other.slot = -1;
+    }
+    
+    PosenetPool::Lease& PosenetPool::Lease::operator=(Lease &&other) {
+        if (this != &other) {
+            release();
+            
+            pool = other.pool;
+            slot = other.slot;
+            
+            other.pool = NULL;
+            other.slot = -1;
+        }
+        
+        return *this;
+    }
+    
+    PosenetPool::Lease::~Lease() {
+        release();
+    }
+    
+    Posenet* PosenetPool::Lease::operator->() {
+        return pool->instances[slot].get();
+    }
+    
+    Posenet& PosenetPool::Lease::operator*() {
+        return *pool->instances[slot];
+    }
+    
+    void PosenetPool::Lease::release() {
+        if (pool != NULL) {
+            pool->checkIn(slot);
+            pool = NULL;
+            slot = -1;
+        }
+    }
+    
+    
+    //load the model once, then build every interpreter up front so no request pays for interpreter creation. They're built
+    //one after another, so with a weight cache the first one writes the file and the rest load it
+    PosenetPool::PosenetPool(const char* pFilename, Device pDevice, int numInterpreters, int pThreadsPerInterpreter,
+    const char* weightCachePath) {
+        threadsPerInterpreter = pThreadsPerInterpreter;
+        model = ModelRegistry::acquire(pFilename);
+        
+        if (!model) {
+            LOGE("PosenetPool: model initialization failed");
+            return;
+        }
+        
+        for (int i = 0; i < numInterpreters; i++) {
+            std::unique_ptr<Posenet> instance(new Posenet(model, pDevice, threadsPerInterpreter, weightCachePath));
+            
+            if (instance->getInterpreter() == NULL) {
+                LOGW("PosenetPool: failed to create interpreter %d, stopping at %d", i, i);
+                break;
+            }
+            
+            instances.push_back(std::move(instance));
+            freeSlots.push_back(i);
+        }
+        
+        checkoutTimes.resize(instances.size());
+        statsStart = chrono::steady_clock::now();
+        
+        LOGI("PosenetPool: %d interpreters x %d threads ready", (int)instances.size(), threadsPerInterpreter);
+    }
+    
+    PosenetPool::~PosenetPool() {
+        //interpreters have to go before the model they point into
+        for (auto &instance : instances) {
+            instance->close();
+        }
+        
+        instances.clear();
+        model.reset();
+    }
+    
+    int PosenetPool::checkOut() {
+        chrono::steady_clock::time_point waitStart = chrono::steady_clock::now();
+        
+        unique_lock<std::mutex> lock(mutex);
+        
+        available.wait(lock, [this] { return !freeSlots.empty(); });
+        
+        int slot = freeSlots.back();
+        freeSlots.pop_back();
+        
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        
+        checkoutTimes[slot] = now;
+        checkouts++;
+        waitNanos += nanosBetween(waitStart, now);
+        
+        return slot;
+    }
+    
+    void PosenetPool::checkIn(int slot) {
+        {
+            lock_guard<std::mutex> lock(mutex);
+            
+            busyNanos += nanosBetween(checkoutTimes[slot], chrono::steady_clock::now());
+            freeSlots.push_back(slot);
+        }
+        
+        available.notify_one();
+    }
+    
+    PosenetPool::Lease PosenetPool::acquire() {
+        if (instances.empty()) {
+            LOGE("acquire(): pool has no interpreters");
+            return Lease();
+        }
+        
+        return Lease(this, checkOut());
+    }
+    
+    bool PosenetPool::tryAcquire(Lease &lease) {
+        //hand back what the lease still holds first: checkIn() takes the mutex, so it can't happen under the lock below
+        lease.release();
+        
+        int slot;
+        
+        {
+            lock_guard<std::mutex> lock(mutex);
+            
+            if (freeSlots.empty()) {
+                return false;
+            }
+            
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            
+            checkoutTimes[slot] = chrono::steady_clock::now();
+            checkouts++;
+        }
+        
+        lease = Lease(this, slot);
+        
+        return true;
+    }
+    
+    Person PosenetPool::estimateSinglePose(const cv::Mat &img) {
+        Lease lease = acquire();
+        
+        if (!lease.valid()) {
+            return Person();
+        }
+        
+        return lease->estimateSinglePose(img);
+    }
+    
+    bool PosenetPool::estimateSinglePose(const cv::Mat &img, Person &person) {
+        Lease lease = acquire();
+        
+        return lease.valid() && lease->estimateSinglePose(img, person);
+    }
+    
+    std::vector<Person> PosenetPool::estimateMultiplePoses(const cv::Mat &img, int maxPoses, float scoreThreshold, float nmsRadius) {
+        Lease lease = acquire();
+        
+        if (!lease.valid()) {
+            return std::vector<Person>();
+        }
+        
+        return lease->estimateMultiplePoses(img, maxPoses, scoreThreshold, nmsRadius);
+    }
+    
+    PoolStats PosenetPool::getStats() {
+        lock_guard<std::mutex> lock(mutex);
+        
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        
+        PoolStats stats;
+        stats.interpreters = (int)instances.size();
+        stats.threadsPerInterpreter = threadsPerInterpreter;
+        stats.inUse = (int)(instances.size() - freeSlots.size());
+        stats.checkouts = checkouts;
+        stats.waitNanos = waitNanos;
+        stats.wallNanos = nanosBetween(statsStart, now);
+        stats.busyNanos = busyNanos;
+        
+        //count the time interpreters that are out right now have been busy too
+        std::vector<bool> isFree(instances.size(), false);
+        
+        for (int slot : freeSlots) {
+            isFree[slot] = true;
+        }
+        
+        for (size_t i = 0; i < instances.size(); i++) {
+            if (!isFree[i]) {
+                stats.busyNanos += nanosBetween(std::max(checkoutTimes[i], statsStart), now);
+            }
+        }
+        
+        if (stats.wallNanos > 0 && stats.interpreters > 0) {
+            stats.utilization = stats.busyNanos / ((double)stats.wallNanos * stats.interpreters);
+        }
+        
+        return stats;
+    }
+    
+    void PosenetPool::resetStats() {
+        lock_guard<std::mutex> lock(mutex);
+        
+        statsStart = chrono::steady_clock::now();
+        checkouts = 0;
+        busyNanos = 0;
+        waitNanos = 0;
+        
+        //time already spent by interpreters that are still checked out belongs to the old window
+        for (auto &checkoutTime : checkoutTimes) {
+            checkoutTime = std::max(checkoutTime, statsStart);
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef POSENET_POOL_H
+#define POSENET_POOL_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "Posenet.h"
+
+
+namespace ORB_SLAM2 {
+
+    //snapshot of how busy a PosenetPool has been since it was created (or since the last resetStats())
+    struct PoolStats {
+        int interpreters = 0;
+        int threadsPerInterpreter = 0;
+        int inUse = 0;
+
+        //how many times an interpreter was checked out
+        uint64_t checkouts = 0;
+
+        //total time interpreters spent checked out / callers spent waiting for one
+        uint64_t busyNanos = 0;
+        uint64_t waitNanos = 0;
+        uint64_t wallNanos = 0;
+
+        //busyNanos / (wallNanos * interpreters), in [0,1]
+        double utilization = 0.0;
+    };
+
+    //N interpreters sharing one loaded TfLiteModel, so N requests can run in parallel (e.g. 16 interpreters x 2 threads each on a
+    //32-core box). Each interpreter is only ever used by the thread that checked it out, so Posenet itself needs no locking.
+    class PosenetPool {
+        public:
+            //RAII checkout of one interpreter; hands it back to the pool when it goes out of scope
+            class Lease {
+                PosenetPool* pool = NULL;
+                int slot = -1;
+
+                public:
+                    Lease();
+                    Lease(PosenetPool* pPool, int pSlot);
+                    Lease(Lease &&other);
+                    Lease& operator=(Lease &&other);
+                    ~Lease();
+
+                    Lease(const Lease&) = delete;
+                    Lease& operator=(const Lease&) = delete;
+
+                    bool valid() const { return pool != NULL; }
+                    Posenet* operator->();
+                    Posenet& operator*();
+
+                    //give the interpreter back early
+                    void release();
+            };
+
+            PosenetPool(const char* pFilename, Device pDevice, int numInterpreters, int threadsPerInterpreter,
+            const char* weightCachePath = NULL);
+            ~PosenetPool();
+
+            PosenetPool(const PosenetPool&) = delete;
+            PosenetPool& operator=(const PosenetPool&) = delete;
+
+            //block until an interpreter is free and check it out
+            Lease acquire();
+
+            //check out an interpreter only if one is free right now (an interpreter the lease still holds is returned first)
+            bool tryAcquire(Lease &lease);
+
+            //convenience wrappers that check out an interpreter for the duration of one call
+            Person estimateSinglePose(const cv::Mat &img);
+            bool estimateSinglePose(const cv::Mat &img, Person &person);
+
+            template <int N>
+            bool estimateSinglePose(const cv::Mat &img, FixedPerson<N> &person) {
+                Lease lease = acquire();
+
+                return lease.valid() && lease->estimateSinglePose(img, person);
+            }
+
+            std::vector<Person> estimateMultiplePoses(const cv::Mat &img, int maxPoses = 10, float scoreThreshold = 0.5f, float nmsRadius = 20.0f);
+
+            int size() const { return (int)instances.size(); }
+            PoolStats getStats();
+            void resetStats();
+
+        private:
+            friend class Lease;
+
+            //the one copy of the weights every interpreter shares (also shared with any other Posenet loaded from the same file)
+            std::shared_ptr<TfLiteModel> model;
+            int threadsPerInterpreter;
+
+            std::vector<std::unique_ptr<Posenet>> instances;
+
+            //indices of instances that aren't checked out, plus when each checked out one was taken
+            std::vector<int> freeSlots;
+            std::vector<std::chrono::steady_clock::time_point> checkoutTimes;
+
+            std::mutex mutex;
+            std::condition_variable available;
+
+            std::chrono::steady_clock::time_point statsStart;
+            uint64_t checkouts = 0;
+            uint64_t busyNanos = 0;
+            uint64_t waitNanos = 0;
+
+            int checkOut();
+            void checkIn(int slot);
+    };
+}
+
+#endif //POSENET_POOL_H
@@ -0,0 +1,318 @@
+#include "PosenetScheduler.h"
+#include <algorithm>
+#include "PosenetLog.h"
+#define LOG_TAG "POSENETSCHEDULER.CC"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+    PosenetScheduler::PosenetScheduler(PosenetPool* pPool, const SchedulerConfig &pConfig) {
+        pool = pPool;
+        config = pConfig;
+    }
+    
+    PosenetScheduler::~PosenetScheduler() {
+        stop();
+    }
+    
+    bool PosenetScheduler::start() {
+        lock_guard<std::mutex> lock(mutex);
+        
+        if (running) {
+            return true;
+        }
+        
+        if (pool->size() == 0) {
+            LOGE("start(): pool has no interpreters");
+            return false;
+        }
+        
+        int numWorkers = (config.numWorkers > 0) ? config.numWorkers : pool->size();
+        
+        running = true;
+        
+        for (int i = 0; i < numWorkers; i++) {
+            workers.push_back(std::thread(&PosenetScheduler::workerLoop, this));
+        }
+        
+        return true;
+    }
+    
+    void PosenetScheduler::stop() {
+        std::vector<std::pair<StreamState*, Job>> pending;
+        
+        {
+            lock_guard<std::mutex> lock(mutex);
+            
+            if (!running) {
+                return;
+            }
+            
+            running = false;
+            
+            for (auto &stream : streams) {
+                for (Job &job : stream->jobs) {
+                    pending.push_back(std::make_pair(stream.get(), std::move(job)));
+                }
+                
+                stream->jobs.clear();
+            }
+            
+            queuedJobs = 0;
+        }
+        
+        work.notify_all();
+        
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+        
+        workers.clear();
+        
+        for (auto &entry : pending) {
+            deliverDropped(entry.first, entry.second);
+        }
+    }
+    
+    int PosenetScheduler::addStream(float weight, std::function<void(const ScheduledResult&)> callback) {
+        lock_guard<std::mutex> lock(mutex);
+        
+        std::unique_ptr<StreamState> stream(new StreamState());
+        stream->id = (int)streams.size();
+        stream->weight = std::max(weight, 1e-3f);
+        stream->virtualTime = virtualClock;
+        stream->callback = callback;
+        stream->startNanos = PosenetStats::nowNanos();
+        stream->stats.reset(new PosenetStats());
+        
+        streams.push_back(std::move(stream));
+        
+        return (int)streams.size() - 1;
+    }
+    
+    void PosenetScheduler::setStreamWeight(int streamId, float weight) {
+        lock_guard<std::mutex> lock(mutex);
+        
+        if (streamId >= 0 && streamId < (int)streams.size()) {
+            streams[streamId]->weight = std::max(weight, 1e-3f);
+        }
+    }
+    
+    int PosenetScheduler::getNumStreams() {
+        lock_guard<std::mutex> lock(mutex);
+        
+        return (int)streams.size();
+    }
+    
+    bool PosenetScheduler::submit(int streamId, const cv::Mat &frame, uint64_t deadlineNanos, int64_t timestamp) {
+        StreamState* stream;
+        Job overflow;
+        bool overflowed = false;
+        
+        {
+            lock_guard<std::mutex> lock(mutex);
+            
+            if (!running || streamId < 0 || streamId >= (int)streams.size()) {
+                return false;
+            }
+            
+            stream = streams[streamId].get();
+            
+            Job job;
+            job.frame = frame;
+            job.submitNanos = PosenetStats::nowNanos();
+            job.deadlineNanos = deadlineNanos;
+            job.timestamp = timestamp;
+            job.sequence = stream->nextSequence++;
+            
+            stream->submitted++;
+            
+            //a stream coming back from idle starts at the current virtual time, not where it left off
+            if (stream->jobs.empty()) {
+                stream->virtualTime = std::max(stream->virtualTime, virtualClock);
+            }
+            
+            //full: make room by giving up the frame closest to (or past) its deadline
+            if ((int)stream->jobs.size() >= std::max(config.maxQueuedPerStream, 1)) {
+                overflow = std::move(stream->jobs.front());
+                stream->jobs.pop_front();
+                queuedJobs--;
+                overflowed = true;
+            }
+            
+            auto position = std::upper_bound(stream->jobs.begin(), stream->jobs.end(), job.deadlineNanos,
+            [](uint64_t deadline, const Job &queued) { return deadline < queued.deadlineNanos; });
+            
+            stream->jobs.insert(position, std::move(job));
+            queuedJobs++;
+        }
+        
+        work.notify_one();
+        
+        if (overflowed) {
+            deliverDropped(stream, overflow);
+        }
+        
+        return true;
+    }
+    
+    bool PosenetScheduler::nextJob(std::vector<std::pair<StreamState*, Job>> &expired, StreamState* &stream, Job &job) {
+        uint64_t now = PosenetStats::nowNanos();
+        
+        //drop whatever can no longer make it, and find how far behind the most underserved busy stream is
+        double minVirtualTime = 0.0;
+        bool anyWaiting = false;
+        
+        for (auto &candidate : streams) {
+            while (!candidate->jobs.empty() && candidate->jobs.front().deadlineNanos < now) {
+                expired.push_back(std::make_pair(candidate.get(), std::move(candidate->jobs.front())));
+                candidate->jobs.pop_front();
+                queuedJobs--;
+            }
+            
+            if (!candidate->jobs.empty()) {
+                minVirtualTime = anyWaiting ? std::min(minVirtualTime, candidate->virtualTime) : candidate->virtualTime;
+                anyWaiting = true;
+            }
+        }
+        
+        if (!anyWaiting) {
+            return false;
+        }
+        
+        //earliest deadline among the streams that aren't too far ahead of their share (ties go to the less served stream)
+        StreamState* best = NULL;
+        
+        for (auto &candidate : streams) {
+            if (candidate->jobs.empty() || candidate->virtualTime > minVirtualTime + config.fairnessSlack) {
+                continue;
+            }
+            
+            if (best == NULL || candidate->jobs.front().deadlineNanos < best->jobs.front().deadlineNanos ||
+            (candidate->jobs.front().deadlineNanos == best->jobs.front().deadlineNanos && candidate->virtualTime < best->virtualTime)) {
+                best = candidate.get();
+            }
+        }
+        
+        stream = best;
+        job = std::move(best->jobs.front());
+        best->jobs.pop_front();
+        queuedJobs--;
+        
+        virtualClock = std::max(virtualClock, best->virtualTime);
+        best->virtualTime += 1.0 / best->weight;
+        
+        return true;
+    }
+    
+    void PosenetScheduler::deliverDropped(StreamState* stream, const Job &job) {
+        stream->stats->increment(Counter::DROPPED_FRAMES);
+        
+        if (!stream->callback) {
+            return;
+        }
+        
+        ScheduledResult result;
+        result.streamId = stream->id;
+        result.timestamp = job.timestamp;
+        result.sequence = job.sequence;
+        result.deadlineNanos = job.deadlineNanos;
+        result.dropped = true;
+        
+        stream->callback(result);
+    }
+    
+    void PosenetScheduler::workerLoop() {
+        std::vector<std::pair<StreamState*, Job>> expired;
+        
+        while (true) {
+            StreamState* stream = NULL;
+            Job job;
+            bool picked;
+            
+            {
+                unique_lock<std::mutex> lock(mutex);
+                
+                work.wait(lock, [this] { return !running || queuedJobs > 0; });
+                
+                if (!running) {
+                    return;
+                }
+                
+                picked = nextJob(expired, stream, job);
+            }
+            
+            for (auto &entry : expired) {
+                deliverDropped(entry.first, entry.second);
+            }
+            
+            expired.clear();
+            
+            if (!picked) {
+                continue;
+            }
+            
+            ScheduledResult result;
+            result.streamId = stream->id;
+            result.timestamp = job.timestamp;
+            result.sequence = job.sequence;
+            result.deadlineNanos = job.deadlineNanos;
+            
+            bool ok;
+            
+            {
+                PosenetPool::Lease lease = pool->acquire();
+                ok = lease.valid() && lease->estimateSinglePose(job.frame, result.person);
+            }
+            
+            uint64_t endNanos = PosenetStats::nowNanos();
+            
+            if (!ok) {
+                result.failed = true;
+                stream->stats->increment(Counter::FAILURES);
+            }
+            else {
+                stream->stats->recordSpan(Stage::TOTAL, job.submitNanos, endNanos);
+                stream->stats->increment(Counter::FRAMES);
+                
+                if (endNanos > job.deadlineNanos) {
+                    result.late = true;
+                    stream->stats->increment(Counter::LATE_FRAMES);
+                }
+            }
+            
+            if (stream->callback) {
+                stream->callback(result);
+            }
+        }
+    }
+    
+    SchedulerStreamStats PosenetScheduler::getStreamStats(int streamId) {
+        lock_guard<std::mutex> lock(mutex);
+        
+        SchedulerStreamStats streamStats;
+        
+        if (streamId < 0 || streamId >= (int)streams.size()) {
+            return streamStats;
+        }
+        
+        StreamState* stream = streams[streamId].get();
+        uint64_t now = PosenetStats::nowNanos();
+        
+        streamStats.weight = stream->weight;
+        streamStats.queued = (int)stream->jobs.size();
+        streamStats.submitted = stream->submitted;
+        streamStats.completed = stream->stats->getCounter(Counter::FRAMES);
+        streamStats.dropped = stream->stats->getCounter(Counter::DROPPED_FRAMES);
+        streamStats.late = stream->stats->getCounter(Counter::LATE_FRAMES);
+        streamStats.failed = stream->stats->getCounter(Counter::FAILURES);
+        streamStats.latency = stream->stats->getSummary(Stage::TOTAL);
+        
+        if (now > stream->startNanos) {
+            streamStats.framesPerSecond = streamStats.completed * 1e9 / (double)(now - stream->startNanos);
+        }
+        
+        return streamStats;
+    }
+}
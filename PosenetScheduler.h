@@ -0,0 +1,147 @@
+#ifndef POSENET_SCHEDULER_H
+#define POSENET_SCHEDULER_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+
+#include "PosenetPool.h"
+
+
+namespace ORB_SLAM2 {
+
+    //one frame's worth of output from a PosenetScheduler
+    struct ScheduledResult {
+        int streamId = -1;
+        Person person;
+        int64_t timestamp = 0;
+        uint64_t sequence = 0;
+        uint64_t deadlineNanos = 0;
+
+        //true if the frame was dropped without running: its deadline passed while it waited, or its stream's queue overflowed
+        bool dropped = false;
+
+        //true if the frame ran but finished after its deadline
+        bool late = false;
+
+        //true if inference or decoding failed (person is empty); failed frames don't count as completed
+        bool failed = false;
+    };
+
+    struct SchedulerConfig {
+        //threads dispatching frames to the pool (0 = one per pool interpreter)
+        int numWorkers = 0;
+
+        //frames one stream may have waiting; past that its earliest-deadline waiting frame is dropped to make room
+        int maxQueuedPerStream = 4;
+
+        //how far (in frames, scaled by weight) a stream may run ahead of its fair share before the other streams are served first
+        //regardless of deadlines. 0 is strict weighted round robin; larger lets deadlines matter more
+        double fairnessSlack = 2.0;
+    };
+
+    //per-stream counters from a PosenetScheduler
+    struct SchedulerStreamStats {
+        float weight = 1.0f;
+        int queued = 0;
+
+        uint64_t submitted = 0;
+        uint64_t completed = 0;
+        uint64_t dropped = 0;
+        uint64_t late = 0;
+        uint64_t failed = 0;
+
+        //completed frames per second since the stream was added
+        double framesPerSecond = 0.0;
+
+        //submit-to-result latency of completed frames
+        StageSummary latency;
+    };
+
+    //shares one PosenetPool between many camera streams. Frames are submitted with their stream id and an absolute deadline
+    //(PosenetStats::nowNanos() clock); worker threads hand them to free interpreters earliest-deadline-first, within a weighted
+    //fair share per stream (start-time fair queuing on a virtual clock, so a busy stream can't starve the others), and frames
+    //whose deadline has already passed are dropped instead of run. submit() may be called from any thread. Results come back
+    //through each stream's callback, from the worker threads, so with several workers a stream's results can arrive out of order
+    //(ScheduledResult::sequence says which frame it was).
+    class PosenetScheduler {
+        public:
+            PosenetScheduler(PosenetPool* pPool, const SchedulerConfig &pConfig = SchedulerConfig());
+            ~PosenetScheduler();
+
+            PosenetScheduler(const PosenetScheduler&) = delete;
+            PosenetScheduler& operator=(const PosenetScheduler&) = delete;
+
+            bool start();
+
+            //stop the workers; frames still waiting are delivered as dropped
+            void stop();
+
+            //register a stream, getting back its id. weight is its share of the interpreters relative to the other streams
+            int addStream(float weight = 1.0f, std::function<void(const ScheduledResult&)> callback = nullptr);
+            void setStreamWeight(int streamId, float weight);
+
+            //queue a frame (the Mat is shared, not copied, so don't write into it until its result arrives). Returns false if the
+            //scheduler isn't running or the stream doesn't exist
+            bool submit(int streamId, const cv::Mat &frame, uint64_t deadlineNanos, int64_t timestamp = 0);
+
+            SchedulerStreamStats getStreamStats(int streamId);
+            int getNumStreams();
+
+        private:
+            struct Job {
+                cv::Mat frame;
+                uint64_t submitNanos = 0;
+                uint64_t deadlineNanos = 0;
+                int64_t timestamp = 0;
+                uint64_t sequence = 0;
+            };
+
+            struct StreamState {
+                int id = 0;
+                float weight = 1.0f;
+
+                //virtual time this stream has been served up to: each dispatched frame advances it by 1 / weight
+                double virtualTime = 0.0;
+
+                //waiting frames, earliest deadline first
+                std::deque<Job> jobs;
+
+                std::function<void(const ScheduledResult&)> callback;
+                uint64_t nextSequence = 0;
+                uint64_t submitted = 0;
+                uint64_t startNanos = 0;
+
+                //TOTAL = submit-to-result latency, FRAMES / DROPPED_FRAMES / LATE_FRAMES counters
+                std::unique_ptr<PosenetStats> stats;
+            };
+
+            PosenetPool* pool;
+            SchedulerConfig config;
+
+            std::vector<std::unique_ptr<StreamState>> streams;
+            int queuedJobs = 0;
+
+            //start tag of the most recently dispatched frame; streams that were idle restart from here instead of cashing in
+            //the share they didn't use
+            double virtualClock = 0.0;
+
+            std::mutex mutex;
+            std::condition_variable work;
+            bool running = false;
+            std::vector<std::thread> workers;
+
+            //with the lock held: move expired frames into expired, then pick the next frame to run (false if none)
+            bool nextJob(std::vector<std::pair<StreamState*, Job>> &expired, StreamState* &stream, Job &job);
+            void deliverDropped(StreamState* stream, const Job &job);
+
+            void workerLoop();
+    };
+}
+
+#endif //POSENET_SCHEDULER_H
@@ -0,0 +1,169 @@
+#include "PosenetStats.h"
+
+namespace ORB_SLAM2
+{
+    LatencyHistogram::LatencyHistogram(uint64_t pWindowNanos) {
+        windowNanos = pWindowNanos;
+        reset();
+    }
+    
+    //exponent of the top bit picks the power of two, the next SUB_BUCKET_BITS bits pick the linear sub-bucket within it
+    int LatencyHistogram::bucketFor(uint64_t nanos) {
+        if (nanos < (1ull << MIN_EXPONENT)) {
+            return 0;
+        }
+        
+        int exponent = 63 - __builtin_clzll(nanos);
+        
+        if (exponent >= MAX_EXPONENT) {
+            return NUM_BUCKETS - 1;
+        }
+        
+        int subBucket = (int)((nanos >> (exponent - SUB_BUCKET_BITS)) & ((1 << SUB_BUCKET_BITS) - 1));
+        
+        return ((exponent - MIN_EXPONENT) << SUB_BUCKET_BITS) | subBucket;
+    }
+    
+    uint64_t LatencyHistogram::bucketMidpoint(int bucket) {
+        int exponent = (bucket >> SUB_BUCKET_BITS) + MIN_EXPONENT;
+        uint64_t subBucket = bucket & ((1 << SUB_BUCKET_BITS) - 1);
+        uint64_t width = 1ull << (exponent - SUB_BUCKET_BITS);
+        
+        return (1ull << exponent) + subBucket * width + width / 2;
+    }
+    
+    void LatencyHistogram::record(uint64_t nanos, uint64_t nowNanos) {
+        uint64_t epoch = nowNanos / windowNanos;
+        Window &window = windows[epoch % NUM_WINDOWS];
+        
+        //first sample in a new time slice recycles the slot. A sample recorded concurrently with the clear can be lost, which is
+        //fine for monitoring and keeps this path lock-free.
+        uint64_t windowEpoch = window.epoch.load(std::memory_order_relaxed);
+        
+        if (windowEpoch != epoch && window.epoch.compare_exchange_strong(windowEpoch, epoch, std::memory_order_relaxed)) {
+            window.count.store(0, std::memory_order_relaxed);
+            window.sumNanos.store(0, std::memory_order_relaxed);
+            
+            for (int i = 0; i < NUM_BUCKETS; i++) {
+                window.buckets[i].store(0, std::memory_order_relaxed);
+            }
+        }
+        
+        window.buckets[bucketFor(nanos)].fetch_add(1, std::memory_order_relaxed);
+        window.count.fetch_add(1, std::memory_order_relaxed);
+        window.sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+    }
+    
+    StageSummary LatencyHistogram::summarize(uint64_t nowNanos) const {
+        StageSummary summary;
+        
+        uint64_t currentEpoch = nowNanos / windowNanos;
+        uint64_t merged[NUM_BUCKETS] = {0};
+        uint64_t sumNanos = 0;
+        
+        //merge the slices that are still inside the rolling window
+        for (int w = 0; w < NUM_WINDOWS; w++) {
+            const Window &window = windows[w];
+            uint64_t epoch = window.epoch.load(std::memory_order_relaxed);
+            
+            if (epoch == UINT64_MAX || epoch + NUM_WINDOWS <= currentEpoch) {
+                continue;
+            }
+            
+            for (int i = 0; i < NUM_BUCKETS; i++) {
+                merged[i] += window.buckets[i].load(std::memory_order_relaxed);
+            }
+            
+            sumNanos += window.sumNanos.load(std::memory_order_relaxed);
+        }
+        
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            summary.count += merged[i];
+        }
+        
+        if (summary.count == 0) {
+            return summary;
+        }
+        
+        summary.meanNanos = sumNanos / (double)summary.count;
+        
+        //walk the cumulative counts to find the bucket each percentile falls in
+        uint64_t p50Rank = (summary.count * 50 + 99) / 100;
+        uint64_t p95Rank = (summary.count * 95 + 99) / 100;
+        uint64_t p99Rank = (summary.count * 99 + 99) / 100;
+        uint64_t seen = 0;
+        
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            if (merged[i] == 0) {
+                continue;
+            }
+            
+            uint64_t before = seen;
+            seen += merged[i];
+            
+            if (before < p50Rank && seen >= p50Rank) {
+                summary.p50Nanos = bucketMidpoint(i);
+            }
+            
+            if (before < p95Rank && seen >= p95Rank) {
+                summary.p95Nanos = bucketMidpoint(i);
+            }
+            
+            if (before < p99Rank && seen >= p99Rank) {
+                summary.p99Nanos = bucketMidpoint(i);
+            }
+        }
+        
+        return summary;
+    }
+    
+    void LatencyHistogram::reset() {
+        for (int w = 0; w < NUM_WINDOWS; w++) {
+            //no epoch yet, so the first record() claims the slot
+            windows[w].epoch.store(UINT64_MAX, std::memory_order_relaxed);
+            windows[w].count.store(0, std::memory_order_relaxed);
+            windows[w].sumNanos.store(0, std::memory_order_relaxed);
+            
+            for (int i = 0; i < NUM_BUCKETS; i++) {
+                windows[w].buckets[i].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    
+    PosenetStats::PosenetStats() {
+        for (int i = 0; i < (int)Counter::NUM_COUNTERS; i++) {
+            counters[i].store(0);
+        }
+    }
+    
+    void PosenetStats::record(Stage stage, uint64_t nanos) {
+        histograms[(int)stage].record(nanos, nowNanos());
+    }
+    
+    void PosenetStats::recordSpan(Stage stage, uint64_t startNanos, uint64_t endNanos) {
+        histograms[(int)stage].record(endNanos - startNanos, endNanos);
+    }
+    
+    void PosenetStats::increment(Counter counter, uint64_t amount) {
+        counters[(int)counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+    
+    StageSummary PosenetStats::getSummary(Stage stage) const {
+        return histograms[(int)stage].summarize(nowNanos());
+    }
+    
+    uint64_t PosenetStats::getCounter(Counter counter) const {
+        return counters[(int)counter].load(std::memory_order_relaxed);
+    }
+    
+    void PosenetStats::reset() {
+        for (int i = 0; i < (int)Stage::NUM_STAGES; i++) {
+            histograms[i].reset();
+        }
+        
+        for (int i = 0; i < (int)Counter::NUM_COUNTERS; i++) {
+            counters[i].store(0);
+        }
+    }
+}
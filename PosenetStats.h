@@ -0,0 +1,134 @@
+#ifndef POSENET_STATS_H
+#define POSENET_STATS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+
+namespace ORB_SLAM2 {
+
+    //the timed steps of one inference
+    enum class Stage {
+        PREPROCESS,
+        INPUT_COPY,
+        INVOKE,
+        OUTPUT_READ,
+        DECODE,
+        TOTAL,
+        NUM_STAGES
+    };
+
+    //event counters
+    enum class Counter {
+        FRAMES,
+        FAILURES,
+        DROPPED_FRAMES,
+
+        //tracking mode: frames run on the crop around the previous pose, and times the pose was lost (back to the full frame)
+        TRACKED_FRAMES,
+        TRACKING_LOST,
+
+        //stream motion gating: frames whose pose was predicted instead of inferred
+        SKIPPED_FRAMES,
+
+        //scheduler: frames that finished, but after their deadline
+        LATE_FRAMES,
+        NUM_COUNTERS
+    };
+
+    //percentiles etc. of one stage over the rolling window
+    struct StageSummary {
+        uint64_t count = 0;
+        double meanNanos = 0.0;
+        uint64_t p50Nanos = 0;
+        uint64_t p95Nanos = 0;
+        uint64_t p99Nanos = 0;
+    };
+
+    //lock-free latency histogram over a rolling window. Buckets are log-linear (8 per power of two, so about 9% relative
+    //resolution) from 64ns to ~68s, and samples land in one of NUM_WINDOWS time slices that get recycled as time moves on, so the
+    //percentiles cover the last NUM_WINDOWS * windowNanos. Recording is a couple of relaxed atomic adds.
+    class LatencyHistogram {
+        public:
+            static const int SUB_BUCKET_BITS = 3;
+            static const int MIN_EXPONENT = 6;
+            static const int MAX_EXPONENT = 36;
+            static const int NUM_BUCKETS = (MAX_EXPONENT - MIN_EXPONENT) << SUB_BUCKET_BITS;
+            static const int NUM_WINDOWS = 4;
+
+            explicit LatencyHistogram(uint64_t pWindowNanos = 15000000000ull);
+
+            LatencyHistogram(const LatencyHistogram&) = delete;
+            LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+            void record(uint64_t nanos, uint64_t nowNanos);
+
+            //summary of every sample in windows that haven't expired as of nowNanos
+            StageSummary summarize(uint64_t nowNanos) const;
+
+            void reset();
+
+        private:
+            struct Window {
+                std::atomic<uint64_t> epoch;
+                std::atomic<uint64_t> count;
+                std::atomic<uint64_t> sumNanos;
+                std::atomic<uint32_t> buckets[NUM_BUCKETS];
+            };
+
+            uint64_t windowNanos;
+            Window windows[NUM_WINDOWS];
+
+            static int bucketFor(uint64_t nanos);
+            static uint64_t bucketMidpoint(int bucket);
+    };
+
+    //per-stage latency histograms plus counters for a Posenet (or anything built on one). Safe to record from several threads
+    //and to read from another while recording.
+    class PosenetStats {
+        public:
+            PosenetStats();
+
+            PosenetStats(const PosenetStats&) = delete;
+            PosenetStats& operator=(const PosenetStats&) = delete;
+
+            void record(Stage stage, uint64_t nanos);
+
+            //record end - start, reusing end as the current time
+            void recordSpan(Stage stage, uint64_t startNanos, uint64_t endNanos);
+            void increment(Counter counter, uint64_t amount = 1);
+
+            StageSummary getSummary(Stage stage) const;
+            uint64_t getCounter(Counter counter) const;
+
+            void reset();
+
+            //monotonic timestamp in nanoseconds (steady_clock, so never affected by wall-clock changes)
+            static inline uint64_t nowNanos() {
+                return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+        private:
+            LatencyHistogram histograms[(int)Stage::NUM_STAGES];
+            std::atomic<uint64_t> counters[(int)Counter::NUM_COUNTERS];
+    };
+
+    //records the time between its construction and destruction into one stage
+    class StageTimer {
+        PosenetStats* stats;
+        Stage stage;
+        uint64_t start;
+
+        public:
+            StageTimer(PosenetStats* pStats, Stage pStage) : stats(pStats), stage(pStage), start(PosenetStats::nowNanos())
+            {}
+
+            ~StageTimer() {
+                stats->recordSpan(stage, start, PosenetStats::nowNanos());
+            }
+    };
+}
+
+#endif //POSENET_STATS_H
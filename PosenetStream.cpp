@@ -0,0 +1,471 @@
+#include "PosenetStream.h"
+#include <string.h>
+#include <chrono>
+#include "PosenetLog.h"
+#define LOG_TAG "POSENETSTREAM.CC"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+    //wait a little longer each time a queue comes up empty/full: spin first (cheap when the other side is about to deliver),
+    //then yield, then sleep so idle workers don't burn a core
+    static void backoff(int &attempts) {
+        attempts++;
+        
+        if (attempts < 64) {
+            return;
+        }
+        
+        if (attempts < 128) {
+            std::this_thread::yield();
+            return;
+        }
+        
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    
+    
+    PosenetStream::PosenetStream(Posenet* pPosenet, const StreamConfig &pConfig)
+    : posenet(pPosenet), stats(&pPosenet->getStats()), config(pConfig),
+      //leave slack in the frame ring so DROP_OLDEST can trim on the consumer side before the producer ever sees it full
+      frames(config.policy == BackpressurePolicy::DROP_OLDEST ? 2 * config.maxQueuedFrames + 1 : config.maxQueuedFrames),
+      preprocessed(config.numInputBuffers), inferred(config.numOutputBuffers),
+      freeInputs(config.numInputBuffers), freeOutputs(config.numOutputBuffers),
+      running(false), poseFilter(config.motionGate.filter, config.motionGate.oneEuro),
+      submitted(0), completed(0), dropped(0), skipped(0) {
+    }
+    
+    PosenetStream::~PosenetStream() {
+        stop();
+    }
+    
+    //size the staging buffers from the model and spin up the three workers
+    bool PosenetStream::start() {
+        if (running.load()) {
+            return true;
+        }
+        
+        if (posenet->getBackend() == NULL || !posenet->setBatchSize(1)) {
+            LOGE("start(): no backend available");
+            return false;
+        }
+        
+        TensorView heatmaps = posenet->getOutputView(0);
+        TensorView offsets = posenet->getOutputView(1);
+        
+        if (heatmaps.empty() || offsets.empty()) {
+            LOGE("start(): couldn't read output tensor shapes");
+            return false;
+        }
+        
+        heatmapsLayout = heatmaps;
+        offsetsLayout = offsets;
+        
+        heatmapsBytes = (size_t)heatmaps.height() * heatmaps.width() * heatmaps.channels() * heatmaps.elementSize();
+        offsetsBytes = (size_t)offsets.height() * offsets.width() * offsets.channels() * offsets.elementSize();
+        
+        inputBuffers.assign(config.numInputBuffers, std::vector<uint8_t>(posenet->getInputBytes()));
+        outputBuffers.assign(config.numOutputBuffers, std::vector<uint8_t>(heatmapsBytes + offsetsBytes));
+        
+        for (int i = 0; i < config.numInputBuffers; i++) {
+            freeInputs.tryPush(i);
+        }
+        
+        for (int i = 0; i < config.numOutputBuffers; i++) {
+            freeOutputs.tryPush(i);
+        }
+        
+        //the motion gate starts over: the first frame always goes to the model
+        MotionGateConfig &gate = config.motionGate;
+        gate.thumbnailRows = std::max(gate.thumbnailRows, 1);
+        gate.thumbnailCols = std::min(std::max(gate.thumbnailCols, 1), MAX_THUMBNAIL_COLS);
+        
+        thumbnail.assign((size_t)gate.thumbnailRows * gate.thumbnailCols, 0);
+        referenceThumbnail.assign(thumbnail.size(), 0);
+        referenceRows = 0;
+        referenceCols = 0;
+        skippedInARow = 0;
+        poseFilter.reset();
+        
+        running.store(true);
+        
+        preprocessThread = std::thread(&PosenetStream::preprocessLoop, this);
+        inferThread = std::thread(&PosenetStream::inferLoop, this);
+        decodeThread = std::thread(&PosenetStream::decodeLoop, this);
+        
+        return true;
+    }
+    
+    void PosenetStream::stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        
+        preprocessThread.join();
+        inferThread.join();
+        decodeThread.join();
+        
+        //anything still queued between stages never gets a result
+        FrameItem frame;
+        
+        while (frames.tryPop(frame)) {
+            deliverDropped(frame.timestamp, frame.sequence, frame.promise);
+        }
+        
+        StageItem item;
+        
+        while (preprocessed.tryPop(item)) {
+            deliverDropped(item.timestamp, item.sequence, item.promise);
+        }
+        
+        while (inferred.tryPop(item)) {
+            deliverDropped(item.timestamp, item.sequence, item.promise);
+        }
+        
+        //reset the free lists for a later start()
+        int buffer;
+        
+        while (freeInputs.tryPop(buffer)) {
+        }
+        
+        while (freeOutputs.tryPop(buffer)) {
+        }
+    }
+    
+    bool PosenetStream::enqueue(FrameItem &item) {
+        submitted++;
+        
+        if (!running.load()) {
+            deliverDropped(item.timestamp, item.sequence, item.promise);
+            return false;
+        }
+        
+        if (config.policy == BackpressurePolicy::BLOCK) {
+            int attempts = 0;
+            
+            while (!frames.tryPush(item)) {
+                if (!running.load()) {
+                    deliverDropped(item.timestamp, item.sequence, item.promise);
+                    return false;
+                }
+                
+                backoff(attempts);
+            }
+            
+            return true;
+        }
+        
+        //DROP_NEWEST, or DROP_OLDEST when the preprocess stage is so far behind that even the slack is used up
+        if (!frames.tryPush(item)) {
+            deliverDropped(item.timestamp, item.sequence, item.promise);
+            return false;
+        }
+        
+        return true;
+    }
+    
+    bool PosenetStream::submit(const cv::Mat &frame, int64_t timestamp) {
+        FrameItem item;
+        item.frame = frame;
+        item.submitNanos = PosenetStats::nowNanos();
+        item.timestamp = timestamp;
+        item.sequence = nextSequence++;
+        
+        return enqueue(item);
+    }
+    
+    std::future<StreamResult> PosenetStream::submitAsync(const cv::Mat &frame, int64_t timestamp) {
+        FrameItem item;
+        item.frame = frame;
+        item.submitNanos = PosenetStats::nowNanos();
+        item.timestamp = timestamp;
+        item.sequence = nextSequence++;
+        item.promise.reset(new std::promise<StreamResult>());
+        
+        std::future<StreamResult> future = item.promise->get_future();
+        
+        enqueue(item);
+        
+        return future;
+    }
+    
+    void PosenetStream::deliver(StreamResult &result, std::unique_ptr<std::promise<StreamResult>> &promise) {
+        if (config.callback) {
+            config.callback(result);
+        }
+        
+        if (promise) {
+            promise->set_value(result);
+            promise.reset();
+        }
+    }
+    
+    void PosenetStream::deliverDropped(int64_t timestamp, uint64_t sequence, std::unique_ptr<std::promise<StreamResult>> &promise) {
+        dropped++;
+        stats->increment(Counter::DROPPED_FRAMES);
+        
+        StreamResult result;
+        result.timestamp = timestamp;
+        result.sequence = sequence;
+        result.dropped = true;
+        
+        deliver(result, promise);
+    }
+    
+    //hand an item to the next stage, waiting for room (skipped frames don't hold a staging buffer, so they aren't bounded by the
+    //buffer count). Returns false, reporting the frame as dropped, if the stream stops first
+    bool PosenetStream::pushStage(SpscQueue<StageItem> &queue, StageItem &item) {
+        int attempts = 0;
+        
+        while (!queue.tryPush(item)) {
+            if (!running.load()) {
+                deliverDropped(item.timestamp, item.sequence, item.promise);
+                return false;
+            }
+            
+            backoff(attempts);
+        }
+        
+        return true;
+    }
+    
+    //motion gate (preprocess thread): thumbnail the frame and compare it with the last frame that went to the model
+    bool PosenetStream::skipFrame(const cv::Mat &frame, float &motion) {
+        const MotionGateConfig &gate = config.motionGate;
+        
+        //no thumbnail for this frame, so the next one has nothing current to compare against either
+        if (frame.empty() || frame.depth() != CV_8U) {
+            thumbnailReady = false;
+            referenceRows = 0;
+            referenceCols = 0;
+            return false;
+        }
+        
+        motionThumbnail(frame.data, frame.step, frame.rows, frame.cols, frame.channels(), gate.thumbnailRows, gate.thumbnailCols,
+        thumbnail.data());
+        thumbnailReady = true;
+        
+        //nothing to compare against yet (or the stream changed size)
+        if (frame.rows != referenceRows || frame.cols != referenceCols) {
+            return false;
+        }
+        
+        motion = meanAbsDifference(thumbnail.data(), referenceThumbnail.data(), (int)thumbnail.size());
+        
+        if (motion >= gate.threshold || skippedInARow >= gate.maxSkippedFrames) {
+            return false;
+        }
+        
+        skippedInARow++;
+        
+        return true;
+    }
+    
+    //stage 1: resize/normalize frames into a free input buffer
+    void PosenetStream::preprocessLoop() {
+        //a staging buffer we hold on to until a frame has been successfully preprocessed into it (only the infer stage pushes to
+        //freeInputs)
+        int buffer = -1;
+        
+        while (running.load()) {
+            //grab a free staging buffer first, so the frame we pick is as fresh as possible
+            int attempts = 0;
+            
+            while (buffer < 0 && !freeInputs.tryPop(buffer)) {
+                buffer = -1;
+                
+                if (!running.load()) {
+                    return;
+                }
+                
+                backoff(attempts);
+            }
+            
+            FrameItem frame;
+            attempts = 0;
+            
+            while (true) {
+                //skip frames that went stale while we were waiting
+                if (config.policy == BackpressurePolicy::DROP_OLDEST) {
+                    while (frames.size() > (size_t)config.maxQueuedFrames && frames.tryPop(frame)) {
+                        deliverDropped(frame.timestamp, frame.sequence, frame.promise);
+                    }
+                }
+                
+                if (frames.tryPop(frame)) {
+                    break;
+                }
+                
+                if (!running.load()) {
+                    return;
+                }
+                
+                backoff(attempts);
+            }
+            
+            StageItem item;
+            item.rows = frame.frame.rows;
+            item.cols = frame.frame.cols;
+            item.submitNanos = frame.submitNanos;
+            item.timestamp = frame.timestamp;
+            item.sequence = frame.sequence;
+            item.promise = std::move(frame.promise);
+            
+            //barely changed since the last inferred frame: skip the model (and keep the staging buffer for the next frame)
+            if (config.motionGate.enabled && skipFrame(frame.frame, item.motion)) {
+                item.skipped = true;
+                pushStage(preprocessed, item);
+                continue;
+            }
+            
+            uint64_t preprocessStartNanos = PosenetStats::nowNanos();
+            
+            if (!posenet->preprocessInput(frame.frame, inputBuffers[buffer].data())) {
+                stats->increment(Counter::FAILURES);
+                deliverDropped(item.timestamp, item.sequence, item.promise);
+                continue;
+            }
+            
+            stats->recordSpan(Stage::PREPROCESS, preprocessStartNanos, PosenetStats::nowNanos());
+            
+            //this frame is what later ones get compared against
+            if (config.motionGate.enabled && thumbnailReady) {
+                referenceThumbnail.swap(thumbnail);
+                referenceRows = item.rows;
+                referenceCols = item.cols;
+                skippedInARow = 0;
+            }
+            
+            item.buffer = buffer;
+            buffer = -1;
+            
+            pushStage(preprocessed, item);
+        }
+    }
+    
+    //stage 2: copy a staged input into the input tensor, invoke, and copy the outputs we decode into a free output buffer
+    void PosenetStream::inferLoop() {
+        InferenceBackend* backend = posenet->getBackend();
+        size_t inputBytes = backend->getInputView().byteSize();
+        
+        while (running.load()) {
+            StageItem item;
+            int attempts = 0;
+            
+            while (!preprocessed.tryPop(item)) {
+                if (!running.load()) {
+                    return;
+                }
+                
+                backoff(attempts);
+            }
+            
+            //nothing to run; just keep it in order for the decode stage
+            if (item.skipped) {
+                pushStage(inferred, item);
+                continue;
+            }
+            
+            uint64_t copyStartNanos = PosenetStats::nowNanos();
+            
+            bool copied = backend->setInput(inputBuffers[item.buffer].data(), inputBytes);
+            
+            stats->recordSpan(Stage::INPUT_COPY, copyStartNanos, PosenetStats::nowNanos());
+            
+            //the staging buffer can be refilled while we invoke
+            freeInputs.tryPush(item.buffer);
+            
+            if (!copied || !posenet->invoke()) {
+                LOGE("inferLoop(): inference failed for frame %llu", (unsigned long long)item.sequence);
+                deliverDropped(item.timestamp, item.sequence, item.promise);
+                continue;
+            }
+            
+            int buffer;
+            attempts = 0;
+            
+            while (!freeOutputs.tryPop(buffer)) {
+                if (!running.load()) {
+                    deliverDropped(item.timestamp, item.sequence, item.promise);
+                    return;
+                }
+                
+                backoff(attempts);
+            }
+            
+            uint64_t readStartNanos = PosenetStats::nowNanos();
+            
+            TensorView heatmaps = posenet->getOutputView(0);
+            TensorView offsets = posenet->getOutputView(1);
+            
+            uint8_t* out = outputBuffers[buffer].data();
+            memcpy(out, heatmaps.buffer(), heatmapsBytes);
+            memcpy(out + heatmapsBytes, offsets.buffer(), offsetsBytes);
+            
+            stats->recordSpan(Stage::OUTPUT_READ, readStartNanos, PosenetStats::nowNanos());
+            
+            item.buffer = buffer;
+            pushStage(inferred, item);
+        }
+    }
+    
+    //stage 3: decode the Person from an output buffer and hand it to the caller
+    void PosenetStream::decodeLoop() {
+        while (running.load()) {
+            StageItem item;
+            int attempts = 0;
+            
+            while (!inferred.tryPop(item)) {
+                if (!running.load()) {
+                    return;
+                }
+                
+                backoff(attempts);
+            }
+            
+            StreamResult result;
+            result.timestamp = item.timestamp;
+            result.sequence = item.sequence;
+            result.motion = item.motion;
+            
+            double seconds = item.timestamp / config.motionGate.timestampsPerSecond;
+            
+            if (item.skipped) {
+                result.skipped = true;
+                poseFilter.predict(seconds, result.person);
+                
+                skipped++;
+                stats->increment(Counter::SKIPPED_FRAMES);
+                
+                completed++;
+                deliver(result, item.promise);
+                continue;
+            }
+            
+            const uint8_t* out = outputBuffers[item.buffer].data();
+            
+            TensorView heatmaps = heatmapsLayout.rebased(out);
+            TensorView offsets = offsetsLayout.rebased(out + heatmapsBytes);
+            
+            uint64_t decodeStartNanos = PosenetStats::nowNanos();
+            
+            result.person = posenet->decodeSinglePose(heatmaps, offsets, item.rows, item.cols);
+            
+            freeOutputs.tryPush(item.buffer);
+            
+            if (config.motionGate.enabled) {
+                poseFilter.update(result.person, seconds);
+            }
+            
+            uint64_t endNanos = PosenetStats::nowNanos();
+            
+            stats->recordSpan(Stage::DECODE, decodeStartNanos, endNanos);
+            stats->recordSpan(Stage::TOTAL, item.submitNanos, endNanos);
+            stats->increment(Counter::FRAMES);
+            
+            completed++;
+            deliver(result, item.promise);
+        }
+    }
+}
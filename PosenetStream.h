@@ -0,0 +1,200 @@
+#ifndef POSENET_STREAM_H
+#define POSENET_STREAM_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <functional>
+
+#include "Posenet.h"
+#include "PoseFilter.h"
+#include "SpscQueue.h"
+
+
+namespace ORB_SLAM2 {
+
+    //what submit() does when frames arrive faster than the pipeline can take them
+    enum class BackpressurePolicy {
+        //wait for room in the queue (no frames are lost, but latency grows)
+        BLOCK,
+
+        //skip stale queued frames so the pipeline always works on the newest ones (bounded latency for live cameras)
+        DROP_OLDEST,
+
+        //refuse the incoming frame
+        DROP_NEWEST
+    };
+
+    //one frame's worth of output from a PosenetStream
+    struct StreamResult {
+        Person person;
+        int64_t timestamp = 0;
+        uint64_t sequence = 0;
+
+        //true if the frame was dropped under backpressure (person is empty)
+        bool dropped = false;
+
+        //true if the motion gate skipped inference for this frame: person was predicted from earlier frames (empty if there were
+        //none yet)
+        bool skipped = false;
+
+        //the motion gate's frame difference score (0..255) against the last inferred frame, -1 if it wasn't measured
+        float motion = -1.0f;
+    };
+
+    //motion gating for static cameras: a frame whose downsampled difference from the last inferred frame is below threshold skips
+    //preprocessing and inference, and gets a pose predicted by a PoseFilter instead
+    struct MotionGateConfig {
+        bool enabled = false;
+
+        //mean absolute difference (0..255) between grayscale thumbnails below which a frame counts as unchanged
+        float threshold = 3.0f;
+
+        //run the model at least once every maxSkippedFrames + 1 frames however still the scene is, so slow drift and predictions
+        //can't run away
+        int maxSkippedFrames = 5;
+
+        //size of the thumbnails that get compared (thumbnailCols at most MAX_THUMBNAIL_COLS)
+        int thumbnailRows = 24;
+        int thumbnailCols = 32;
+
+        //how skipped frames are filled in (ONE_EURO also smooths the inferred frames)
+        PoseFilterType filter = PoseFilterType::CONSTANT_VELOCITY;
+        OneEuroConfig oneEuro;
+
+        //submit() timestamp units per second, for the filters' velocities (1e9 for nanosecond camera timestamps)
+        double timestampsPerSecond = 1e9;
+    };
+
+    struct StreamConfig {
+        //how many submitted frames may wait for preprocessing before backpressure kicks in
+        int maxQueuedFrames = 2;
+
+        //staging buffers between preprocess -> infer and infer -> decode (2 = double buffering)
+        int numInputBuffers = 2;
+        int numOutputBuffers = 2;
+
+        BackpressurePolicy policy = BackpressurePolicy::DROP_OLDEST;
+
+        MotionGateConfig motionGate;
+
+        //called for every frame (completed or dropped), if set. Completed frames are delivered in order from the decode thread, but
+        //drops can be reported from the submitting or preprocess thread, so the callback has to be thread-safe.
+        std::function<void(const StreamResult&)> callback;
+    };
+
+    //three-stage pipeline over one Posenet: preprocess, infer and decode each run on their own thread, connected by bounded
+    //lock-free SPSC queues, so preprocessing and decoding of neighbouring frames overlap with the backend's invoke.
+    //submit()/submitAsync() must all be called from the same thread, and the Posenet must not be used elsewhere while the stream
+    //is running.
+    class PosenetStream {
+        public:
+            PosenetStream(Posenet* pPosenet, const StreamConfig &pConfig);
+            ~PosenetStream();
+
+            PosenetStream(const PosenetStream&) = delete;
+            PosenetStream& operator=(const PosenetStream&) = delete;
+
+            bool start();
+
+            //stop the workers; frames still in flight are delivered as dropped
+            void stop();
+
+            //queue a frame; the result comes back through the configured callback. Returns false if the frame was refused.
+            bool submit(const cv::Mat &frame, int64_t timestamp);
+
+            //queue a frame and get its result through a future
+            std::future<StreamResult> submitAsync(const cv::Mat &frame, int64_t timestamp);
+
+            uint64_t getSubmittedFrames() const { return submitted.load(); }
+            uint64_t getCompletedFrames() const { return completed.load(); }
+            uint64_t getDroppedFrames() const { return dropped.load(); }
+
+            //completed frames that the motion gate answered without running the model
+            uint64_t getSkippedFrames() const { return skipped.load(); }
+
+            //per-stage timings are recorded into the Posenet's stats; TOTAL is submit-to-result latency
+            PosenetStats& getStats() { return *stats; }
+
+        private:
+            struct FrameItem {
+                cv::Mat frame;
+                uint64_t submitNanos = 0;
+                int64_t timestamp = 0;
+                uint64_t sequence = 0;
+                std::unique_ptr<std::promise<StreamResult>> promise;
+            };
+
+            //a frame that's been preprocessed into inputBuffers[buffer] or inferred into outputBuffers[buffer], or one the motion
+            //gate skipped (no buffer) passing through to the decode stage in order
+            struct StageItem {
+                int buffer = -1;
+                bool skipped = false;
+                float motion = -1.0f;
+                int rows = 0;
+                int cols = 0;
+                uint64_t submitNanos = 0;
+                int64_t timestamp = 0;
+                uint64_t sequence = 0;
+                std::unique_ptr<std::promise<StreamResult>> promise;
+            };
+
+            Posenet* posenet;
+            PosenetStats* stats;
+            StreamConfig config;
+
+            SpscQueue<FrameItem> frames;
+            SpscQueue<StageItem> preprocessed;
+            SpscQueue<StageItem> inferred;
+
+            //staging buffers, and the indices of the ones that are free (handed back by the stage downstream)
+            //(raw bytes, laid out like the model's tensors: float or quantized)
+            std::vector<std::vector<uint8_t>> inputBuffers;
+            std::vector<std::vector<uint8_t>> outputBuffers;
+            SpscQueue<int> freeInputs;
+            SpscQueue<int> freeOutputs;
+
+            //layout of an output buffer: heatmaps followed by offsets (the views describe type, quantization and shape; their
+            //pointers are swapped for the buffer's when decoding)
+            TensorView heatmapsLayout;
+            TensorView offsetsLayout;
+            size_t heatmapsBytes = 0;
+            size_t offsetsBytes = 0;
+
+            std::atomic<bool> running;
+            std::thread preprocessThread;
+            std::thread inferThread;
+            std::thread decodeThread;
+
+            //motion gate state: the thumbnail of the current frame (if it could be made) and of the last frame sent to the model,
+            //how many frames have been skipped since (preprocess thread), and the filter that fills in skipped frames (decode thread)
+            std::vector<uint8_t> thumbnail;
+            bool thumbnailReady = false;
+            std::vector<uint8_t> referenceThumbnail;
+            int referenceRows = 0;
+            int referenceCols = 0;
+            int skippedInARow = 0;
+            PoseFilter poseFilter;
+
+            uint64_t nextSequence = 0;
+            std::atomic<uint64_t> submitted;
+            std::atomic<uint64_t> completed;
+            std::atomic<uint64_t> dropped;
+            std::atomic<uint64_t> skipped;
+
+            bool enqueue(FrameItem &item);
+            void deliver(StreamResult &result, std::unique_ptr<std::promise<StreamResult>> &promise);
+            void deliverDropped(int64_t timestamp, uint64_t sequence, std::unique_ptr<std::promise<StreamResult>> &promise);
+            bool pushStage(SpscQueue<StageItem> &queue, StageItem &item);
+            bool skipFrame(const cv::Mat &frame, float &motion);
+
+            void preprocessLoop();
+            void inferLoop();
+            void decodeLoop();
+    };
+}
+
+#endif //POSENET_STREAM_H
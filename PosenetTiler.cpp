@@ -0,0 +1,378 @@
+#include "PosenetTiler.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cmath>
+#include "PosenetLog.h"
+#define LOG_TAG "POSENETTILER.CC"
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+    static bool scoreGreater(const Person &a, const Person &b) {
+        return a.score > b.score;
+    }
+    
+    //start offsets of tiles of the given size covering length pixels: evenly spread so neighbours overlap by at least
+    //overlap * size, with the first tile at 0 and the last one ending on the edge
+    static void tileOffsets(int length, int size, float overlap, std::vector<int> &offsets) {
+        offsets.clear();
+        
+        if (length <= size) {
+            offsets.push_back(0);
+            return;
+        }
+        
+        int stride = std::max((int)(size * (1.0f - overlap)), 1);
+        int count = (length - size + stride - 1) / stride + 1;
+        
+        for (int i = 0; i < count; i++) {
+            offsets.push_back((int)(((int64_t)i * (length - size)) / (count - 1)));
+        }
+    }
+    
+    PosenetTiler::PosenetTiler(Posenet* pPosenet, const TilingConfig &pConfig) {
+        posenet = pPosenet;
+        config = pConfig;
+        config.thumbnailCols = std::min(std::max(config.thumbnailCols, 1), MAX_THUMBNAIL_COLS);
+        config.thumbnailRows = std::max(config.thumbnailRows, 1);
+    }
+    
+    PosenetTiler::PosenetTiler(PosenetPool* pPool, const TilingConfig &pConfig) : PosenetTiler((Posenet*)NULL, pConfig) {
+        pool = pPool;
+    }
+    
+    //tile size in frame pixels: the configured one, or the model input size
+    void PosenetTiler::tileSize(int &rows, int &cols) {
+        rows = config.tileRows;
+        cols = config.tileCols;
+        
+        if (rows > 0 && cols > 0) {
+            return;
+        }
+        
+        int inputRows = 0;
+        int inputCols = 0;
+        
+        if (posenet != NULL) {
+            posenet->getInputSize(inputRows, inputCols);
+        }
+        else if (pool != NULL && pool->size() > 0) {
+            PosenetPool::Lease lease = pool->acquire();
+            lease->getInputSize(inputRows, inputCols);
+        }
+        
+        rows = (rows > 0) ? rows : inputRows;
+        cols = (cols > 0) ? cols : inputCols;
+    }
+    
+    std::vector<cv::Rect> PosenetTiler::getTiles(int rows, int cols) {
+        int tileRows, tileCols;
+        tileSize(tileRows, tileCols);
+        
+        std::vector<cv::Rect> regions;
+        
+        if (rows <= 0 || cols <= 0 || tileRows <= 0 || tileCols <= 0) {
+            return regions;
+        }
+        
+        std::vector<int> ys, xs;
+        tileOffsets(rows, tileRows, config.overlap, ys);
+        tileOffsets(cols, tileCols, config.overlap, xs);
+        
+        for (int y : ys) {
+            for (int x : xs) {
+                regions.push_back(cv::Rect(x, y, std::min(tileCols, cols), std::min(tileRows, rows)));
+            }
+        }
+        
+        return regions;
+    }
+    
+    //new frame size: new grid, and nothing to compare the tiles against yet
+    void PosenetTiler::layout(int rows, int cols) {
+        std::vector<cv::Rect> regions = getTiles(rows, cols);
+        
+        tiles.assign(regions.size(), TileState());
+        
+        for (size_t i = 0; i < regions.size(); i++) {
+            tiles[i].region = regions[i];
+        }
+        
+        frameRows = rows;
+        frameCols = cols;
+        
+        LOGI("layout(): %d x %d frame split into %d tiles", cols, rows, (int)tiles.size());
+    }
+    
+    void PosenetTiler::reset() {
+        for (TileState &tile : tiles) {
+            tile.ran = false;
+            tile.skippedInARow = 0;
+            tile.persons.clear();
+        }
+    }
+    
+    TilingStats PosenetTiler::getLastFrameStats() const {
+        return lastStats;
+    }
+    
+    //thumbnail the tile and compare it with the one from the last time it ran; a tile that's going to run keeps the new
+    //thumbnail as its reference
+    bool PosenetTiler::tileChanged(const cv::Mat &frame, TileState &tile) {
+        if (!config.skipStaticTiles || frame.depth() != CV_8U) {
+            //no reference for this run, so the next 8-bit frame can't be compared against one from an older frame
+            tile.thumbnail.clear();
+            return true;
+        }
+        
+        int channels = frame.channels();
+        const cv::Rect &region = tile.region;
+        
+        thumbnail.resize(config.thumbnailRows * config.thumbnailCols);
+        motionThumbnail(frame.data + region.y * frame.step + region.x * channels, frame.step, region.height, region.width, channels,
+        config.thumbnailRows, config.thumbnailCols, thumbnail.data());
+        
+        bool changed = !tile.ran || tile.thumbnail.size() != thumbnail.size() ||
+        tile.skippedInARow >= config.maxSkippedFrames ||
+        meanAbsDifference(thumbnail.data(), tile.thumbnail.data(), (int)thumbnail.size()) >= config.skipThreshold;
+        
+        if (!changed) {
+            tile.skippedInARow++;
+            return false;
+        }
+        
+        tile.thumbnail.swap(thumbnail);
+        tile.skippedInARow = 0;
+        
+        return true;
+    }
+    
+    //move a tile's decoded poses (tile coordinates) to frame coordinates and keep them as the tile's current poses
+    void PosenetTiler::keepPoses(TileState &tile, std::vector<Person> &persons) {
+        for (Person &person : persons) {
+            for (KeyPoint &keyPoint : person.keyPoints) {
+                keyPoint.position.x += tile.region.x;
+                keyPoint.position.y += tile.region.y;
+            }
+        }
+        
+        tile.persons.swap(persons);
+        tile.ran = true;
+    }
+    
+    //one Posenet: preprocess up to maxBatchSize tiles into the slices of the input tensor, invoke once, decode each slice
+    void PosenetTiler::runBatched(const cv::Mat &frame, const std::vector<int> &toRun) {
+        int maxBatch = std::max(config.maxBatchSize, 1);
+        
+        for (size_t start = 0; start < toRun.size(); start += maxBatch) {
+            int batchSize = (int)std::min(toRun.size() - start, (size_t)maxBatch);
+            
+            //a model with a fixed batch dimension runs its tiles one at a time
+            if (!posenet->setBatchSize(batchSize)) {
+                for (int i = 0; i < batchSize; i++) {
+                    TileState &tile = tiles[toRun[start + i]];
+                    std::vector<Person> persons = posenet->estimateMultiplePoses(frame(tile.region), config.maxPosesPerTile,
+                    config.scoreThreshold, config.nmsRadius);
+                    
+                    keepPoses(tile, persons);
+                }
+                
+                continue;
+            }
+            
+            bool filled = true;
+            
+            for (int i = 0; i < batchSize && filled; i++) {
+                filled = posenet->fillInputTensor(frame(tiles[toRun[start + i]].region), i);
+            }
+            
+            TensorView heatmaps, offsets, displacementsFwd, displacementsBwd;
+            
+            if (filled && posenet->invoke()) {
+                heatmaps = posenet->getOutputView(0);
+                offsets = posenet->getOutputView(1);
+                displacementsFwd = posenet->getOutputView(2);
+                displacementsBwd = posenet->getOutputView(3);
+            }
+            
+            //these tiles have nothing to show and run again next frame
+            if (heatmaps.empty() || offsets.empty() || displacementsFwd.empty() || displacementsBwd.empty()) {
+                LOGE("runBatched(): running a batch of %d tiles failed", batchSize);
+                
+                for (int i = 0; i < batchSize; i++) {
+                    tiles[toRun[start + i]].persons.clear();
+                    tiles[toRun[start + i]].ran = false;
+                }
+                
+                continue;
+            }
+            
+            for (int i = 0; i < batchSize; i++) {
+                TileState &tile = tiles[toRun[start + i]];
+                std::vector<Person> persons = posenet->decodeMultiplePoses(heatmaps, offsets, displacementsFwd, displacementsBwd,
+                tile.region.height, tile.region.width, config.maxPosesPerTile, config.scoreThreshold, config.nmsRadius, i);
+                
+                keepPoses(tile, persons);
+            }
+        }
+    }
+    
+    //a pool: one thread per interpreter, each holding its lease and taking the next tile until none are left
+    void PosenetTiler::runPooled(const cv::Mat &frame, const std::vector<int> &toRun) {
+        int numWorkers = std::min(pool->size(), (int)toRun.size());
+        std::atomic<size_t> next(0);
+        
+        auto work = [&] {
+            PosenetPool::Lease lease = pool->acquire();
+            
+            if (!lease.valid()) {
+                return;
+            }
+            
+            for (size_t i = next++; i < toRun.size(); i = next++) {
+                TileState &tile = tiles[toRun[i]];
+                std::vector<Person> persons = lease->estimateMultiplePoses(frame(tile.region), config.maxPosesPerTile,
+                config.scoreThreshold, config.nmsRadius);
+                
+                //each tile is only ever touched by the thread that took it
+                keepPoses(tile, persons);
+            }
+        };
+        
+        std::vector<std::thread> workers;
+        
+        for (int t = 1; t < numWorkers; t++) {
+            workers.push_back(std::thread(work));
+        }
+        
+        //the calling thread works too
+        work();
+        
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+    
+    //two poses are the same person if enough of the keypoints confident in both line up
+    bool PosenetTiler::samePerson(const Person &a, const Person &b) {
+        size_t numKeyPoints = std::min(a.keyPoints.size(), b.keyPoints.size());
+        float squaredRadius = config.mergeRadius * config.mergeRadius;
+        
+        int confident = 0;
+        int matches = 0;
+        
+        for (size_t i = 0; i < numKeyPoints; i++) {
+            const KeyPoint &ka = a.keyPoints[i];
+            const KeyPoint &kb = b.keyPoints[i];
+            
+            if (ka.score < config.mergeKeyPointScore || kb.score < config.mergeKeyPointScore) {
+                continue;
+            }
+            
+            confident++;
+            
+            float dx = ka.position.x - kb.position.x;
+            float dy = ka.position.y - kb.position.y;
+            
+            if (dx * dx + dy * dy <= squaredRadius) {
+                matches++;
+            }
+        }
+        
+        return matches >= config.mergeMinMatches && matches >= config.mergeMinFraction * confident;
+    }
+    
+    //strongest first, fold each pose into an earlier one it duplicates, taking whichever copy of each keypoint is more
+    //confident (a person cut off at one tile's edge is usually whole in the neighbour); returns how many were merged away
+    int PosenetTiler::mergePoses(std::vector<Person> &persons) {
+        std::sort(persons.begin(), persons.end(), scoreGreater);
+        
+        size_t kept = 0;
+        
+        for (size_t i = 0; i < persons.size(); i++) {
+            bool merged = false;
+            
+            for (size_t j = 0; j < kept && !merged; j++) {
+                if (!samePerson(persons[j], persons[i])) {
+                    continue;
+                }
+                
+                std::vector<KeyPoint> &keyPoints = persons[j].keyPoints;
+                const std::vector<KeyPoint> &other = persons[i].keyPoints;
+                
+                for (size_t k = 0; k < keyPoints.size() && k < other.size(); k++) {
+                    if (other[k].score > keyPoints[k].score) {
+                        keyPoints[k] = other[k];
+                    }
+                }
+                
+                merged = true;
+            }
+            
+            if (!merged) {
+                if (kept != i) {
+                    persons[kept] = std::move(persons[i]);
+                }
+                
+                kept++;
+            }
+        }
+        
+        int numMerged = (int)(persons.size() - kept);
+        persons.resize(kept);
+        
+        return numMerged;
+    }
+    
+    std::vector<Person> PosenetTiler::estimateMultiplePoses(const cv::Mat &frame) {
+        uint64_t startNanos = PosenetStats::nowNanos();
+        
+        lastStats = TilingStats();
+        
+        std::vector<Person> persons;
+        
+        if (frame.empty() || (posenet == NULL && (pool == NULL || pool->size() == 0))) {
+            LOGE("estimateMultiplePoses(): nothing to run on");
+            return persons;
+        }
+        
+        if (frame.rows != frameRows || frame.cols != frameCols || tiles.empty()) {
+            layout(frame.rows, frame.cols);
+        }
+        
+        std::vector<int> toRun;
+        
+        for (size_t i = 0; i < tiles.size(); i++) {
+            if (tileChanged(frame, tiles[i])) {
+                toRun.push_back((int)i);
+            }
+        }
+        
+        if (!toRun.empty()) {
+            if (posenet != NULL) {
+                runBatched(frame, toRun);
+            }
+            else {
+                runPooled(frame, toRun);
+            }
+        }
+        
+        for (const TileState &tile : tiles) {
+            persons.insert(persons.end(), tile.persons.begin(), tile.persons.end());
+        }
+        
+        lastStats.tiles = (int)tiles.size();
+        lastStats.tilesRun = (int)toRun.size();
+        lastStats.tilesSkipped = lastStats.tiles - lastStats.tilesRun;
+        lastStats.posesDecoded = (int)persons.size();
+        lastStats.posesMerged = mergePoses(persons);
+        lastStats.totalNanos = PosenetStats::nowNanos() - startNanos;
+        
+        LOGT("estimateMultiplePoses(): ran %d of %d tiles, %d poses (%d seam duplicates merged)", lastStats.tilesRun,
+        lastStats.tiles, (int)persons.size(), lastStats.posesMerged);
+        
+        return persons;
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef POSENET_TILER_H
+#define POSENET_TILER_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+#include "Posenet.h"
+#include "PosenetPool.h"
+
+
+namespace ORB_SLAM2 {
+
+    struct TilingConfig {
+        //tile size in frame pixels (0 = the model input size, so tiles go through the model at full resolution). Frames smaller
+        //than a tile are run whole
+        int tileRows = 0;
+        int tileCols = 0;
+
+        //how much neighbouring tiles overlap, as a fraction of the tile size: anyone up to about this size is whole in at least
+        //one tile, so seams only produce duplicates, not halves
+        float overlap = 0.25f;
+
+        //multi-pose decoding of each tile (nmsRadius in model input pixels, as for Posenet::estimateMultiplePoses)
+        int maxPosesPerTile = 10;
+        float scoreThreshold = 0.5f;
+        float nmsRadius = 20.0f;
+
+        //most tiles packed into one invoke on a single Posenet (the input tensor is resized to the number of tiles run)
+        int maxBatchSize = 16;
+
+        //seam merging: of the keypoints confident (mergeKeyPointScore) in both of two poses, if at least mergeMinMatches and at
+        //least mergeMinFraction of them lie within mergeRadius frame pixels of each other, they're the same person
+        float mergeRadius = 20.0f;
+        float mergeKeyPointScore = 0.3f;
+        int mergeMinMatches = 3;
+        float mergeMinFraction = 0.5f;
+
+        //skip tiles whose thumbnail hasn't changed (mean absolute difference 0..255 under skipThreshold) since they last ran,
+        //reusing the poses found there then; every tile still runs at least once every maxSkippedFrames + 1 frames
+        bool skipStaticTiles = true;
+        float skipThreshold = 2.0f;
+        int maxSkippedFrames = 30;
+
+        //per-tile thumbnail size (thumbnailCols at most MAX_THUMBNAIL_COLS)
+        int thumbnailRows = 8;
+        int thumbnailCols = 8;
+    };
+
+    //what the last frame cost
+    struct TilingStats {
+        int tiles = 0;
+        int tilesRun = 0;
+        int tilesSkipped = 0;
+
+        //poses decoded across the tiles that ran or were reused, and how many were merged away as seam duplicates
+        int posesDecoded = 0;
+        int posesMerged = 0;
+
+        uint64_t totalNanos = 0;
+    };
+
+    //multi-person estimation on frames much larger than the model input (e.g. 4K): instead of squashing the frame into 257x257,
+    //where distant people are a few pixels tall, it's split into overlapping model-sized tiles that each go through the model,
+    //keypoints are mapped back to frame coordinates and people found twice across a seam are merged. Tiles that haven't
+    //changed since they last ran are skipped, so on a static camera the cost follows the occupied, moving area rather than the
+    //frame size. Runs either on one Posenet (tiles batched into as few invokes as maxBatchSize allows) or on a PosenetPool
+    //(tiles spread over its interpreters from one thread per interpreter). Not thread-safe: one frame at a time.
+    class PosenetTiler {
+        public:
+            PosenetTiler(Posenet* pPosenet, const TilingConfig &pConfig = TilingConfig());
+            PosenetTiler(PosenetPool* pPool, const TilingConfig &pConfig = TilingConfig());
+
+            //people in the frame, in frame pixel coordinates, highest score first
+            std::vector<Person> estimateMultiplePoses(const cv::Mat &frame);
+
+            //the tile grid used for frames of this size
+            std::vector<cv::Rect> getTiles(int frameRows, int frameCols);
+
+            //forget every tile's thumbnail and poses, so the next frame runs all tiles
+            void reset();
+
+            TilingStats getLastFrameStats() const;
+
+        private:
+            struct TileState {
+                cv::Rect region;
+
+                //thumbnail from the last time the tile ran, and the poses it found (frame coordinates)
+                std::vector<uint8_t> thumbnail;
+                std::vector<Person> persons;
+                bool ran = false;
+                int skippedInARow = 0;
+            };
+
+            Posenet* posenet = NULL;
+            PosenetPool* pool = NULL;
+            TilingConfig config;
+
+            //the grid for the current frame size
+            std::vector<TileState> tiles;
+            int frameRows = 0;
+            int frameCols = 0;
+
+            std::vector<uint8_t> thumbnail;
+            TilingStats lastStats;
+
+            void layout(int rows, int cols);
+            void tileSize(int &rows, int &cols);
+
+            //decide which tiles need the model this frame
+            bool tileChanged(const cv::Mat &frame, TileState &tile);
+
+            //run the given tiles, leaving each one's poses (frame coordinates) in its TileState
+            void runBatched(const cv::Mat &frame, const std::vector<int> &toRun);
+            void runPooled(const cv::Mat &frame, const std::vector<int> &toRun);
+            void keepPoses(TileState &tile, std::vector<Person> &persons);
+
+            bool samePerson(const Person &a, const Person &b);
+            int mergePoses(std::vector<Person> &persons);
+    };
+}
+
+#endif //POSENET_TILER_H
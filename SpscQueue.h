@@ -0,0 +1,72 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+
+namespace ORB_SLAM2 {
+
+    //bounded lock-free single-producer/single-consumer ring. Exactly one thread may push and exactly one (other) thread may pop.
+    //Slots are allocated once up front and items are moved in and out, so steady-state use doesn't touch the heap.
+    template <typename T>
+    class SpscQueue {
+        std::vector<T> slots;
+        size_t capacity;
+
+        //head is only written by the consumer and tail only by the producer; keep them on separate cache lines
+        alignas(64) std::atomic<size_t> head;
+        alignas(64) std::atomic<size_t> tail;
+
+        public:
+            explicit SpscQueue(size_t pCapacity) : slots(pCapacity), capacity(pCapacity), head(0), tail(0)
+            {}
+
+            SpscQueue(const SpscQueue&) = delete;
+            SpscQueue& operator=(const SpscQueue&) = delete;
+
+            //producer side: returns false (leaving item untouched) if the queue is full
+            bool tryPush(T &item) {
+                size_t t = tail.load(std::memory_order_relaxed);
+
+                if (t - head.load(std::memory_order_acquire) == capacity) {
+                    return false;
+                }
+
+                slots[t % capacity] = std::move(item);
+                tail.store(t + 1, std::memory_order_release);
+
+                return true;
+            }
+
+            //consumer side: returns false if the queue is empty
+            bool tryPop(T &item) {
+                size_t h = head.load(std::memory_order_relaxed);
+
+                if (h == tail.load(std::memory_order_acquire)) {
+                    return false;
+                }
+
+                item = std::move(slots[h % capacity]);
+                head.store(h + 1, std::memory_order_release);
+
+                return true;
+            }
+
+            //approximate when called from a thread that's neither the producer nor the consumer
+            size_t size() const {
+                return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+            }
+
+            bool empty() const {
+                return size() == 0;
+            }
+
+            size_t getCapacity() const {
+                return capacity;
+            }
+    };
+}
+
+#endif //SPSC_QUEUE_H
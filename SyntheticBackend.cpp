@@ -0,0 +1,311 @@
+#include "SyntheticBackend.h"
+#include "Posenet.h"
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include "PosenetLog.h"
+#define LOG_TAG "SYNTHETICBACKEND.CC"
+
+namespace ORB_SLAM2
+{
+    //heatmaps, offsets, forward displacements, backward displacements
+    static const int NUM_OUTPUTS = 4;
+    
+    //logit the heatmap peaks of random people get (a score of about 0.95)
+    static const float RANDOM_PEAK_LOGIT = 3.0f;
+    
+    //cells around each keypoint whose offsets and displacements point at it
+    static const int NEIGHBOURHOOD_RADIUS = 1;
+    
+    SyntheticBackend::SyntheticBackend(const SyntheticBackendConfig &pConfig) {
+        config = pConfig;
+        
+        if (!resizeInput(1, config.inputRows, config.inputCols)) {
+            LOGE("SyntheticBackend(): bad config (%d x %d input, output stride %d, %d keypoints)", config.inputRows, config.inputCols,
+            config.outputStride, config.numKeyPoints);
+        }
+    }
+    
+    void SyntheticBackend::setPoses(const std::vector<SyntheticPose> &poses) {
+        config.poses = poses;
+        dirty = true;
+    }
+    
+    const SyntheticBackendConfig& SyntheticBackend::getConfig() const {
+        return config;
+    }
+    
+    uint64_t SyntheticBackend::getNumInvokes() const {
+        return numInvokes;
+    }
+    
+    const char* SyntheticBackend::getName() const {
+        return "synthetic";
+    }
+    
+    //input quantization matches a typical quantized PoseNet: raw pixels for uint8, pixels - 128 for int8
+    TensorView SyntheticBackend::getInputView() {
+        if (input.empty()) {
+            return TensorView();
+        }
+        
+        bool quantizedInput = config.inputType != TensorType::FLOAT32;
+        int32_t zeroPoint = (config.inputType == TensorType::UINT8) ? 128 : 0;
+        
+        return TensorView(input.data(), config.inputType, quantizedInput ? 1.0f / 127.5f : 1.0f, zeroPoint, batchSize,
+        config.inputRows, config.inputCols, 3);
+    }
+    
+    void* SyntheticBackend::getInputBuffer() {
+        return input.empty() ? NULL : input.data();
+    }
+    
+    bool SyntheticBackend::resizeInput(int batch, int rows, int cols) {
+        if (batch <= 0 || config.outputStride <= 0 || config.numKeyPoints <= 0) {
+            return false;
+        }
+        
+        //the decoder needs at least two cells a side to work out the output stride
+        if ((rows - 1) / config.outputStride < 1 || (cols - 1) / config.outputStride < 1) {
+            LOGE("resizeInput(): %d x %d is too small for output stride %d", rows, cols, config.outputStride);
+            return false;
+        }
+        
+        batchSize = batch;
+        config.inputRows = rows;
+        config.inputCols = cols;
+        
+        size_t elementSize = (config.inputType == TensorType::FLOAT32) ? sizeof(float) : 1;
+        size_t inputBytes = (size_t)batch * rows * cols * 3 * elementSize;
+        
+        input.assign((inputBytes + sizeof(float) - 1) / sizeof(float), 0.0f);
+        
+        generate();
+        
+        return true;
+    }
+    
+    //nearest grid cell to a coordinate in model input pixels
+    static int nearestCell(float coord, float stride, int size) {
+        int cell = (int)std::round(coord / stride);
+        
+        return std::min(std::max(cell, 0), size - 1);
+    }
+    
+    //write one person's peaks, offsets and displacements into the first batch slice. Like a trained model's, the offsets and
+    //displacements point the right way from every cell within radius of the keypoint's own cell, so a position that snaps to a
+    //neighbouring cell (e.g. one right on a cell boundary, after quantization) still decodes
+    void SyntheticBackend::placePose(const SyntheticPose &pose, float strideY, float strideX, int radius) {
+        int numKeyPoints = std::min((int)pose.keyPoints.size(), config.numKeyPoints);
+        int offsetChannels = config.numKeyPoints * 2;
+        int displacementChannels = NUM_POSE_EDGES * 2;
+        
+        for (int k = 0; k < numKeyPoints; k++) {
+            const SyntheticKeyPoint &keyPoint = pose.keyPoints[k];
+            
+            int row = nearestCell(keyPoint.y, strideY, gridRows);
+            int col = nearestCell(keyPoint.x, strideX, gridCols);
+            
+            //inverse sigmoid, so the decoder's sigmoid gives the score back
+            float score = std::min(std::max(keyPoint.score, 1e-4f), 1.0f - 1e-4f);
+            
+            floatOutputs[0][((size_t)row * gridCols + col) * config.numKeyPoints + k] = std::log(score / (1.0f - score));
+            
+            for (int r = std::max(row - radius, 0); r <= std::min(row + radius, gridRows - 1); r++) {
+                for (int c = std::max(col - radius, 0); c <= std::min(col + radius, gridCols - 1); c++) {
+                    size_t cell = (size_t)r * gridCols + c;
+                    
+                    floatOutputs[1][cell * offsetChannels + k] = keyPoint.y - r * strideY;
+                    floatOutputs[1][cell * offsetChannels + k + config.numKeyPoints] = keyPoint.x - c * strideX;
+                }
+            }
+        }
+        
+        if (!config.multiPose) {
+            return;
+        }
+        
+        //forward displacements sit around the parent's cell and point to the child, backward ones the other way round
+        for (int edge = 0; edge < NUM_POSE_EDGES; edge++) {
+            int parent = (int)POSE_CHAIN[edge][0];
+            int child = (int)POSE_CHAIN[edge][1];
+            
+            if (parent >= numKeyPoints || child >= numKeyPoints) {
+                continue;
+            }
+            
+            for (int direction = 0; direction < 2; direction++) {
+                const SyntheticKeyPoint &from = pose.keyPoints[direction == 0 ? parent : child];
+                const SyntheticKeyPoint &to = pose.keyPoints[direction == 0 ? child : parent];
+                std::vector<float> &displacements = floatOutputs[2 + direction];
+                
+                int row = nearestCell(from.y, strideY, gridRows);
+                int col = nearestCell(from.x, strideX, gridCols);
+                
+                for (int r = std::max(row - radius, 0); r <= std::min(row + radius, gridRows - 1); r++) {
+                    for (int c = std::max(col - radius, 0); c <= std::min(col + radius, gridCols - 1); c++) {
+                        size_t cell = (size_t)r * gridCols + c;
+                        
+                        displacements[cell * displacementChannels + edge] = to.y - from.y;
+                        displacements[cell * displacementChannels + edge + NUM_POSE_EDGES] = to.x - from.x;
+                    }
+                }
+            }
+        }
+    }
+    
+    //rebuild every output for the current shape and poses
+    void SyntheticBackend::generate() {
+        gridRows = (config.inputRows - 1) / config.outputStride + 1;
+        gridCols = (config.inputCols - 1) / config.outputStride + 1;
+        
+        //the same strides the decoder works out from the shapes
+        float strideY = (config.inputRows - 1) / (float)(gridRows - 1);
+        float strideX = (config.inputCols - 1) / (float)(gridCols - 1);
+        
+        size_t cells = (size_t)gridRows * gridCols;
+        int channels[NUM_OUTPUTS] = {config.numKeyPoints, config.numKeyPoints * 2, NUM_POSE_EDGES * 2, NUM_POSE_EDGES * 2};
+        
+        std::mt19937 rng(config.seed);
+        
+        for (int i = 0; i < NUM_OUTPUTS; i++) {
+            floatOutputs[i].assign(cells * channels[i] * batchSize, 0.0f);
+        }
+        
+        //background: low heatmap logits and small random offsets/displacements, so multi-pose decoding sees realistic clutter
+        std::fill(floatOutputs[0].begin(), floatOutputs[0].begin() + cells * channels[0], config.backgroundLogit);
+        
+        if (config.noise > 0.0f) {
+            std::normal_distribution<float> background(config.backgroundLogit, config.noise);
+            std::uniform_real_distribution<float> offset(-strideY / 2.0f, strideY / 2.0f);
+            std::uniform_real_distribution<float> displacement(-2.0f * strideY, 2.0f * strideY);
+            
+            for (size_t i = 0; i < cells * channels[0]; i++) {
+                floatOutputs[0][i] = background(rng);
+            }
+            
+            for (size_t i = 0; i < cells * channels[1]; i++) {
+                floatOutputs[1][i] = offset(rng);
+            }
+            
+            for (int output = 2; output < NUM_OUTPUTS && config.multiPose; output++) {
+                for (size_t i = 0; i < cells * channels[output]; i++) {
+                    floatOutputs[output][i] = displacement(rng);
+                }
+            }
+        }
+        
+        std::vector<SyntheticPose> people = config.poses;
+        
+        //random people: keypoints within two cells of a center that keeps them on the grid
+        std::uniform_int_distribution<int> centerRow(std::min(2, gridRows - 1), std::max(gridRows - 3, std::min(2, gridRows - 1)));
+        std::uniform_int_distribution<int> centerCol(std::min(2, gridCols - 1), std::max(gridCols - 3, std::min(2, gridCols - 1)));
+        std::uniform_int_distribution<int> jitter(-2, 2);
+        std::uniform_real_distribution<float> subCell(-0.25f, 0.25f);
+        
+        float randomScore = 1.0f / (1.0f + std::exp(-RANDOM_PEAK_LOGIT));
+        
+        for (int p = 0; p < config.numRandomPeople; p++) {
+            SyntheticPose pose;
+            pose.keyPoints.resize(config.numKeyPoints);
+            
+            int row = centerRow(rng);
+            int col = centerCol(rng);
+            
+            for (SyntheticKeyPoint &keyPoint : pose.keyPoints) {
+                int r = std::min(std::max(row + jitter(rng), 0), gridRows - 1);
+                int c = std::min(std::max(col + jitter(rng), 0), gridCols - 1);
+                
+                keyPoint.y = (r + subCell(rng)) * strideY;
+                keyPoint.x = (c + subCell(rng)) * strideX;
+                keyPoint.score = randomScore;
+            }
+            
+            people.push_back(pose);
+        }
+        
+        //neighbourhoods first, then every person's own cells, so one person's neighbourhood never overwrites another's keypoints
+        for (const SyntheticPose &pose : people) {
+            placePose(pose, strideY, strideX, NEIGHBOURHOOD_RADIUS);
+        }
+        
+        for (const SyntheticPose &pose : people) {
+            placePose(pose, strideY, strideX, 0);
+        }
+        
+        //every frame of a batch sees the same people
+        for (int i = 0; i < NUM_OUTPUTS; i++) {
+            size_t sliceSize = cells * channels[i];
+            
+            for (int n = 1; n < batchSize; n++) {
+                memcpy(floatOutputs[i].data() + n * sliceSize, floatOutputs[i].data(), sliceSize * sizeof(float));
+            }
+        }
+        
+        //quantize each output with a symmetric scale fitted to its range
+        for (int i = 0; i < NUM_OUTPUTS && config.outputType != TensorType::FLOAT32; i++) {
+            float maxAbs = 0.0f;
+            
+            for (float v : floatOutputs[i]) {
+                maxAbs = std::max(maxAbs, std::fabs(v));
+            }
+            
+            bool isSigned = config.outputType == TensorType::INT8;
+            
+            outputScales[i] = (maxAbs > 0.0f) ? maxAbs / 127.0f : 1.0f;
+            outputZeroPoints[i] = isSigned ? 0 : 128;
+            
+            quantizedOutputs[i].resize(floatOutputs[i].size());
+            
+            for (size_t j = 0; j < floatOutputs[i].size(); j++) {
+                int32_t q = (int32_t)lrintf(floatOutputs[i][j] / outputScales[i]) + outputZeroPoints[i];
+                
+                q = std::min(std::max(q, isSigned ? -128 : 0), isSigned ? 127 : 255);
+                quantizedOutputs[i][j] = (uint8_t)q;
+            }
+        }
+        
+        dirty = false;
+    }
+    
+    bool SyntheticBackend::invoke() {
+        if (input.empty()) {
+            return false;
+        }
+        
+        uint64_t startNanos = PosenetStats::nowNanos();
+        
+        if (dirty) {
+            generate();
+        }
+        
+        //stand in for the model's compute time
+        while (PosenetStats::nowNanos() - startNanos < config.invokeNanos) {
+        }
+        
+        numInvokes++;
+        
+        return true;
+    }
+    
+    int SyntheticBackend::getNumOutputs() {
+        return config.multiPose ? NUM_OUTPUTS : 2;
+    }
+    
+    TensorView SyntheticBackend::getOutputView(int index) {
+        if (index < 0 || index >= getNumOutputs() || floatOutputs[index].empty()) {
+            LOGE("getOutputView(): no output %d", index);
+            return TensorView();
+        }
+        
+        int channels = (index == 0) ? config.numKeyPoints : (index == 1) ? config.numKeyPoints * 2 : NUM_POSE_EDGES * 2;
+        
+        if (config.outputType == TensorType::FLOAT32) {
+            return TensorView(floatOutputs[index].data(), batchSize, gridRows, gridCols, channels);
+        }
+        
+        return TensorView(quantizedOutputs[index].data(), config.outputType, outputScales[index], outputZeroPoints[index], batchSize,
+        gridRows, gridCols, channels);
+    }
+}
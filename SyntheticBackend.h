@@ -0,0 +1,98 @@
+#ifndef SYNTHETIC_BACKEND_H
+#define SYNTHETIC_BACKEND_H
+
+#include <vector>
+
+#include "InferenceBackend.h"
+
+
+namespace ORB_SLAM2 {
+
+    //one keypoint of a synthetic pose, in model input pixels, with the score (after sigmoid) its heatmap peak decodes to
+    struct SyntheticKeyPoint {
+        float x = 0.0f;
+        float y = 0.0f;
+        float score = 0.9f;
+    };
+
+    //a person to put in the synthetic outputs: one entry per keypoint, in BodyPart order
+    struct SyntheticPose {
+        std::vector<SyntheticKeyPoint> keyPoints;
+    };
+
+    struct SyntheticBackendConfig {
+        //model input the backend pretends to have; the output grid is (size - 1) / outputStride + 1 cells on each side
+        int inputRows = 257;
+        int inputCols = 257;
+        int outputStride = 32;
+        int numKeyPoints = 17;
+
+        //element type of the input and of the outputs (quantized outputs get a symmetric scale fitted to each tensor's range)
+        TensorType inputType = TensorType::FLOAT32;
+        TensorType outputType = TensorType::FLOAT32;
+
+        //also emit the forward and backward displacement outputs (2 and 3) that multi-pose decoding follows
+        bool multiPose = true;
+
+        //the people in every frame: these poses exactly (in pixels of the current input size), plus numRandomPeople skeletons
+        //scattered around random centers
+        std::vector<SyntheticPose> poses;
+        int numRandomPeople = 0;
+
+        //background heatmap logits are backgroundLogit plus gaussian noise, offsets and displacements away from the people are
+        //uniform noise of up to half a cell and two cells; noise = 0 gives flat background. Everything is drawn from seed, so
+        //the same config always produces the same outputs
+        float backgroundLogit = -4.0f;
+        float noise = 1.0f;
+        uint32_t seed = 42;
+
+        //how long each invoke() busy-waits, to stand in for a real model's latency in pipeline and scheduling tests
+        uint64_t invokeNanos = 0;
+    };
+
+    //deterministic stand-in for a model: invoke() ignores the input and leaves outputs generated from the config (heatmaps,
+    //offsets and optionally displacements, identical for every frame of a batch), so preprocessing, decoding and the
+    //stream/pool plumbing can be tested and benchmarked without a model file or an interpreter. Poses decode back to the
+    //configured positions (to within the decoder's whole-pixel truncation for single-pose)
+    class SyntheticBackend : public InferenceBackend {
+        SyntheticBackendConfig config;
+
+        int batchSize = 1;
+        int gridRows = 0;
+        int gridCols = 0;
+
+        //input 0 (floats or bytes, kept float-aligned for the preprocessing kernels)
+        std::vector<float> input;
+
+        //the outputs handed out (every batch slice a copy of the first), in float and, for quantized outputs, quantized
+        std::vector<float> floatOutputs[4];
+        std::vector<uint8_t> quantizedOutputs[4];
+        float outputScales[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        int32_t outputZeroPoints[4] = {0, 0, 0, 0};
+
+        //outputs need regenerating before the next invoke (shape or poses changed)
+        bool dirty = true;
+        uint64_t numInvokes = 0;
+
+        void generate();
+        void placePose(const SyntheticPose &pose, float strideY, float strideX, int radius);
+
+        public:
+            explicit SyntheticBackend(const SyntheticBackendConfig &pConfig = SyntheticBackendConfig());
+
+            //replace the explicit poses; the next invoke() emits them
+            void setPoses(const std::vector<SyntheticPose> &poses);
+            const SyntheticBackendConfig& getConfig() const;
+            uint64_t getNumInvokes() const;
+
+            const char* getName() const override;
+            TensorView getInputView() override;
+            void* getInputBuffer() override;
+            bool resizeInput(int batch, int rows, int cols) override;
+            bool invoke() override;
+            int getNumOutputs() override;
+            TensorView getOutputView(int index) override;
+    };
+}
+
+#endif //SYNTHETIC_BACKEND_H
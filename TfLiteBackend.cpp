@@ -0,0 +1,137 @@
+#include "TfLiteBackend.h"
+#include "PosenetLog.h"
+#define LOG_TAG "TFLITEBACKEND.CC"
+
+namespace ORB_SLAM2
+{
+    TfLiteBackend::TfLiteBackend()
+    {}
+    
+    TfLiteBackend::TfLiteBackend(TfLiteInterpreter* pInterpreter) {
+        interpreter = pInterpreter;
+    }
+    
+    void TfLiteBackend::setInterpreter(TfLiteInterpreter* pInterpreter) {
+        interpreter = pInterpreter;
+    }
+    
+    TfLiteInterpreter* TfLiteBackend::getInterpreter() {
+        return interpreter;
+    }
+    
+    const char* TfLiteBackend::getName() const {
+        return "tflite";
+    }
+    
+    //wrap a tensor's flat data buffer in a TensorView (no copy)
+    TensorView TfLiteBackend::tensorView(const TfLiteTensor* tensor) {
+        if (tensor == NULL) {
+            return TensorView();
+        }
+        
+        //quantized models give uint8/int8 tensors, which stay quantized: the decoder only dequantizes the few cells it reads
+        TensorType type;
+        
+        switch (TfLiteTensorType(tensor)) {
+            case kTfLiteFloat32:
+                type = TensorType::FLOAT32;
+                break;
+            case kTfLiteUInt8:
+                type = TensorType::UINT8;
+                break;
+            case kTfLiteInt8:
+                type = TensorType::INT8;
+                break;
+            default:
+                LOGE("tensorView(): unsupported tensor type %d", (int)TfLiteTensorType(tensor));
+                return TensorView();
+        }
+        
+        const void* data = TfLiteTensorData(tensor);
+        
+        if (data == NULL) {
+            LOGE("tensorView(): problem getting underlying data buffer from tensor");
+            return TensorView();
+        }
+        
+        TfLiteQuantizationParams quantization = TfLiteTensorQuantizationParams(tensor);
+        
+        if (type != TensorType::FLOAT32 && quantization.scale <= 0.0f) {
+            LOGE("tensorView(): quantized tensor has no scale");
+            return TensorView();
+        }
+        
+        //pad missing leading dimensions with 1 so we always have NHWC
+        int32_t dims[4] = {1, 1, 1, 1};
+        int32_t numDims = TfLiteTensorNumDims(tensor);
+        
+        for (int i = 0; i < numDims && i < 4; i++) {
+            dims[4 - numDims + i] = TfLiteTensorDim(tensor, i);
+        }
+        
+        return TensorView(data, type, quantization.scale, quantization.zero_point, dims[0], dims[1], dims[2], dims[3]);
+    }
+    
+    TensorView TfLiteBackend::getInputView() {
+        if (interpreter == NULL) {
+            return TensorView();
+        }
+        
+        return tensorView(TfLiteInterpreterGetInputTensor(interpreter, 0));
+    }
+    
+    void* TfLiteBackend::getInputBuffer() {
+        TfLiteTensor* input = (interpreter == NULL) ? NULL : TfLiteInterpreterGetInputTensor(interpreter, 0);
+        
+        if (input == NULL) {
+            LOGE("getInputBuffer(): input tensor came up NULL");
+            return NULL;
+        }
+        
+        return TfLiteTensorData(input);
+    }
+    
+    bool TfLiteBackend::resizeInput(int batch, int rows, int cols) {
+        if (interpreter == NULL) {
+            return false;
+        }
+        
+        const int dims[4] = {batch, rows, cols, 3};
+        
+        if (TfLiteInterpreterResizeInputTensor(interpreter, 0, dims, 4) != kTfLiteOk) {
+            LOGE("resizeInput(): resizing input tensor to %d x %d x %d failed", batch, rows, cols);
+            return false;
+        }
+        
+        if (TfLiteInterpreterAllocateTensors(interpreter) != kTfLiteOk) {
+            LOGE("resizeInput(): TfLite allocate tensors failed for %d x %d x %d", batch, rows, cols);
+            return false;
+        }
+        
+        return true;
+    }
+    
+    bool TfLiteBackend::invoke() {
+        if (interpreter == NULL || TfLiteInterpreterInvoke(interpreter) != kTfLiteOk) {
+            LOGE("TfLiteInterpreterInvoke FAILED");
+            return false;
+        }
+        
+        return true;
+    }
+    
+    int TfLiteBackend::getNumOutputs() {
+        return (interpreter == NULL) ? 0 : TfLiteInterpreterGetOutputTensorCount(interpreter);
+    }
+    
+    TensorView TfLiteBackend::getOutputView(int index) {
+        const TfLiteTensor* tensor = (interpreter == NULL) ? NULL : TfLiteInterpreterGetOutputTensor(interpreter, index);
+        
+        if (tensor == NULL) {
+            LOGE("getOutputView(): output tensor %d came up NULL", index);
+            return TensorView();
+        }
+        
+        return tensorView(tensor);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef TFLITE_BACKEND_H
+#define TFLITE_BACKEND_H
+
+#include "c_api.h"
+#include "InferenceBackend.h"
+
+
+namespace ORB_SLAM2 {
+
+    //InferenceBackend over a TfLiteInterpreter. It doesn't own the interpreter: Posenet keeps building, caching (one per input
+    //resolution) and deleting interpreters along with their options and delegates, and points the backend at the current one
+    class TfLiteBackend : public InferenceBackend {
+        TfLiteInterpreter* interpreter = NULL;
+
+        public:
+            TfLiteBackend();
+            explicit TfLiteBackend(TfLiteInterpreter* pInterpreter);
+
+            void setInterpreter(TfLiteInterpreter* pInterpreter);
+            TfLiteInterpreter* getInterpreter();
+
+            //view over any input or output tensor of a supported type (float32/uint8/int8), empty otherwise
+            static TensorView tensorView(const TfLiteTensor* tensor);
+
+            const char* getName() const override;
+            TensorView getInputView() override;
+            void* getInputBuffer() override;
+            bool resizeInput(int batch, int rows, int cols) override;
+            bool invoke() override;
+            int getNumOutputs() override;
+            TensorView getOutputView(int index) override;
+    };
+}
+
+#endif //TFLITE_BACKEND_H
@@ -0,0 +1,649 @@
+//Google benchmark suite for the Posenet hot path. The preprocessing, output-copy and decode benchmarks run on synthetic data
+//(outputs from a SyntheticBackend), so they work on any box without a model file; the initOutputMap and end-to-end benchmarks
+//need the real model, so point POSENET_MODEL at posenet_model.tflite to enable them. Emit JSON for tracking regressions across versions with
+//
+//  ./posenet_benchmark --benchmark_format=json --benchmark_out=posenet_bench.json
+
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Posenet.h"
+#include "SyntheticBackend.h"
+#include "PosenetTiler.h"
+#include "PoseBatch.h"
+#include "PoseLog.h"
+
+using namespace ORB_SLAM2;
+
+//every heap allocation in the process goes through here, so the decode benchmarks can report allocations per frame (which should
+//be exactly 0 for the FixedPerson / reused Person paths)
+static std::atomic<uint64_t> heapAllocations(0);
+
+//the replacements below all allocate and free through these two, kept out of line so the compiler never pairs a visible malloc
+//with a visible free across a new/delete boundary (which -Wmismatched-new-delete reports)
+__attribute__((noinline)) static void* countedAlloc(size_t size) noexcept {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    
+    return malloc(size == 0 ? 1 : size);
+}
+
+__attribute__((noinline)) static void countedFree(void* p) noexcept {
+    free(p);
+}
+
+void* operator new(size_t size) {
+    void* p = countedAlloc(size);
+    
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    
+    return p;
+}
+
+void* operator new[](size_t size) {
+    void* p = countedAlloc(size);
+    
+    if (p == NULL) {
+        throw std::bad_alloc();
+    }
+    
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+    countedFree(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    countedFree(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    countedFree(p);
+}
+
+//heap allocations per iteration between two counter readings
+static double allocationsPerFrame(benchmark::State &state, uint64_t startAllocations) {
+    uint64_t allocations = heapAllocations.load(std::memory_order_relaxed) - startAllocations;
+    
+    return state.iterations() == 0 ? 0.0 : allocations / (double)state.iterations();
+}
+
+//model input sizes we care about, and the output strides PoseNet models ship with
+static const int INPUT_SIZES[] = {257, 353, 513};
+static const int OUTPUT_STRIDES[] = {16, 32};
+
+static const char* modelPath() {
+    return getenv("POSENET_MODEL");
+}
+
+//fill a Mat with deterministic noise
+static cv::Mat syntheticImage(int rows, int cols, int type) {
+    cv::Mat img(rows, cols, type);
+    
+    std::mt19937 rng(1234);
+    
+    for (int r = 0; r < rows; r++) {
+        uint8_t* row = img.ptr(r);
+        
+        for (size_t i = 0; i < (size_t)cols * img.channels(); i++) {
+            row[i] = (uint8_t)(rng() & 0xFF);
+        }
+    }
+    
+    return img;
+}
+
+//a backend shaped like a model with the given input size and output stride, whose outputs hold numPeople skeletons: background
+//cells get low logits, and each person's keypoints are strong local maxima around a random center
+static std::shared_ptr<SyntheticBackend> syntheticBackend(int inputSize, int outputStride, int numPeople) {
+    SyntheticBackendConfig config;
+    config.inputRows = inputSize;
+    config.inputCols = inputSize;
+    config.outputStride = outputStride;
+    config.numRandomPeople = numPeople;
+    
+    return std::make_shared<SyntheticBackend>(config);
+}
+
+//build a Posenet on the real model with the given input size and thread count, or NULL if no model is available
+static Posenet* modelPosenet(int inputSize, int numThreads) {
+    if (modelPath() == NULL) {
+        return NULL;
+    }
+    
+    Posenet* posenet = new Posenet(modelPath(), Device::CPU);
+    posenet->setNumThreads(numThreads);
+    
+    TfLiteInterpreter* interpreter = posenet->getInterpreter();
+    
+    if (interpreter == NULL) {
+        delete posenet;
+        return NULL;
+    }
+    
+    const int dims[4] = {1, inputSize, inputSize, 3};
+    
+    if (TfLiteInterpreterResizeInputTensor(interpreter, 0, dims, 4) != kTfLiteOk || TfLiteInterpreterAllocateTensors(interpreter) != kTfLiteOk) {
+        posenet->close();
+        delete posenet;
+        return NULL;
+    }
+    
+    return posenet;
+}
+
+//input sizes x output strides
+static void inputSizesAndStrides(benchmark::internal::Benchmark* b) {
+    for (int size : INPUT_SIZES) {
+        for (int stride : OUTPUT_STRIDES) {
+            b->Args({size, stride});
+        }
+    }
+}
+
+//input sizes x 1..N interpreter threads
+static void inputSizesAndThreads(benchmark::internal::Benchmark* b) {
+    int maxThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+    
+    for (int size : INPUT_SIZES) {
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            b->Args({size, threads});
+        }
+    }
+}
+
+
+//the original scalar [-1,1] conversion into a fresh std::vector (input must already be model-sized)
+static void BM_InitInputArray(benchmark::State &state) {
+    int size = (int)state.range(0);
+    
+    Posenet posenet;
+    cv::Mat img = syntheticImage(size, size, CV_8UC3);
+    
+    for (auto _ : state) {
+        std::vector<float> input = posenet.initInputArray(img);
+        benchmark::DoNotOptimize(input.data());
+    }
+    
+    state.SetBytesProcessed(state.iterations() * (int64_t)size * size * 3);
+}
+BENCHMARK(BM_InitInputArray)->Arg(257)->Arg(353)->Arg(513)->Unit(benchmark::kMicrosecond);
+
+//fused resize + reorder + normalize from a camera-sized BGR frame (range(1) = source rows: 480 -> 640x480, 1080 -> 1920x1080)
+static void BM_FusedPreprocess(benchmark::State &state) {
+    int size = (int)state.range(0);
+    int srcRows = (int)state.range(1);
+    int srcCols = (srcRows == 1080) ? 1920 : srcRows * 4 / 3;
+    
+    cv::Mat img = syntheticImage(srcRows, srcCols, CV_8UC3);
+    std::vector<float> input((size_t)size * size * 3);
+    
+    PreprocessPlan plan;
+    plan.update(img.rows, img.cols, img.channels(), size, size);
+    
+    for (auto _ : state) {
+        preprocessToFloat(img.data, img.step, PixelFormat::BGR, plan, input.data());
+        benchmark::DoNotOptimize(input.data());
+    }
+    
+    state.SetItemsProcessed(state.iterations() * (int64_t)size * size);
+}
+BENCHMARK(BM_FusedPreprocess)->ArgsProduct({{257, 353, 513}, {480, 1080}})->Unit(benchmark::kMicrosecond);
+
+//the same straight from an NV21 camera frame (YUV -> RGB fused in, only sampled pixels converted), to compare against
+//BM_FusedPreprocess plus a full-frame color conversion
+static void BM_FusedPreprocessNV21(benchmark::State &state) {
+    int size = (int)state.range(0);
+    int srcRows = (int)state.range(1);
+    int srcCols = (srcRows == 1080) ? 1920 : srcRows * 4 / 3;
+    
+    cv::Mat luma = syntheticImage(srcRows, srcCols, CV_8UC1);
+    cv::Mat chroma = syntheticImage(srcRows / 2, srcCols, CV_8UC1);
+    std::vector<float> input((size_t)size * size * 3);
+    
+    YuvFrame frame;
+    frame.layout = YuvLayout::NV21;
+    frame.rows = srcRows;
+    frame.cols = srcCols;
+    frame.planes[0] = luma.data;
+    frame.strides[0] = luma.step;
+    frame.planes[1] = chroma.data;
+    frame.strides[1] = chroma.step;
+    
+    PreprocessPlan plan;
+    plan.update(srcRows, srcCols, 1, size, size);
+    
+    for (auto _ : state) {
+        preprocessYuvToFloat(frame, plan, input.data());
+        benchmark::DoNotOptimize(input.data());
+    }
+    
+    state.SetItemsProcessed(state.iterations() * (int64_t)size * size);
+}
+BENCHMARK(BM_FusedPreprocessNV21)->ArgsProduct({{257, 353, 513}, {480, 1080}})->Unit(benchmark::kMicrosecond);
+
+//building the nested-vector output map (needs the model for the output shapes)
+static void BM_InitOutputMap(benchmark::State &state) {
+    Posenet* posenet = modelPosenet((int)state.range(0), 1);
+    
+    if (posenet == NULL) {
+        state.SkipWithError("set POSENET_MODEL to run this benchmark");
+        return;
+    }
+    
+    for (auto _ : state) {
+        auto outputMap = posenet->initOutputMap();
+        benchmark::DoNotOptimize(outputMap.size());
+    }
+    
+    posenet->close();
+    delete posenet;
+}
+BENCHMARK(BM_InitOutputMap)->Arg(257)->Arg(353)->Arg(513)->Unit(benchmark::kMicrosecond);
+
+//copying the flat offsets tensor into the nested std::vector map, as runForMultipleInputsOutputs does
+static void BM_ReadFlatIntoMultiDimensionalArray(benchmark::State &state) {
+    std::shared_ptr<SyntheticBackend> backend = syntheticBackend((int)state.range(0), (int)state.range(1), 1);
+    TensorView offsets = backend->getOutputView(1);
+    int channels = NUM_KEYPOINTS * 2;
+    
+    std::vector<std::vector<std::vector<std::vector<float>>>> map(1,
+    std::vector<std::vector<std::vector<float>>>(offsets.height(), std::vector<std::vector<float>>(offsets.width(), std::vector<float>(channels))));
+    
+    Posenet posenet(backend);
+    
+    for (auto _ : state) {
+        posenet.readFlatIntoMultiDimensionalArray((float*)offsets.data, map);
+        benchmark::DoNotOptimize(map[0][0][0].data());
+    }
+    
+    state.SetBytesProcessed(state.iterations() * (int64_t)offsets.byteSize());
+}
+BENCHMARK(BM_ReadFlatIntoMultiDimensionalArray)->Apply(inputSizesAndStrides);
+
+//the same copy into a plain float**** (the std::vector vs C array comparison from the README)
+static void BM_ReadFlatIntoRawArray(benchmark::State &state) {
+    std::shared_ptr<SyntheticBackend> backend = syntheticBackend((int)state.range(0), (int)state.range(1), 1);
+    TensorView offsets = backend->getOutputView(1);
+    int height = offsets.height();
+    int width = offsets.width();
+    int channels = NUM_KEYPOINTS * 2;
+    
+    float**** map = new float***[1];
+    map[0] = new float**[height];
+    
+    for (int r = 0; r < height; r++) {
+        map[0][r] = new float*[width];
+        
+        for (int c = 0; c < width; c++) {
+            map[0][r][c] = new float[channels];
+        }
+    }
+    
+    for (auto _ : state) {
+        const float* data = offsets.data;
+        
+        for (int r = 0; r < height; r++) {
+            for (int c = 0; c < width; c++) {
+                for (int k = 0; k < channels; k++) {
+                    map[0][r][c][k] = *data++;
+                }
+            }
+        }
+        
+        benchmark::DoNotOptimize(map[0][0][0]);
+    }
+    
+    state.SetBytesProcessed(state.iterations() * (int64_t)offsets.byteSize());
+    
+    for (int r = 0; r < height; r++) {
+        for (int c = 0; c < width; c++) {
+            delete[] map[0][r][c];
+        }
+        
+        delete[] map[0][r];
+    }
+    
+    delete[] map[0];
+    delete[] map;
+}
+BENCHMARK(BM_ReadFlatIntoRawArray)->Apply(inputSizesAndStrides);
+
+//heatmap argmax + offset refinement + sigmoid, straight off the (synthetic) output tensors
+static void BM_DecodeSinglePose(benchmark::State &state) {
+    std::shared_ptr<SyntheticBackend> backend = syntheticBackend((int)state.range(0), (int)state.range(1), 1);
+    
+    TensorView heatmaps = backend->getOutputView(0);
+    TensorView offsets = backend->getOutputView(1);
+    
+    Posenet posenet(backend);
+    
+    uint64_t startAllocations = heapAllocations.load();
+    
+    for (auto _ : state) {
+        Person person = posenet.decodeSinglePose(heatmaps, offsets, 480, 640);
+        benchmark::DoNotOptimize(person.score);
+    }
+    
+    state.counters["heatmap_cells"] = heatmaps.height() * heatmaps.width();
+    state.counters["allocs_per_frame"] = allocationsPerFrame(state, startAllocations);
+}
+BENCHMARK(BM_DecodeSinglePose)->Apply(inputSizesAndStrides);
+
+//same decode into a Person reused across frames: after the first frame its keypoint vector is only overwritten
+static void BM_DecodeSinglePoseReused(benchmark::State &state) {
+    std::shared_ptr<SyntheticBackend> backend = syntheticBackend((int)state.range(0), (int)state.range(1), 1);
+    
+    TensorView heatmaps = backend->getOutputView(0);
+    TensorView offsets = backend->getOutputView(1);
+    
+    Posenet posenet(backend);
+    Person person;
+    
+    posenet.decodeSinglePose(heatmaps, offsets, 480, 640, person);
+    
+    uint64_t startAllocations = heapAllocations.load();
+    
+    for (auto _ : state) {
+        posenet.decodeSinglePose(heatmaps, offsets, 480, 640, person);
+        benchmark::DoNotOptimize(person.score);
+    }
+    
+    state.counters["allocs_per_frame"] = allocationsPerFrame(state, startAllocations);
+    
+    //the framework allocates a little around the timed loop, so check strictly on a window of our own
+    uint64_t checkAllocations = heapAllocations.load();
+    
+    for (int i = 0; i < 100; i++) {
+        posenet.decodeSinglePose(heatmaps, offsets, 480, 640, person);
+    }
+    
+    if (heapAllocations.load() != checkAllocations) {
+        state.SkipWithError("decoding into a reused Person allocated");
+    }
+}
+BENCHMARK(BM_DecodeSinglePoseReused)->Apply(inputSizesAndStrides);
+
+//and into a FixedPerson, whose keypoints live inline
+static void BM_DecodeSinglePoseFixed(benchmark::State &state) {
+    std::shared_ptr<SyntheticBackend> backend = syntheticBackend((int)state.range(0), (int)state.range(1), 1);
+    
+    TensorView heatmaps = backend->getOutputView(0);
+    TensorView offsets = backend->getOutputView(1);
+    
+    Posenet posenet(backend);
+    FixedPerson<> person;
+    
+    uint64_t startAllocations = heapAllocations.load();
+    
+    for (auto _ : state) {
+        posenet.decodeSinglePose(heatmaps, offsets, 480, 640, person);
+        benchmark::DoNotOptimize(person.score);
+    }
+    
+    state.counters["allocs_per_frame"] = allocationsPerFrame(state, startAllocations);
+    
+    //the framework allocates a little around the timed loop, so check strictly on a window of our own
+    uint64_t checkAllocations = heapAllocations.load();
+    
+    for (int i = 0; i < 100; i++) {
+        posenet.decodeSinglePose(heatmaps, offsets, 480, 640, person);
+    }
+    
+    if (heapAllocations.load() != checkAllocations) {
+        state.SkipWithError("decoding into a FixedPerson allocated");
+    }
+}
+BENCHMARK(BM_DecodeSinglePoseFixed)->Apply(inputSizesAndStrides);
+
+//multi-person decode with 15 people in the frame
+static void BM_DecodeMultiplePoses(benchmark::State &state) {
+    std::shared_ptr<SyntheticBackend> backend = syntheticBackend((int)state.range(0), (int)state.range(1), 15);
+    
+    TensorView heatmaps = backend->getOutputView(0);
+    TensorView offsets = backend->getOutputView(1);
+    TensorView displacementsFwd = backend->getOutputView(2);
+    TensorView displacementsBwd = backend->getOutputView(3);
+    
+    Posenet posenet(backend);
+    
+    for (auto _ : state) {
+        std::vector<Person> poses = posenet.decodeMultiplePoses(heatmaps, offsets, displacementsFwd, displacementsBwd, 480, 640, 15,
+        0.5f, 20.0f);
+        benchmark::DoNotOptimize(poses.data());
+    }
+}
+BENCHMARK(BM_DecodeMultiplePoses)->Apply(inputSizesAndStrides)->Unit(benchmark::kMicrosecond);
+
+//everything estimateSinglePose does around the model (preprocess a 640x480 BGR frame into the input, decode the outputs), with
+//a synthetic backend standing in for the model so it runs without one
+static void BM_EndToEndSynthetic(benchmark::State &state) {
+    Posenet posenet(syntheticBackend((int)state.range(0), (int)state.range(1), 1));
+    posenet.setInputFormat(PixelFormat::BGR);
+    
+    cv::Mat img = syntheticImage(480, 640, CV_8UC3);
+    
+    FixedPerson<> person;
+    posenet.estimateSinglePose(img, person);
+    
+    uint64_t startAllocations = heapAllocations.load();
+    
+    for (auto _ : state) {
+        posenet.estimateSinglePose(img, person);
+        benchmark::DoNotOptimize(person.score);
+    }
+    
+    state.counters["allocs_per_frame"] = allocationsPerFrame(state, startAllocations);
+    
+    PosenetStats &stats = posenet.getStats();
+    
+    state.counters["preprocess_us"] = stats.getSummary(Stage::PREPROCESS).meanNanos / 1000.0;
+    state.counters["decode_us"] = stats.getSummary(Stage::DECODE).meanNanos / 1000.0;
+}
+BENCHMARK(BM_EndToEndSynthetic)->Apply(inputSizesAndStrides)->Unit(benchmark::kMicrosecond);
+
+//tiled multi-pose on a 4K BGR frame (257x257 synthetic model, 2 people per tile), with the given percentage of the frame's
+//columns changing every frame: tiles that didn't change are skipped, so the cost should follow the changing area
+static void BM_TiledSynthetic(benchmark::State &state) {
+    Posenet posenet(syntheticBackend(257, 16, 2));
+    posenet.setInputFormat(PixelFormat::BGR);
+    
+    PosenetTiler tiler(&posenet);
+    
+    cv::Mat img = syntheticImage(2160, 3840, CV_8UC3);
+    int changingCols = (int)(img.cols * state.range(0) / 100);
+    
+    tiler.estimateMultiplePoses(img);
+    
+    uint64_t tilesRun = 0;
+    uint8_t value = 0;
+    
+    for (auto _ : state) {
+        //repaint the changing strip so its tiles have to run again
+        value += 64;
+        
+        for (int r = 0; r < img.rows; r++) {
+            memset(img.ptr(r), value, (size_t)changingCols * 3);
+        }
+        
+        std::vector<Person> persons = tiler.estimateMultiplePoses(img);
+        benchmark::DoNotOptimize(persons.data());
+        
+        tilesRun += tiler.getLastFrameStats().tilesRun;
+    }
+    
+    state.counters["tiles"] = tiler.getLastFrameStats().tiles;
+    state.counters["tiles_run_per_frame"] = benchmark::Counter((double)tilesRun, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_TiledSynthetic)->Arg(0)->Arg(10)->Arg(100)->Unit(benchmark::kMillisecond);
+
+//count people with random keypoints and scores spread over a 1080p frame, for the analytics benchmarks
+static std::vector<Person> syntheticPersons(int count) {
+    std::mt19937 rng(99);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    
+    std::vector<Person> persons(count);
+    
+    for (Person &person : persons) {
+        person.keyPoints.resize(NUM_KEYPOINTS);
+        
+        for (int k = 0; k < NUM_KEYPOINTS; k++) {
+            person.keyPoints[k].bodyPart = static_cast<BodyPart>(k);
+            person.keyPoints[k].position.x = unit(rng) * 1920;
+            person.keyPoints[k].position.y = unit(rng) * 1080;
+            person.keyPoints[k].score = unit(rng);
+        }
+        
+        person.score = unit(rng);
+    }
+    
+    return persons;
+}
+
+//bounding boxes of the confident keypoints of 4000 people: straight off the Persons (arg 0) vs off a PoseBatch's columns (arg 1)
+static void BM_BoundingBoxes(benchmark::State &state) {
+    const int numPersons = 4000;
+    const float minScore = 0.3f;
+    
+    std::vector<Person> persons = syntheticPersons(numPersons);
+    std::vector<PoseBox> boxes(numPersons);
+    
+    PoseBatch batch;
+    
+    for (int i = 0; i < numPersons; i += 4) {
+        batch.addFrame(std::vector<Person>(persons.begin() + i, persons.begin() + i + 4));
+    }
+    
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            for (int p = 0; p < numPersons; p++) {
+                PoseBox &box = boxes[p];
+                box = PoseBox();
+                box.minX = box.minY = INFINITY;
+                box.maxX = box.maxY = -INFINITY;
+                
+                for (const KeyPoint &keyPoint : persons[p].keyPoints) {
+                    if (keyPoint.score >= minScore) {
+                        box.minX = std::min(box.minX, keyPoint.position.x);
+                        box.minY = std::min(box.minY, keyPoint.position.y);
+                        box.maxX = std::max(box.maxX, keyPoint.position.x);
+                        box.maxY = std::max(box.maxY, keyPoint.position.y);
+                        box.numKeyPoints++;
+                    }
+                }
+            }
+        }
+        else {
+            batch.boundingBoxes(minScore, boxes);
+        }
+        
+        benchmark::DoNotOptimize(boxes.data());
+    }
+    
+    state.SetItemsProcessed(state.iterations() * numPersons);
+}
+BENCHMARK(BM_BoundingBoxes)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+//appending single-person frames to a pose log with one write() per frame (arg 0) vs through the default 256 KB buffer (arg 1)
+static void BM_PoseLogAppend(benchmark::State &state) {
+    std::vector<Person> persons = syntheticPersons(64);
+    
+    PoseLogConfig config;
+    config.frameRows = 480;
+    config.frameCols = 640;
+    
+    if (state.range(0) == 0) {
+        config.bufferBytes = 0;
+    }
+    
+    PoseLogWriter writer;
+    
+    if (!writer.open("/tmp/posenet_benchmark.plog", config)) {
+        state.SkipWithError("couldn't create /tmp/posenet_benchmark.plog");
+        return;
+    }
+    
+    int64_t frame = 0;
+    
+    for (auto _ : state) {
+        writer.append(frame, persons[frame % persons.size()]);
+        frame++;
+    }
+    
+    writer.close();
+    unlink("/tmp/posenet_benchmark.plog");
+    
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PoseLogAppend)->Arg(0)->Arg(1);
+
+//full estimateSinglePose on a 640x480 BGR frame (needs the model), across input sizes and interpreter thread counts
+static void BM_EndToEnd(benchmark::State &state) {
+    Posenet* posenet = modelPosenet((int)state.range(0), (int)state.range(1));
+    
+    if (posenet == NULL) {
+        state.SkipWithError("set POSENET_MODEL to run this benchmark");
+        return;
+    }
+    
+    posenet->setInputFormat(PixelFormat::BGR);
+    cv::Mat img = syntheticImage(480, 640, CV_8UC3);
+    
+    FixedPerson<> person;
+    
+    uint64_t startAllocations = heapAllocations.load();
+    
+    for (auto _ : state) {
+        posenet->estimateSinglePose(img, person);
+        benchmark::DoNotOptimize(person.score);
+    }
+    
+    //our side of the frame doesn't allocate, so anything counted here comes from the interpreter
+    state.counters["allocs_per_frame"] = allocationsPerFrame(state, startAllocations);
+    
+    //break the latency down by stage
+    PosenetStats &stats = posenet->getStats();
+    
+    state.counters["preprocess_us"] = stats.getSummary(Stage::PREPROCESS).meanNanos / 1000.0;
+    state.counters["invoke_us"] = stats.getSummary(Stage::INVOKE).meanNanos / 1000.0;
+    state.counters["decode_us"] = stats.getSummary(Stage::DECODE).meanNanos / 1000.0;
+    state.counters["invoke_p99_us"] = stats.getSummary(Stage::INVOKE).p99Nanos / 1000.0;
+    
+    posenet->close();
+    delete posenet;
+}
+BENCHMARK(BM_EndToEnd)->Apply(inputSizesAndThreads)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,881 @@
+//posenet_batch: offline pose estimation over a video file or a directory of images, for reprocessing archives.
+//
+//Frames are decoded on prefetch threads, run through a PosenetPool (one worker thread per interpreter) and written in frame
+//order to JSONL or a binary pose log (PoseLog.h). A single video is split into chunks that the decoder threads seek to
+//independently, so one large input keeps every core busy instead of being limited by a single decode thread. At the end
+//(and every --progress seconds) it reports sustained frames/sec and how busy each stage was, to show where the bottleneck is.
+//
+//    posenet_batch --model posenet.tflite --input clip.mp4 --output clip.plog
+//    posenet_batch --model posenet.tflite --input frames/ --output poses.jsonl --interpreters 16 --decoders 8 --multi 5
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "Posenet.h"
+#include "PosenetPool.h"
+#include "PosenetStats.h"
+#include "PoseLog.h"
+
+using namespace ORB_SLAM2;
+
+struct Options {
+    std::string model;
+    std::string input;
+    std::string output;
+    
+    //"jsonl" or "poselog" (default: poselog for a .plog output, jsonl otherwise)
+    std::string format;
+    
+    Device device = Device::CPU;
+    
+    //XNNPACK packed weight cache shared by every interpreter (empty = none)
+    std::string weightCache;
+    
+    //0 = pick from the core count
+    int interpreters = 0;
+    int threadsPerInterpreter = 1;
+    int decoders = 0;
+    
+    //decoded frames waiting for an interpreter (0 = 2 per interpreter)
+    int queueFrames = 0;
+    
+    //frames per decoder seek when splitting a video
+    int chunkFrames = 300;
+    
+    //0 = single pose per frame, otherwise the most people multi-pose decoding keeps
+    int multi = 0;
+    float scoreThreshold = 0.5f;
+    float nmsRadius = 20.0f;
+    
+    //timestamps for image directories, which have none of their own
+    double fps = 30.0;
+    
+    double progressSeconds = 5.0;
+};
+
+//one decoded frame on its way to an interpreter
+struct FrameJob {
+    uint64_t index = 0;
+    int64_t timestamp = 0;
+    cv::Mat image;
+};
+
+//one frame's output on its way to the writer; failed frames (unreadable image, seek past the real end of a video) keep their
+//place in the order but aren't written
+struct FrameResult {
+    int64_t timestamp = 0;
+    int rows = 0;
+    int cols = 0;
+    bool failed = false;
+    std::vector<Person> persons;
+};
+
+//bounded queue for several producers and consumers. pop() returns false once the queue is closed and drained
+template <typename T>
+class BlockingQueue {
+    std::deque<T> items;
+    size_t capacity;
+    bool closed = false;
+    
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    
+    public:
+        explicit BlockingQueue(size_t pCapacity) : capacity(pCapacity)
+        {}
+        
+        void push(T &item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [this] { return items.size() < capacity || closed; });
+            
+            if (!closed) {
+                items.push_back(std::move(item));
+                notEmpty.notify_one();
+            }
+        }
+        
+        bool pop(T &item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+            
+            if (items.empty()) {
+                return false;
+            }
+            
+            item = std::move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+            
+            return true;
+        }
+        
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            notEmpty.notify_all();
+            notFull.notify_all();
+        }
+};
+
+//results arrive in whatever order the interpreters finish them; take() hands them out in frame order
+class OrderedResults {
+    std::map<uint64_t, FrameResult> pending;
+    uint64_t next = 0;
+    bool closed = false;
+    
+    std::mutex mutex;
+    std::condition_variable ready;
+    
+    public:
+        void put(uint64_t index, FrameResult &result) {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending[index] = std::move(result);
+            
+            if (index == next) {
+                ready.notify_one();
+            }
+        }
+        
+        bool take(uint64_t &index, FrameResult &result) {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] { return closed || (!pending.empty() && pending.begin()->first == next); });
+            
+            if (pending.empty()) {
+                return false;
+            }
+            
+            //once everything is in, indices nobody produced (a video shorter than its reported frame count) are skipped
+            auto first = pending.begin();
+            index = first->first;
+            result = std::move(first->second);
+            pending.erase(first);
+            next = index + 1;
+            
+            return true;
+        }
+        
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            ready.notify_all();
+        }
+};
+
+//everything the stage threads share
+struct Pipeline {
+    const Options* options = NULL;
+    PosenetPool* pool = NULL;
+    
+    BlockingQueue<FrameJob>* frames = NULL;
+    OrderedResults results;
+    
+    //JSONL output, opened by main before anything runs
+    FILE* out = NULL;
+    
+    //image directory input (sorted), or empty for a video
+    std::vector<std::string> files;
+    
+    //video split: chunks handed out in order, each chunkFrames long (totalFrames = 0: read sequentially to the end)
+    uint64_t totalFrames = 0;
+    std::atomic<uint64_t> nextItem;
+    
+    //per-stage busy time summed over the stage's threads, and how long workers sat waiting for a decoded frame
+    std::atomic<uint64_t> decodeNanos;
+    std::atomic<uint64_t> writeNanos;
+    std::atomic<uint64_t> starvedNanos;
+    
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> failed;
+    std::atomic<uint64_t> persons;
+    std::atomic<bool> writeError;
+    
+    Pipeline() : nextItem(0), decodeNanos(0), writeNanos(0), starvedNanos(0), written(0), failed(0), persons(0),
+                 writeError(false)
+    {}
+};
+
+static void usage() {
+    fprintf(stderr,
+        "usage: posenet_batch --model FILE --input VIDEO|DIR --output FILE [options]\n"
+        "  --format jsonl|poselog    output format (default: poselog for .plog files, jsonl otherwise; '-' writes JSONL to stdout)\n"
+        "  --device cpu|xnnpack|xnnpack-fp16|xnnpack-int8\n"
+        "  --weight-cache FILE       keep XNNPACK's packed weights in FILE, so later runs start faster\n"
+        "  --interpreters N          interpreters in the pool (default: one per core / threads)\n"
+        "  --threads N               threads per interpreter (default 1, best for throughput)\n"
+        "  --decoders N              prefetch/decode threads (default: a quarter of the cores, at least 2)\n"
+        "  --queue N                 decoded frames waiting for an interpreter (default 2 per interpreter)\n"
+        "  --chunk N                 frames per decoder seek when splitting a video (default 300)\n"
+        "  --multi N                 multi-pose decoding, keeping up to N people per frame (default: single pose)\n"
+        "  --score X                 multi-pose score threshold (default 0.5)\n"
+        "  --nms X                   multi-pose NMS radius in pixels (default 20)\n"
+        "  --fps X                   frame rate used for image directory timestamps (default 30)\n"
+        "  --progress X              seconds between progress lines, 0 for none (default 5)\n");
+}
+
+static bool parseDevice(const std::string &name, Device &device) {
+    if (name == "cpu") {
+        device = Device::CPU;
+    }
+    else if (name == "xnnpack") {
+        device = Device::XNNPACK;
+    }
+    else if (name == "xnnpack-fp16") {
+        device = Device::XNNPACK_FP16;
+    }
+    else if (name == "xnnpack-int8") {
+        device = Device::XNNPACK_INT8;
+    }
+    else {
+        return false;
+    }
+    
+    return true;
+}
+
+static bool parseOptions(int argc, char** argv, Options &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        }
+        
+        if (i + 1 >= argc) {
+            fprintf(stderr, "posenet_batch: %s needs a value\n", arg.c_str());
+            return false;
+        }
+        
+        const char* value = argv[++i];
+        
+        if (arg == "--model") {
+            options.model = value;
+        }
+        else if (arg == "--input") {
+            options.input = value;
+        }
+        else if (arg == "--output") {
+            options.output = value;
+        }
+        else if (arg == "--format") {
+            options.format = value;
+        }
+        else if (arg == "--device") {
+            if (!parseDevice(value, options.device)) {
+                fprintf(stderr, "posenet_batch: unknown device %s\n", value);
+                return false;
+            }
+        }
+        else if (arg == "--weight-cache") {
+            options.weightCache = value;
+        }
+        else if (arg == "--interpreters") {
+            options.interpreters = atoi(value);
+        }
+        else if (arg == "--threads") {
+            options.threadsPerInterpreter = std::max(atoi(value), 1);
+        }
+        else if (arg == "--decoders") {
+            options.decoders = atoi(value);
+        }
+        else if (arg == "--queue") {
+            options.queueFrames = atoi(value);
+        }
+        else if (arg == "--chunk") {
+            options.chunkFrames = std::max(atoi(value), 1);
+        }
+        else if (arg == "--multi") {
+            options.multi = std::max(atoi(value), 0);
+        }
+        else if (arg == "--score") {
+            options.scoreThreshold = (float)atof(value);
+        }
+        else if (arg == "--nms") {
+            options.nmsRadius = (float)atof(value);
+        }
+        else if (arg == "--fps") {
+            options.fps = atof(value);
+        }
+        else if (arg == "--progress") {
+            options.progressSeconds = atof(value);
+        }
+        else {
+            fprintf(stderr, "posenet_batch: unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    
+    if (options.model.empty() || options.input.empty() || options.output.empty()) {
+        fprintf(stderr, "posenet_batch: --model, --input and --output are required\n");
+        return false;
+    }
+    
+    if (options.format.empty()) {
+        bool plog = options.output.size() > 5 && options.output.compare(options.output.size() - 5, 5, ".plog") == 0;
+        options.format = plog ? "poselog" : "jsonl";
+    }
+    
+    if (options.format != "jsonl" && options.format != "poselog") {
+        fprintf(stderr, "posenet_batch: unknown format %s\n", options.format.c_str());
+        return false;
+    }
+    
+    if (options.format == "poselog" && options.output == "-") {
+        fprintf(stderr, "posenet_batch: pose logs can't be written to stdout\n");
+        return false;
+    }
+    
+    if (options.fps <= 0.0) {
+        options.fps = 30.0;
+    }
+    
+    return true;
+}
+
+static bool isDirectory(const std::string &path) {
+    struct stat st;
+    
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+//image files in a directory, sorted by name so frame order is the lexical order of the file names
+static std::vector<std::string> listImages(const std::string &directory) {
+    static const char* const EXTENSIONS[] = {".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff", ".webp", ".ppm", ".pgm"};
+    
+    std::vector<std::string> files;
+    DIR* dir = opendir(directory.c_str());
+    
+    if (dir == NULL) {
+        return files;
+    }
+    
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        size_t dot = name.rfind('.');
+        
+        if (dot == std::string::npos) {
+            continue;
+        }
+        
+        std::string extension = name.substr(dot);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        
+        for (const char* known : EXTENSIONS) {
+            if (extension == known) {
+                files.push_back(directory + "/" + name);
+                break;
+            }
+        }
+    }
+    
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    
+    return files;
+}
+
+//hand a decoded (or failed) frame on: failures go straight to the writer so the frame order doesn't stall on them
+static void emitFrame(Pipeline &pipeline, uint64_t index, int64_t timestamp, cv::Mat &image) {
+    if (image.empty()) {
+        FrameResult result;
+        result.timestamp = timestamp;
+        result.failed = true;
+        pipeline.results.put(index, result);
+        return;
+    }
+    
+    FrameJob job;
+    job.index = index;
+    job.timestamp = timestamp;
+    job.image = image;
+    
+    pipeline.frames->push(job);
+}
+
+//decoder thread for an image directory: files are claimed one at a time, so slow (large) images don't hold up the others
+static void decodeImages(Pipeline &pipeline) {
+    double nanosPerFrame = 1e9 / pipeline.options->fps;
+    
+    while (true) {
+        uint64_t index = pipeline.nextItem++;
+        
+        if (index >= pipeline.files.size()) {
+            break;
+        }
+        
+        uint64_t start = PosenetStats::nowNanos();
+        cv::Mat image = cv::imread(pipeline.files[index], cv::IMREAD_COLOR);
+        pipeline.decodeNanos += PosenetStats::nowNanos() - start;
+        
+        if (image.empty()) {
+            fprintf(stderr, "posenet_batch: couldn't read %s\n", pipeline.files[index].c_str());
+        }
+        
+        emitFrame(pipeline, index, (int64_t)(index * nanosPerFrame), image);
+    }
+}
+
+//decoder thread for a video: with a known frame count the decoders claim consecutive chunks and seek to them, each with its own
+//capture; chunks are claimed in order so the writer never has to hold more than about decoders x chunk frames of results.
+//Without one (some streams and containers don't say) a single decoder reads straight through
+static void decodeVideo(Pipeline &pipeline) {
+    cv::VideoCapture capture(pipeline.options->input);
+    
+    if (!capture.isOpened()) {
+        fprintf(stderr, "posenet_batch: couldn't open %s\n", pipeline.options->input.c_str());
+        return;
+    }
+    
+    uint64_t chunk = (uint64_t)pipeline.options->chunkFrames;
+    
+    //where the capture will read next, so a decoder that gets the chunk right after its last one doesn't seek
+    uint64_t position = 0;
+    
+    while (true) {
+        uint64_t begin;
+        uint64_t end;
+        
+        if (pipeline.totalFrames > 0) {
+            begin = pipeline.nextItem++ * chunk;
+            
+            if (begin >= pipeline.totalFrames) {
+                break;
+            }
+            
+            end = std::min(begin + chunk, pipeline.totalFrames);
+        }
+        else {
+            begin = 0;
+            end = UINT64_MAX;
+        }
+        
+        if (begin != position) {
+            capture.set(cv::CAP_PROP_POS_FRAMES, (double)begin);
+        }
+        
+        for (uint64_t index = begin; index < end; index++) {
+            cv::Mat image;
+            
+            uint64_t start = PosenetStats::nowNanos();
+            bool ok = capture.read(image);
+            int64_t timestamp = (int64_t)(capture.get(cv::CAP_PROP_POS_MSEC) * 1e6);
+            pipeline.decodeNanos += PosenetStats::nowNanos() - start;
+            
+            if (!ok) {
+                //reading straight through: this is the end. Chunked: the container promised more frames than it has, so the
+                //rest of the chunk fails and the writer skips it
+                if (pipeline.totalFrames == 0) {
+                    return;
+                }
+                
+                for (; index < end; index++) {
+                    cv::Mat none;
+                    emitFrame(pipeline, index, 0, none);
+                }
+                
+                break;
+            }
+            
+            emitFrame(pipeline, index, timestamp, image);
+        }
+        
+        position = end;
+        
+        if (pipeline.totalFrames == 0) {
+            break;
+        }
+    }
+}
+
+//worker thread: one per interpreter, so each always has an interpreter free and the pool's busy time is inference alone
+static void inferFrames(Pipeline &pipeline) {
+    const Options &options = *pipeline.options;
+    
+    FrameJob job;
+    
+    while (true) {
+        uint64_t waitStart = PosenetStats::nowNanos();
+        
+        if (!pipeline.frames->pop(job)) {
+            break;
+        }
+        
+        pipeline.starvedNanos += PosenetStats::nowNanos() - waitStart;
+        
+        FrameResult result;
+        result.timestamp = job.timestamp;
+        result.rows = job.image.rows;
+        result.cols = job.image.cols;
+        
+        {
+            PosenetPool::Lease lease = pipeline.pool->acquire();
+            lease->setInputFormat(PixelFormat::BGR);
+            
+            if (options.multi > 0) {
+                result.persons = lease->estimateMultiplePoses(job.image, options.multi, options.scoreThreshold, options.nmsRadius);
+            }
+            else {
+                result.persons.resize(1);
+                result.failed = !lease->estimateSinglePose(job.image, result.persons[0]);
+            }
+        }
+        
+        //release the image before waiting on anything else
+        job.image = cv::Mat();
+        pipeline.results.put(job.index, result);
+    }
+}
+
+static void writeJsonString(FILE* out, const std::string &value) {
+    fputc('"', out);
+    
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        }
+        else if ((unsigned char)c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        }
+        else {
+            fputc(c, out);
+        }
+    }
+    
+    fputc('"', out);
+}
+
+//one line per frame: {"frame":N,"timestamp":ns,["file":...,]"persons":[{"score":s,"keypoints":[[x,y,score],...]},...]}
+static void writeJsonLine(FILE* out, Pipeline &pipeline, uint64_t index, const FrameResult &result) {
+    fprintf(out, "{\"frame\":%llu,\"timestamp\":%lld,", (unsigned long long)index, (long long)result.timestamp);
+    
+    if (!pipeline.files.empty()) {
+        fputs("\"file\":", out);
+        writeJsonString(out, pipeline.files[index]);
+        fputc(',', out);
+    }
+    
+    fputs("\"persons\":[", out);
+    
+    for (size_t p = 0; p < result.persons.size(); p++) {
+        const Person &person = result.persons[p];
+        
+        fprintf(out, "%s{\"score\":%.4f,\"keypoints\":[", p == 0 ? "" : ",", person.score);
+        
+        for (size_t k = 0; k < person.keyPoints.size(); k++) {
+            const KeyPoint &keyPoint = person.keyPoints[k];
+            
+            fprintf(out, "%s[%.2f,%.2f,%.4f]", k == 0 ? "" : ",", keyPoint.position.x, keyPoint.position.y, keyPoint.score);
+        }
+        
+        fputs("]}", out);
+    }
+    
+    fputs("]}\n", out);
+}
+
+//writer thread: takes results in frame order, so the output is ordered whatever order the interpreters finished in
+static void writeResults(Pipeline &pipeline) {
+    const Options &options = *pipeline.options;
+    bool json = options.format == "jsonl";
+    
+    FILE* out = pipeline.out;
+    PoseLogWriter log;
+    int logRows = 0;
+    int logCols = 0;
+    
+    uint64_t index;
+    FrameResult result;
+    
+    while (pipeline.results.take(index, result)) {
+        if (result.failed) {
+            pipeline.failed++;
+            continue;
+        }
+        
+        uint64_t start = PosenetStats::nowNanos();
+        
+        if (json) {
+            if (out != NULL) {
+                writeJsonLine(out, pipeline, index, result);
+            }
+        }
+        else if (!pipeline.writeError) {
+            //the log's coordinates are quantized against the frame size, which isn't known until the first frame is decoded
+            if (!log.isOpen()) {
+                PoseLogConfig config;
+                config.frameRows = result.rows;
+                config.frameCols = result.cols;
+                config.maxPersons = std::max(options.multi, 1);
+                config.bufferBytes = 1 << 20;
+                
+                if (!log.open(options.output, config)) {
+                    fprintf(stderr, "posenet_batch: couldn't create %s\n", options.output.c_str());
+                    pipeline.writeError = true;
+                }
+                
+                logRows = result.rows;
+                logCols = result.cols;
+            }
+            
+            //every frame is quantized against the one frame size in the header: a different sized frame would come out
+            //clamped and scaled wrong, so it's left out and counted as failed
+            if (log.isOpen() && (result.rows != logRows || result.cols != logCols)) {
+                fprintf(stderr, "posenet_batch: frame %llu%s%s is %dx%d, the pose log holds %dx%d frames; skipped\n",
+                        (unsigned long long)index, pipeline.files.empty() ? "" : " ",
+                        pipeline.files.empty() ? "" : pipeline.files[index].c_str(), result.cols, result.rows, logCols, logRows);
+                
+                pipeline.writeNanos += PosenetStats::nowNanos() - start;
+                pipeline.failed++;
+                continue;
+            }
+            
+            if (log.isOpen() && !log.append(result.timestamp, result.persons)) {
+                fprintf(stderr, "posenet_batch: writing %s failed\n", options.output.c_str());
+                pipeline.writeError = true;
+            }
+        }
+        
+        pipeline.writeNanos += PosenetStats::nowNanos() - start;
+        pipeline.persons += result.persons.size();
+        pipeline.written++;
+    }
+    
+    if (out != NULL) {
+        if (fflush(out) != 0) {
+            fprintf(stderr, "posenet_batch: writing %s failed\n", options.output.c_str());
+            pipeline.writeError = true;
+        }
+        
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+    
+    if (log.isOpen() && !log.flush()) {
+        pipeline.writeError = true;
+    }
+    
+    log.close();
+}
+
+static double percent(uint64_t busyNanos, uint64_t wallNanos, int threads) {
+    if (wallNanos == 0 || threads <= 0) {
+        return 0.0;
+    }
+    
+    return 100.0 * busyNanos / ((double)wallNanos * threads);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+    
+    int cores = std::max((int)std::thread::hardware_concurrency(), 1);
+    
+    //throughput comes from running frames side by side: one single-threaded interpreter per core beats fewer wide ones
+    int interpreters = options.interpreters > 0 ? options.interpreters : std::max(cores / options.threadsPerInterpreter, 1);
+    int decoders = options.decoders > 0 ? options.decoders : std::max(cores / 4, 2);
+    int queueFrames = options.queueFrames > 0 ? options.queueFrames : 2 * interpreters;
+    
+    Pipeline pipeline;
+    pipeline.options = &options;
+    
+    //create the output before loading anything, so a bad path fails now rather than after the whole archive has run. The
+    //pose log can't be written until the first frame gives it a frame size, but creating the file checks it's writable
+    if (options.output == "-") {
+        pipeline.out = stdout;
+    }
+    else {
+        pipeline.out = fopen(options.output.c_str(), "w");
+        
+        if (pipeline.out == NULL) {
+            fprintf(stderr, "posenet_batch: couldn't create %s: %s\n", options.output.c_str(), strerror(errno));
+            return 1;
+        }
+        
+        if (options.format != "jsonl") {
+            fclose(pipeline.out);
+            pipeline.out = NULL;
+        }
+    }
+    
+    if (pipeline.out != NULL) {
+        //big stdio buffer: one write() per megabyte instead of one per line
+        setvbuf(pipeline.out, NULL, _IOFBF, 1 << 20);
+    }
+    
+    bool directory = isDirectory(options.input);
+    
+    if (directory) {
+        pipeline.files = listImages(options.input);
+        
+        if (pipeline.files.empty()) {
+            fprintf(stderr, "posenet_batch: no images in %s\n", options.input.c_str());
+            return 1;
+        }
+        
+        decoders = std::min(decoders, (int)pipeline.files.size());
+    }
+    else {
+        cv::VideoCapture probe(options.input);
+        
+        if (!probe.isOpened()) {
+            fprintf(stderr, "posenet_batch: couldn't open %s\n", options.input.c_str());
+            return 1;
+        }
+        
+        double frameCount = probe.get(cv::CAP_PROP_FRAME_COUNT);
+        pipeline.totalFrames = frameCount > 0 ? (uint64_t)frameCount : 0;
+        
+        uint64_t chunks = (pipeline.totalFrames + options.chunkFrames - 1) / options.chunkFrames;
+        
+        if (pipeline.totalFrames == 0) {
+            fprintf(stderr, "posenet_batch: %s doesn't report a frame count, decoding on one thread\n", options.input.c_str());
+            decoders = 1;
+        }
+        else {
+            decoders = (int)std::min((uint64_t)decoders, chunks);
+        }
+    }
+    
+    PosenetPool pool(options.model.c_str(), options.device, interpreters, options.threadsPerInterpreter,
+                     options.weightCache.empty() ? NULL : options.weightCache.c_str());
+    
+    if (pool.size() == 0) {
+        fprintf(stderr, "posenet_batch: couldn't load %s\n", options.model.c_str());
+        return 1;
+    }
+    
+    //build and warm every interpreter before the clock starts
+    {
+        std::vector<PosenetPool::Lease> leases;
+        
+        for (int i = 0; i < pool.size(); i++) {
+            leases.push_back(pool.acquire());
+            leases.back()->prepare();
+        }
+    }
+    
+    pool.resetStats();
+    pipeline.pool = &pool;
+    
+    BlockingQueue<FrameJob> frames((size_t)queueFrames);
+    pipeline.frames = &frames;
+    
+    fprintf(stderr, "posenet_batch: %s (%s), %d decoders, %d interpreters x %d threads, %d cores\n", options.input.c_str(),
+            directory ? "image directory" : "video", decoders, pool.size(), options.threadsPerInterpreter, cores);
+    
+    uint64_t startNanos = PosenetStats::nowNanos();
+    
+    std::vector<std::thread> decodeThreads;
+    std::vector<std::thread> inferThreads;
+    
+    for (int i = 0; i < decoders; i++) {
+        decodeThreads.emplace_back(directory ? decodeImages : decodeVideo, std::ref(pipeline));
+    }
+    
+    for (int i = 0; i < pool.size(); i++) {
+        inferThreads.emplace_back(inferFrames, std::ref(pipeline));
+    }
+    
+    std::thread writeThread(writeResults, std::ref(pipeline));
+    
+    //shut down stage by stage: the workers drain the frame queue once the decoders are done, then the writer drains the results
+    std::atomic<bool> finished(false);
+    
+    std::thread closer([&] {
+        for (std::thread &thread : decodeThreads) {
+            thread.join();
+        }
+        
+        frames.close();
+        
+        for (std::thread &thread : inferThreads) {
+            thread.join();
+        }
+        
+        pipeline.results.close();
+        writeThread.join();
+        
+        finished = true;
+    });
+    
+    uint64_t lastReport = startNanos;
+    uint64_t lastWritten = 0;
+    
+    while (!finished) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        
+        uint64_t now = PosenetStats::nowNanos();
+        
+        if (options.progressSeconds > 0 && now - lastReport >= options.progressSeconds * 1e9) {
+            uint64_t written = pipeline.written.load();
+            
+            fprintf(stderr, "posenet_batch: %llu frames, %.1f frames/s\n", (unsigned long long)written,
+                    (written - lastWritten) * 1e9 / (now - lastReport));
+            
+            lastReport = now;
+            lastWritten = written;
+        }
+    }
+    
+    closer.join();
+    
+    uint64_t wallNanos = PosenetStats::nowNanos() - startNanos;
+    PoolStats poolStats = pool.getStats();
+    
+    uint64_t written = pipeline.written.load();
+    double seconds = wallNanos / 1e9;
+    
+    double decodeBusy = percent(pipeline.decodeNanos.load(), wallNanos, decoders);
+    double inferBusy = poolStats.utilization * 100.0;
+    double writeBusy = percent(pipeline.writeNanos.load(), wallNanos, 1);
+    double starved = percent(pipeline.starvedNanos.load(), wallNanos, pool.size());
+    
+    fprintf(stderr, "posenet_batch: %llu frames (%llu failed), %llu people in %.2f s: %.1f frames/s\n",
+            (unsigned long long)written, (unsigned long long)pipeline.failed.load(), (unsigned long long)pipeline.persons.load(),
+            seconds, seconds > 0 ? written / seconds : 0.0);
+    fprintf(stderr, "  decode  %3d threads                  %5.1f%% busy\n", decoders, decodeBusy);
+    fprintf(stderr, "  infer   %3d interpreters x %d threads %5.1f%% busy, %.1f%% waiting for frames\n", pool.size(),
+            options.threadsPerInterpreter, inferBusy, starved);
+    fprintf(stderr, "  write     1 thread                   %5.1f%% busy\n", writeBusy);
+    
+    //the busiest stage is the one to give more threads (or hardware) to
+    const char* busiest = "inference";
+    double busiestPercent = inferBusy;
+    
+    if (decodeBusy > busiestPercent) {
+        busiest = "decode (try more --decoders)";
+        busiestPercent = decodeBusy;
+    }
+    
+    if (writeBusy > busiestPercent) {
+        busiest = "write";
+    }
+    
+    fprintf(stderr, "  bottleneck: %s\n", busiest);
+    
+    return pipeline.writeError ? 1 : 0;
+}